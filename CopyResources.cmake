@@ -0,0 +1,7 @@
+# Copies the Resources folder into the build with the modification times of
+# the files, skipping the ones that are there already. The converted meshes
+# and textures store the size and time of their source (getSourceStamp), a
+# fresh copy on every build would make all of them look out of date.
+#
+#   cmake -DSOURCE=<directory> -DDESTINATION=<directory> -P CopyResources.cmake
+file(COPY "${SOURCE}/" DESTINATION "${DESTINATION}")
@@ -26,6 +26,23 @@ in struct Material {
     float shininess;
 } material;
 
+// Materials of the loaded models, see MAX_TABLE_MATERIALS in Model.h
+struct TableMaterial {
+    vec3 diffuseColor;
+    vec3 ambientColor;
+    vec3 specularColor;
+    float shininess;
+};
+
+layout(std140) uniform MaterialTable {
+    TableMaterial tableMaterials[256];
+};
+
+// Index into the table, -1 for the per-vertex material
+flat in int passMaterial;
+
+Material surface;
+
 in vec3 passPosition;
 in vec3 passNormal;
 in vec2 passTexCoord;
@@ -90,7 +107,7 @@ vec3 getShading(Light light, vec3 lightDir, vec3 normal, vec3 diffuseToUse){
         float specularStrength = 0.5;
         vec3 viewDir = normalize(viewPos - passPosition);
         vec3 reflectDir = reflect(-lightDir, normal);
-        float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+        float spec = pow(max(dot(viewDir, reflectDir), 0.0), surface.shininess);
         specular = spec * specularStrength * light.specularColor;
         
     }
@@ -108,7 +125,7 @@ vec3 getShading(Light light, vec3 lightDir, vec3 normal, vec3 diffuseToUse){
         }
     }
     
-    vec3 result = material.ambientColor * ambient + diffuseToUse * diffuse + material.specularColor * specular;
+    vec3 result = surface.ambientColor * ambient + diffuseToUse * diffuse + surface.specularColor * specular;
     
     return result;
 }
@@ -116,6 +133,12 @@ vec3 getShading(Light light, vec3 lightDir, vec3 normal, vec3 diffuseToUse){
 
 void main()
 {
+    surface = material;
+    if (passMaterial >= 0) {
+        TableMaterial entry = tableMaterials[passMaterial];
+        surface = Material(entry.ambientColor, entry.diffuseColor, entry.specularColor, entry.shininess);
+    }
+
     // For shadows
     vec4 fragLightCoord = light.projectionMatrix * light.viewMatrix * vec4(passPosition, 1.0);
     float percentageShadow = getShadowMultiplier(fragLightCoord, false);
@@ -135,7 +158,7 @@ void main()
         finalColor = getShading(light, lightDir, normal, texDiffuse);
         
     }else{
-        finalColor = getShading(light, lightDir, normal, material.diffuseColor);
+        finalColor = getShading(light, lightDir, normal, surface.diffuseColor);
     }
 
     //if(tintOn) fragColor = vec4(1.f, 0.f, 0.f, 1.0);
@@ -6,18 +6,74 @@ uniform mat4 projMatrix;
 uniform mat4 viewMatrix;
 uniform mat4 modelMatrix;
 
+// Animated ocean, see WaveSettings in Terrain.h
+uniform bool wavesOn;
+uniform float waveTime;
+uniform float waveAmplitude;
+uniform float waveFrequency;
+uniform float waveSpeed;
+uniform float waveDirection;
+uniform int waveOctaves;
+uniform float waveLacunarity;
+uniform float wavePersistence;
+
+// Height of the waves at world position p (x) and its derivatives along x and z (y, z)
+vec3 oceanWaves(vec2 p)
+{
+    vec3 wave = vec3(0.f);
+    float amplitude = waveAmplitude;
+    float frequency = waveFrequency;
+    for (int o = 0; o < waveOctaves; o++) {
+        // Golden angle steps, so no two octaves run in the same direction
+        float angle = waveDirection + float(o) * 2.39996f;
+        vec2 direction = vec2(cos(angle), sin(angle));
+        float phase = frequency * (dot(direction, p) - waveSpeed * waveTime);
+        wave.x += amplitude * sin(phase);
+        wave.yz += amplitude * frequency * cos(phase) * direction;
+        amplitude *= wavePersistence;
+        frequency *= waveLacunarity;
+    }
+    return wave;
+}
+
+// Octahedral encoding of PackedVertex (MeshData.h), xy in [-1, 1]
+vec3 octahedralDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.f - abs(e.x) - abs(e.y));
+    if (n.z < 0.f) {
+        n.xy = (1.f - abs(n.yx)) * vec2(n.x >= 0.f ? 1.f : -1.f, n.y >= 0.f ? 1.f : -1.f);
+    }
+    return normalize(n);
+}
+
+// Loaded models: packed normal and material index into the material table
+// of shader.frag, from materialBase on. Terrain: float normal and colours per vertex.
+uniform bool packedVertices;
+uniform int materialBase;
+
+// Morph animations (MorphAnimation.h): the offsets from the base position, in
+// units of morphScale, and the packed normals of two frames, blended by morphWeight
+uniform bool morphOn;
+uniform float morphWeight;
+uniform float morphScale;
+
 layout(location = 0) in vec3 position;
-layout(location = 1) in vec3 normal;
+layout(location = 1) in vec4 normal;        // packed: octahedral x, y (+-511) and material index
 layout(location = 2) in vec3 diffuseColor;
 layout(location = 3) in vec3 ambientColor;
 layout(location = 4) in vec3 specularColor;
 layout(location = 5) in float shininessValue;
 layout(location = 6) in vec2 texCoord;
+layout(location = 7) in vec3 morphDeltaA;
+layout(location = 8) in vec4 morphNormalA;
+layout(location = 9) in vec3 morphDeltaB;
+layout(location = 10) in vec4 morphNormalB;
 
 out vec3 passPosition;
 out vec3 passNormal;
 out vec2 passTexCoord;
 out vec4 passShadowCoord;
+flat out int passMaterial;
 //out vec3 passColor;
 
 out struct Material {
@@ -29,12 +85,32 @@ out struct Material {
 
 void main()
 {
-    gl_Position = projMatrix * viewMatrix * modelMatrix * vec4(position, 1.f);
+    vec3 objectPosition = position;
+    vec3 objectNormal = packedVertices ? octahedralDecode(normal.xy / 511.f) : normal.xyz;
+    float objectMaterial = normal.z;
+    if (morphOn) {
+        objectPosition += mix(morphDeltaA, morphDeltaB, morphWeight) * morphScale;
+        vec3 normalA = octahedralDecode(morphNormalA.xy / 511.f);
+        vec3 blended = mix(normalA, octahedralDecode(morphNormalB.xy / 511.f), morphWeight);
+        objectNormal = dot(blended, blended) > 0.f ? normalize(blended) : normalA;
+        objectMaterial = morphWeight < 0.5f ? morphNormalA.z : morphNormalB.z;
+    }
+    vec4 worldPosition = modelMatrix * vec4(objectPosition, 1.f);
+    vec3 worldNormal = (modelMatrix * vec4(objectNormal, 0)).xyz;
+    if (wavesOn) {
+        // Adds the slope of the waves to the one of the (heightfield) surface
+        vec3 wave = oceanWaves(worldPosition.xz);
+        worldPosition.y += wave.x;
+        worldNormal = normalize(worldNormal / worldNormal.y - vec3(wave.y, 0.f, wave.z));
+    }
+    gl_Position = projMatrix * viewMatrix * worldPosition;
     
-    passPosition = (modelMatrix * vec4(position, 1.f)).xyz;
-    passNormal = (modelMatrix * vec4(normal, 0)).xyz;
+    passPosition = worldPosition.xyz;
+    passNormal = worldNormal;
     passTexCoord = texCoord;
     
+    passMaterial = packedVertices && !tintOn ? materialBase + int(objectMaterial) : -1;
+
     if(!tintOn) { 
         material.diffuseColor = diffuseColor;
         material.ambientColor = ambientColor;
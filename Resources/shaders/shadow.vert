@@ -4,6 +4,36 @@ uniform mat4 projMatrix;
 uniform mat4 viewMatrix;
 uniform mat4 modelMatrix;
 
+// Animated ocean, see WaveSettings in Terrain.h
+uniform bool wavesOn;
+uniform float waveTime;
+uniform float waveAmplitude;
+uniform float waveFrequency;
+uniform float waveSpeed;
+uniform float waveDirection;
+uniform int waveOctaves;
+uniform float waveLacunarity;
+uniform float wavePersistence;
+
+// Height of the waves at world position p (x) and its derivatives along x and z (y, z)
+vec3 oceanWaves(vec2 p)
+{
+    vec3 wave = vec3(0.f);
+    float amplitude = waveAmplitude;
+    float frequency = waveFrequency;
+    for (int o = 0; o < waveOctaves; o++) {
+        // Golden angle steps, so no two octaves run in the same direction
+        float angle = waveDirection + float(o) * 2.39996f;
+        vec2 direction = vec2(cos(angle), sin(angle));
+        float phase = frequency * (dot(direction, p) - waveSpeed * waveTime);
+        wave.x += amplitude * sin(phase);
+        wave.yz += amplitude * frequency * cos(phase) * direction;
+        amplitude *= wavePersistence;
+        frequency *= waveLacunarity;
+    }
+    return wave;
+}
+
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
 layout(location = 6) in vec2 texCoord;
@@ -28,7 +58,9 @@ void main()
 //    [0, 0.707107, 0.707107, -28.2843]
 //    [0, 0, 0, 1]
     
-    gl_Position = projMatrix * viewMatrix * modelMatrix * vec4(position, 1.f);
+    vec4 worldPosition = modelMatrix * vec4(position, 1.f);
+    if (wavesOn) worldPosition.y += oceanWaves(worldPosition.xz).x;
+    gl_Position = projMatrix * viewMatrix * worldPosition;
     //gl_Position = projMatrix * modelMatrix * vec4(position, 1.f);
     
     passNormal = (modelMatrix * vec4(normal, 0)).xyz;
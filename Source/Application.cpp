@@ -1,5 +1,16 @@
+#include "AssetLoader.h"
 #include "Model.h"
+#include "ModelCache.h"
 #include "Image.h"
+#include "Terrain.h"
+#include "TerrainCache.h"
+#include "ChunkedTerrain.h"
+#include "TerrainStreamer.h"
+#include "TextureRegistry.h"
+#include "TextureStreamer.h"
+#include "NoiseBatch.h"
+#include "NoiseGraph.h"
+#include "ResourceArchive.h"
 
 #include <GDT/Window.h>
 #include <GDT/Input.h>
@@ -13,6 +24,7 @@
 #include <glm/glm/gtc/type_ptr.hpp>
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
 #include <vector>
 #include <iostream>
 #define _USE_MATH_DEFINES
@@ -20,7 +32,9 @@
 #include <map>
 #include <string>
 #include <ctime>
+#include <chrono>
 #include <cmath>
+#include <limits>
 
 #include <noise/noise.h> // used for the Perlin noise generation
 
@@ -29,8 +43,6 @@
 #endif
 #define degToRad(angleInDegrees) ((angleInDegrees) * M_PI / 180.0)
 
-std::map<std::string, int> textureHandles;
-
 
 // Produces a projection matrix for perspective projection
 // http://www.songho.ca/opengl/gl_projectionmatrix.html
@@ -70,6 +82,15 @@ Matrix4f lookAtMatrix(Vector3f camera, Vector3f target, Vector3f up)
 }
 
 
+// Where the material indices of a loaded model start in the material table
+void setMaterialUniforms(ShaderProgram& shader, const Model& model)
+{
+    shader.uniform1i("packedVertices", model.packedVertices);
+    shader.uniform1i("materialBase", model.materialBase);
+    shader.uniform1i("morphOn", model.morphFrames > 0);
+    shader.uniform1f("morphScale", model.morphScale);
+}
+
 void drawModel(ShaderProgram& shader, const Model& model, Vector3f position, Vector3f rotation = Vector3f(0), float scale = 1, bool spacecraft = false)
 {
     Matrix4f modelMatrix;
@@ -87,30 +108,32 @@ void drawModel(ShaderProgram& shader, const Model& model, Vector3f position, Vec
 
 	
     shader.uniformMatrix4f("modelMatrix", modelMatrix);
-    shader.uniform1i("hasTexCoords", model.texCoords.size() > 0);
+    shader.uniform1i("hasTexCoords", model.hasTexCoords);
+    setMaterialUniforms(shader, model);
     
-	if (model.texCoords.size() > 0) {
-		int nMaterial = model.materials.size();
-
-		// Bind texture of the model
-        glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, textureHandles[model.materials[0].diffuse_texname]);
-        shader.uniform1i("colorMap", 0);
+	if (model.hasTexCoords) {
+		// Bind texture of the model, colorMap samples unit 0
+		bindTexture(model.texture);
 	}
 
-    glBindVertexArray(model.vao);
-    glDrawArrays(GL_TRIANGLES, 0, model.vertices.size());
+    drawGeometry(model);
     
 }
 
 
+// Where drawPlanet draws a planet orbiting 'rotationPoint'
+Vector3f orbitPosition(Vector3f position, Vector3f rotation, Vector3f rotationPoint, float distance)
+{
+	float newX = distance * cos(degToRad(rotation.y)) + rotationPoint.x;
+	float newZ = distance * sin(degToRad(rotation.y)) + rotationPoint.z;
+	return Vector3f(newX, position.y, newZ);
+}
+
 void drawPlanet(ShaderProgram& shader, const Model& model, Vector3f position, Vector3f rotation = Vector3f(0), float scale = 1, Vector3f rotationPoint = Vector3f(0), float distance=1.f)
 {
 	Matrix4f modelMatrix;
 	
-	float newX = distance * cos(degToRad(rotation.y)) + rotationPoint.x;
-	float newZ = distance * sin(degToRad(rotation.y)) + rotationPoint.z;
-	position = Vector3f(newX, position.y, newZ);
+	position = orbitPosition(position, rotation, rotationPoint, distance);
 	
 	modelMatrix.translate(position);
 	modelMatrix.rotate(rotation.y, 0, 1.f, 0);
@@ -118,20 +141,16 @@ void drawPlanet(ShaderProgram& shader, const Model& model, Vector3f position, Ve
 	modelMatrix.scale(scale);
 
 	shader.uniformMatrix4f("modelMatrix", modelMatrix);
-	shader.uniform1i("hasTexCoords", model.texCoords.size() > 0);
-
-	if (model.texCoords.size() > 0) {
-		int nMaterial = model.materials.size();
+	shader.uniform1i("hasTexCoords", model.hasTexCoords);
+	setMaterialUniforms(shader, model);
 
-		// Bind texture of the model
-        glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, textureHandles[model.materials[0].diffuse_texname]);
-        shader.uniform1i("colorMap", 0);
+	if (model.hasTexCoords) {
+		// Bind texture of the model, colorMap samples unit 0
+		bindTexture(model.texture);
 	}
 
 
-	glBindVertexArray(model.vao);
-	glDrawArrays(GL_TRIANGLES, 0, model.vertices.size());
+	drawGeometry(model);
 
 }
 
@@ -143,10 +162,30 @@ public:
 	Vector3f cameraTarget = Vector3f(0, 0, 1.0f); // 0, 0, -1.0f
 	Vector3f cameraUp = Vector3f(0.f, 1.f, 0.f);
 
+    // Off: everything is loaded before the first frame, like before the
+    // asset loader, to compare the startup times
+    bool asyncLoading = true;
+
+    // Off: the loose files are read even when the build baked Resources.pak
+    bool useArchive = true;
+
+    // Off: the compressed textures are uploaded whole, like the others
+    bool streamTextures = true;
+
+    // Off: the map is the fixed size cached heightfield (TerrainCache.h),
+    // drawn as a quadtree of LOD patches, or as one mesh without terrainLod
+    bool streamTerrain = true;
+    bool terrainLod = true;
+
     void init()
     {
+        startTime = std::chrono::steady_clock::now();
+        if (useArchive && !mountArchive("Resources.pak")) {
+            std::cout << "Resources.pak not mounted, reading the loose files" << std::endl;
+        }
         window.setGlVersion(3, 3, true);
 		window.create("Grand Theft Spacecraft", 1024, 1024);
+        detectTextureCompression();
         
         // Viewport for camera calculations
         glViewport(0, 0, WIDTH, HEIGHT);
@@ -159,46 +198,58 @@ public:
         // INIT GAME STATE
         srand(time(0));
         
-        // -- general game state
-        
-        initGameState();
-        
         // -- loading models
         
         map.center = Vector3f(0.f);
-        map.model = makeTerrain(map.perlinGenerator, map.perlinSize, map.resolution, map.heightMult, map.scale, false);
+        map.noise.init(map.perlinGenerator, false);
+        map.streaming = streamTerrain;
+        map.chunked = terrainLod;
+        if (map.streaming) {
+            map.streamer.init(map.perlinGenerator, map.perlinSize, map.heightMult, map.scale);
+        } else {
+            // The heightfield is kept for the ground height queries
+            if (map.chunked) {
+                map.heightfield = loadOrBuildHeightfield(map.perlinGenerator, map.perlinSize, map.resolution, false);
+                map.terrain.build(map.heightfield, map.heightMult, map.scale, false);
+            } else {
+                map.model = loadOrMakeTerrain(map.perlinGenerator, map.perlinSize, map.resolution, map.heightMult, map.scale, false, map.indexed, &map.heightfield);
+            }
+        }
         
         ocean.center = Vector3f(0.f);
         //ocean.resolution = 100;
+        ocean.chunked = false;
+        ocean.streaming = false;
         ocean.perlinSize = 3;
         ocean.heightMult = 1.f;
-        ocean.model = makeTerrain(ocean.perlinGenerator, ocean.perlinSize, ocean.resolution, ocean.heightMult, ocean.scale, true);
+        ocean.model = loadOrMakeTerrain(ocean.perlinGenerator, ocean.perlinSize, ocean.resolution, ocean.heightMult, ocean.scale, true, ocean.indexed);
+        
+        // -- general game state, after the map as obstacles are put on the ground
+        
+        initGameState();
+        printModelCacheStats();
         
 		
-        spacecraft = loadModelWithMaterials("Resources/spacecraft.obj", "Resources/");
+        // Models and textures load in the background and show up as they
+        // are uploaded, see AssetLoader.h
+        assets.loadModel("Resources/spacecraft.obj", "Resources/", true, &spacecraft);
         
-        explosion.numFrames = 9;
-        for (int i = explosion.firstFrame; i < explosion.numFrames + 1; ++i) {
-            explosion.frames.push_back(loadModelWithMaterials("Resources/spacecraftExplosion/spacecraftExplosion_00000"+ std::to_string(i)+".obj", "Resources/spacecraftExplosion/"));
+        // All frames in one model, as morph targets of the first one
+        std::vector<std::string> explosionFrames;
+        for (int i = 1; i <= explosion.numFrames; ++i) {
+            std::string number = std::to_string(i);
+            explosionFrames.push_back("Resources/spacecraftExplosion/spacecraftExplosion_" + std::string(6 - number.size(), '0') + number + ".obj");
         }
+        assets.loadMorphModel("Resources/spacecraftExplosion/spacecraftExplosion", explosionFrames, "Resources/spacecraftExplosion/", &explosion.model);
         
-        skybox = loadModel("Resources/skysphereblue.obj");
-        skybox_texture = loadImage("Resources/" + skybox.materials[0].diffuse_texname);
-		skyboxBH = loadModel("Resources/skysphereblueBH.obj");
-		skybox_BH_texture = loadImage("Resources/" + skyboxBH.materials[0].diffuse_texname);
-
-		starSkybox = loadModel("Resources/skybox.obj");
-		starsky_texture = loadImage("Resources/" + starSkybox.materials[0].diffuse_texname);
-
-        earth = loadModelWithMaterials("Resources/gijsEarth.obj", "Resources/");
-        earth_texture = loadImage("Resources/"+earth.materials[0].diffuse_texname);
-		mars = loadModelWithMaterials("Resources/mars.obj", "Resources/");
-		mars_texture = loadImage("Resources/" + mars.materials[0].diffuse_texname);
-		pinkplanet = loadModelWithMaterials("Resources/pink.obj", "Resources/");
-		pink_texture = loadImage("Resources/" + pinkplanet.materials[0].diffuse_texname);
+        loadModelAndTexture("Resources/skysphereblue.obj", false, &skybox, &skybox_texture);
+		loadModelAndTexture("Resources/skysphereblueBH.obj", false, &skyboxBH, &skybox_BH_texture);
+		loadModelAndTexture("Resources/skybox.obj", false, &starSkybox, &starsky_texture);
 
-		sun = loadModelWithMaterials("Resources/sun.obj", "Resources/");
-		sun_texture = loadImage("Resources/" + sun.materials[0].diffuse_texname);
+        loadModelAndTexture("Resources/gijsEarth.obj", true, &earth, &earth_texture);
+		loadModelAndTexture("Resources/mars.obj", true, &mars, &mars_texture);
+		loadModelAndTexture("Resources/pink.obj", true, &pinkplanet, &pink_texture);
+		loadModelAndTexture("Resources/sun.obj", true, &sun, &sun_texture);
 
 		pEarth.position = Vector3f(0.f, 30.f, 0.f);
 		pEarth.rotationAngle = 0.f;
@@ -207,18 +258,7 @@ public:
 		pTest.position = Vector3f(10.f, 30.f, 12.f);
 		pTest.rotationAngle = 0.f;
 
-        hangar = loadModelWithMaterials("Resources/Hangar2.obj", "Resources/");
-        hangar_roof = loadImage("Resources/" + hangar.materials[0].diffuse_texname);
-
-		textureHandles.insert(std::pair<std::string, int>(earth.materials[0].diffuse_texname, earth_texture.handle));
-		textureHandles.insert(std::pair<std::string, int>(hangar.materials[0].diffuse_texname, hangar_roof.handle));
-		textureHandles.insert(std::pair<std::string, int>(mars.materials[0].diffuse_texname, mars_texture.handle));
-		textureHandles.insert(std::pair<std::string, int>(pinkplanet.materials[0].diffuse_texname, pink_texture.handle));
-		textureHandles.insert(std::pair<std::string, int>(sun.materials[0].diffuse_texname, sun_texture.handle));
-		textureHandles.insert(std::pair<std::string, int>(skybox.materials[0].diffuse_texname, skybox_texture.handle));
-		textureHandles.insert(std::pair<std::string, int>(skyboxBH.materials[0].diffuse_texname, skybox_BH_texture.handle));
-
-		textureHandles.insert(std::pair<std::string, int>(starSkybox.materials[0].diffuse_texname, starsky_texture.handle));
+        loadModelAndTexture("Resources/Hangar2.obj", true, &hangar, &hangar_roof);
 
         // testing models
         testingQuad = makeQuad();
@@ -255,7 +295,13 @@ public:
             std::cerr << e.what() << std::endl;
         }
 
+        // The color maps are always on unit 0 (bindTexture)
+        skySphereShader.bind();
+        skySphereShader.uniform1i("colorMap", 0);
+
         defaultShader.bind();
+        defaultShader.uniform1i("colorMap", 0);
+        connectMaterialTable();
 
         // Upload the projection matrix once, if it doesn't change
         // during the game we don't need to reupload it
@@ -294,6 +340,9 @@ public:
         glClear(GL_DEPTH_BUFFER_BIT);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
         
+        if (!asyncLoading) {
+            assets.finish();
+        }
     }
     
     void initGameState(){
@@ -312,7 +361,6 @@ public:
         
         game.obstaclesSurpased = false;
         
-        explosion.currentFrame = 1;
         explosion.on = false;
         
         game.hangarPosition = Vector3f(0.f, 1.f, 0.f);
@@ -331,12 +379,13 @@ public:
                 
                 float randomPositionX = rand()%(int)round(map.scale/2) - (int)round(map.scale/4);
                 float randomPositionZ = rand()%(int)round(map.scale/2) - (int)round(map.scale/4);
-                float height = getHeightMapPoint(Vector3f(randomPositionX, 0.f, randomPositionZ), map.perlinGenerator, map.perlinSize, map.scale, map.heightMult);
+                float height = groundHeight(Vector3f(randomPositionX, 0.f, randomPositionZ));
                 
                 if(height <= 0) height = 10;
                 
                 newObstacle.position = Vector3f(randomPositionX, height + 10, randomPositionZ);
-                newObstacle.model = loadModelWithMaterials("Resources/obstacleArcSimplified.obj", "Resources/");
+                // One load for all obstacles, they only differ in their transform
+                newObstacle.model = acquireModelWithMaterials("Resources/obstacleArcSimplified.obj", "Resources/");
                 newObstacle.scaling = 1.f;
                 newObstacle.rotation = Vector3f(0.f, 90.f, 0.f);
                 obstacles.push_back(newObstacle);
@@ -394,9 +443,10 @@ public:
         // add iff
         if(obstacles.size() == game.arcsCrossed) game.obstaclesSurpased = true;
         
-        float currentGroundHeight = getHeightMapPoint(game.characterPosition, map.perlinGenerator, map.perlinSize, map.scale, map.heightMult);
+        float currentGroundHeight = groundHeight(game.characterPosition);
         
-        if((game.characterPosition.length() > map.scale/2 && !game.obstaclesSurpased) || (game.characterPosition.y <= currentGroundHeight)){
+        bool outOfMap = !map.streaming && game.characterPosition.length() > map.scale/2;
+        if((outOfMap && !game.obstaclesSurpased) || (game.characterPosition.y <= currentGroundHeight)){
             
             if(!explosion.on){
                 explosion.on = true;
@@ -422,7 +472,7 @@ public:
             cameraPos = game.characterPosition + -cameraTarget * 1.f;
         }
         game.characterViewMatrix = lookAtMatrix(cameraPos, game.characterPosition, cameraUp); // depends on processKeyboardInput();
-        game.projMatrix = projectionProjectiveMatrix(45, m_viewport[2] / m_viewport[3], 0.1, map.scale);
+        game.projMatrix = projectionProjectiveMatrix(fieldOfView, m_viewport[2] / m_viewport[3], 0.1, map.scale);
         
         
         if (game.turboModeOn){
@@ -431,6 +481,13 @@ public:
             movementSpeed = 0.05f;
         }
         
+        // Terrain patches for this frame, depending on the spacecraft position
+        if (map.streaming) {
+            map.streamer.update(game.characterPosition, map.visibleChunks);
+        } else if (map.chunked) {
+            map.terrain.select(game.characterPosition, map.visiblePatches);
+        }
+        
         pEarth.rotationAngle += 0.1f;
         pMars.rotationAngle += 0.05f;
         pTest.rotationAngle += 0.01f;
@@ -449,6 +506,8 @@ public:
             processKeyboardInput();
             
             updateGameState();
+
+            resetTextureBindings();
             
             // SHADOWS
             drawScene(true);
@@ -469,11 +528,14 @@ public:
             skySphereShader.uniformMatrix4f("viewMatrix", game.characterViewMatrix);
 
 			if (!game.obstaclesSurpased) { //TODO If not all arcs are crossed
-				drawModel(skySphereShader, skybox, Vector3f(0.f), Vector3f(0.f), map.scale / 2, false);
+				drawModel(skySphereShader, skybox, worldCenter(), Vector3f(0.f), map.scale / 2, false);
+				requestTextureDetail(skybox, skybox_texture, worldCenter(), map.scale / 2);
 			}
 			else {
-				drawModel(skySphereShader, skyboxBH, Vector3f(0.f), Vector3f(0.f), map.scale / 2, false);
+				drawModel(skySphereShader, skyboxBH, worldCenter(), Vector3f(0.f), map.scale / 2, false);
 				drawModel(skySphereShader, starSkybox, Vector3f(-95.f, 60.f, 140.f), Vector3f(0.f), 75.f, false);
+				requestTextureDetail(skyboxBH, skybox_BH_texture, worldCenter(), map.scale / 2);
+				requestTextureDetail(starSkybox, starsky_texture, Vector3f(-95.f, 60.f, 140.f), 75.f);
 			}
 
             
@@ -498,9 +560,65 @@ public:
             
             // Processes input and swaps the window buffer
             window.update();
+
+            if (!firstFrameShown) {
+                firstFrameShown = true;
+                std::cout << "Startup to first frame: " << millisecondsSinceStart() << " ms" << std::endl;
+            }
+            if (!fullyLoaded && assets.update(assetUploadBudgetMs)) {
+                fullyLoaded = true;
+                std::cout << "Startup to fully loaded: " << millisecondsSinceStart() << " ms" << std::endl;
+            }
+            textureStreamer.update();
         }
     }
     
+    // Frame time of drawing the ocean alone, re-uploading its vertices every
+    // frame like the ocean used to against displacing them in the vertex
+    // shader. Meant to run on a software GL driver (LIBGL_ALWAYS_SOFTWARE=1 on
+    // Mesa), where the buffer uploads cost CPU time like everything else.
+    void benchmarkOcean(int frames) {
+        glfwSwapInterval(0);
+        glfwGetFramebufferSize(window.windowPointer(), &framebufferWidth, &framebufferHeight);
+        glViewport(0, 0, framebufferWidth, framebufferHeight);
+
+        defaultShader.bind();
+        defaultShader.uniformMatrix4f("projMatrix", projectionProjectiveMatrix(45, 1.f, 0.1f, ocean.scale));
+        defaultShader.uniformMatrix4f("viewMatrix", lookAtMatrix(Vector3f(0.f, 30.f, -60.f), Vector3f(0.f), cameraUp));
+        defaultShader.uniform1i("tintOn", false);
+
+        const char* names[2] = { "CPU re-upload", "vertex shader" };
+        for (int pass = 0; pass < 2; pass++) {
+            bool shaderWaves = pass == 1;
+            double cpuMs = 0;
+
+            glFinish();
+            auto start = std::chrono::steady_clock::now();
+            for (int frame = 0; frame < frames; frame++) {
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+                auto cpuStart = std::chrono::steady_clock::now();
+                if (shaderWaves) {
+                    drawOcean(defaultShader);
+                } else {
+                    updateMapValues(ocean.model);
+                    drawModel(defaultShader, ocean.model, Vector3f(0.f), Vector3f(0.f), 1.f);
+                }
+                cpuMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cpuStart).count();
+
+                glFinish();
+                window.update();
+            }
+            double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            size_t uploadBytes = shaderWaves ? 0 : ocean.model.vertices.size() * sizeof(Vector3f);
+            std::cout << "Ocean (" << names[pass] << "): " << totalMs / frames << " ms/frame, "
+                      << cpuMs / frames << " ms/frame on the CPU, "
+                      << uploadBytes / 1024 << " KB uploaded per frame" << std::endl;
+        }
+        std::cout << "GL renderer: " << glGetString(GL_RENDERER) << std::endl;
+    }
+
     // Method for drawing all the elements of the game
     void drawScene(bool forComputingShadows) {
         
@@ -551,16 +669,16 @@ public:
         if(!forComputingShadows){
             // 1. Draw map
             defaultShader.uniform1i("tintOn", false); // REMOVE at the end
-            drawModel(defaultShader, map.model, Vector3f(0.f), Vector3f(0.f), 1.f);
+            drawTerrain(defaultShader, map);
             
-            updateMapValues(ocean.model);
             defaultShader.uniform1i("tintOn", false); // REMOVE at the end
-            drawModel(defaultShader, ocean.model, Vector3f(0.f), Vector3f(0.f), 1.f);
+            drawOcean(defaultShader);
             
             
             // 2. Draw hangar
             defaultShader.uniform1i("tintOn", false);
             drawModel(defaultShader, hangar, game.hangarPosition, Vector3f(0, 0, 0), game.hangarScalingFactor);
+            requestTextureDetail(hangar, hangar_roof, game.hangarPosition, game.hangarScalingFactor);
             
             // 3. Draw spacecraft
             if(!explosion.on){
@@ -570,36 +688,46 @@ public:
             
             // 4. Draw arcs
             for (std::vector<Obstacle>::iterator it = obstacles.begin() ; it != obstacles.end(); ++it){
-                Obstacle obs = *it;
+                const Obstacle& obs = *it;
                 if(obs.crossed) defaultShader.uniform1i("tintOn", true); // REMOVE at the end
                 else defaultShader.uniform1i("tintOn", false); // REMOVE at the end
-                drawModel(defaultShader, obs.model, obs.position, obs.rotation, obs.scaling);
+                drawModel(defaultShader, *obs.model, obs.position, obs.rotation, obs.scaling);
             }
             
             // 5. Draw moving planets
             defaultShader.uniform1i("tintOn", false); // REMOVE at the end
             drawModel(defaultShader, earth, pEarth.position+ Vector3f(-95.f, 60.f, 140.f), Vector3f(0, pEarth.rotationAngle, 0), 4.f);
             drawPlanet(defaultShader, mars, pMars.position+ Vector3f(-95.f, 60.f, 140.f), Vector3f(0, pEarth.rotationAngle * 5, 0), 5.f, pEarth.position + Vector3f(-95.f, 60.f, 140.f), 25.f);
+            requestTextureDetail(earth, earth_texture, pEarth.position + Vector3f(-95.f, 60.f, 140.f), 4.f);
+            requestTextureDetail(mars, mars_texture, orbitPosition(pMars.position + Vector3f(-95.f, 60.f, 140.f), Vector3f(0, pEarth.rotationAngle * 5, 0),
+                                                                   pEarth.position + Vector3f(-95.f, 60.f, 140.f), 25.f), 5.f);
             
 			float newX = 25.f * cos(degToRad(pEarth.rotationAngle)) + pEarth.position.x;
 			float newZ = 25.f * sin(degToRad(pEarth.rotationAngle)) + pEarth.position.z;
 			pMars.position = Vector3f(newX, 60.f, newZ);
             drawPlanet(defaultShader, pinkplanet, pTest.position + Vector3f(-95.f, 60.f, 140.f), Vector3f(0, pTest.rotationAngle * 10 , 0), 1.5f, pMars.position + Vector3f(-95.f, 60.f, 140.f), 12.f);
+            requestTextureDetail(pinkplanet, pink_texture, orbitPosition(pTest.position + Vector3f(-95.f, 60.f, 140.f), Vector3f(0, pTest.rotationAngle * 10, 0),
+                                                                         pMars.position + Vector3f(-95.f, 60.f, 140.f), 12.f), 1.5f);
             
             
             // 6. Draw OTHER stuff
                 //drawModel(defaultShader, testingQuad, Vector3f(0, 5, 0));
             if(explosion.on){
                 defaultShader.uniform1i("tintOn", false); // REMOVE at the end
-                drawModel(defaultShader, explosion.frames[explosion.currentFrame - 1], game.characterPosition, Vector3f(-pitch, -yaw + 90.f,game.characterRoll), game.characterScalingFactor, true);
-                if(explosion.currentFrame < explosion.numFrames)
-                    explosion.currentFrame++;
+                // Blends the two frames around the time since the explosion, the last one stays
+                double frame = double(clock() - explosion.startTime) / CLOCKS_PER_SEC / explosion.timePerFrame;
+                int lastFrame = std::max(explosion.model.morphFrames - 1, 0);
+                int frameA = std::min((int) frame, lastFrame);
+                setMorphFrames(explosion.model, frameA, std::min(frameA + 1, lastFrame));
+                defaultShader.uniform1f("morphWeight", frameA < lastFrame ? (float) (frame - frameA) : 0.f);
+                drawModel(defaultShader, explosion.model, game.characterPosition, Vector3f(-pitch, -yaw + 90.f,game.characterRoll), game.characterScalingFactor, true);
             }
             
 			// Draw Sun as light in solar system
             defaultShader.uniform1i("isSun", true);
             drawModel(defaultShader, sun , light.position, Vector3f(0.f), light.scale);
             defaultShader.uniform1i("isSun", false);
+            requestTextureDetail(sun, sun_texture, light.position, light.scale);
 			
             
         }
@@ -607,8 +735,8 @@ public:
         if(forComputingShadows){
             
             // 1. Draw map
-            drawModel(shadowShader, map.model, Vector3f(0.f), Vector3f(0.f), 1.f);
-            drawModel(shadowShader, ocean.model, Vector3f(0.f), Vector3f(0.f), 1.f);
+            drawTerrain(shadowShader, map);
+            drawOcean(shadowShader);
             
             // 2. Draw hangar
             drawModel(shadowShader, hangar, game.hangarPosition, Vector3f(0, 0, 0), game.hangarScalingFactor);            
@@ -619,8 +747,8 @@ public:
             
             // 4. Draw arcs
             for (std::vector<Obstacle>::iterator it = obstacles.begin() ; it != obstacles.end(); ++it){
-                Obstacle obs = *it;
-                drawModel(shadowShader, obs.model, obs.position, obs.rotation, obs.scaling);
+                const Obstacle& obs = *it;
+                drawModel(shadowShader, *obs.model, obs.position, obs.rotation, obs.scaling);
             }
             
             // 5. Draw OTHER stuff
@@ -682,6 +810,15 @@ public:
 	void onKeyPressed(int key, int mods)
 	{
 		mKeyPressed[key] = true;
+		if (key == GLFW_KEY_P && map.streaming) {
+			map.streamer.printStats();
+		}
+		if (key == GLFW_KEY_M) {
+			printTextureMemory();
+			textureStreamer.printResidency();
+			TextureBindingStats binds = getTextureBindingStats();
+			std::cout << "Texture binds: " << binds.binds << " made, " << binds.skipped << " skipped" << std::endl;
+		}
 	}
 
     // In here you can handle key releases
@@ -749,6 +886,15 @@ private:
     Window window;
     const int WIDTH = 1024;
     const int HEIGHT = 1024;
+
+    // Background loading of the models and textures
+    AssetLoader assets;
+    double assetUploadBudgetMs = 4.0;
+    TextureStreamer textureStreamer;
+    float fieldOfView = 45.f;  // vertical, in degrees
+    std::chrono::steady_clock::time_point startTime;
+    bool firstFrameShown = false;
+    bool fullyLoaded = false;
     
     // Game state
     
@@ -787,11 +933,115 @@ private:
         Model model;
         float heightMult = 5.f;
         float scale = 200.f;
+        bool indexed = true; // one shared vertex per grid point, smooth normals
         noise::module::Perlin perlinGenerator;
+        TerrainNoise noise; // of perlinGenerator, for the exact ground height
+        Heightfield heightfield;
+        bool exactGroundHeight = false; // evaluate the noise instead of the drawn triangles
+        
+        // Quadtree of patches with distance based level of detail
+        bool chunked = true;
+        ChunkedTerrain terrain;
+        std::vector<int> visiblePatches;
+        
+        // Endless terrain streamed in chunks around the spacecraft
+        bool streaming = true;
+        TerrainStreamer streamer;
+        std::vector<const Model*> visibleChunks;
     };
     
     Map map;
     Map ocean;
+    WaveSettings waves;
+    
+    // The ocean and the sky follow the spacecraft over a streamed map, snapped
+    // to the ocean grid so its waves do not slide along
+    Vector3f worldCenter() {
+        if (!map.streaming) return Vector3f(0.f);
+        float cellSize = ocean.scale / ocean.resolution;
+        return Vector3f(std::floor(game.characterPosition.x / cellSize) * cellSize, 0.f, std::floor(game.characterPosition.z / cellSize) * cellSize);
+    }
+    
+    // Height of the map surface below 'position', on the triangles that are
+    // drawn there (full resolution for a chunked map). Falls back to the
+    // noise where no triangles are loaded.
+    float groundHeight(Vector3f position) {
+        Vector3f normal;
+        return groundHeight(position, normal);
+    }
+    
+    float groundHeight(Vector3f position, Vector3f& normal) {
+        float height;
+        if (!map.exactGroundHeight) {
+            if (map.streaming && map.streamer.getGroundHeight(position.x, position.z, height, normal)) return height;
+            if (!map.streaming && sampleHeightfield(map.heightfield, map.heightMult, map.scale, position.x, position.z, height, normal)) return height;
+        }
+        return getHeightMapPoint(position, map.noise, map.perlinSize, map.scale, map.heightMult, normal);
+    }
+    
+    // Draws either the selected patches of a chunked terrain or its single model
+    void drawTerrain(ShaderProgram& shader, Map& terrain) {
+        if (terrain.streaming) {
+            for (const Model* chunk : terrain.visibleChunks) {
+                drawModel(shader, *chunk, Vector3f(0.f), Vector3f(0.f), 1.f);
+            }
+        } else if (terrain.chunked) {
+            for (int patch : terrain.visiblePatches) {
+                drawModel(shader, terrain.terrain.patchModel(patch), Vector3f(0.f), Vector3f(0.f), 1.f);
+            }
+        } else {
+            drawModel(shader, terrain.model, Vector3f(0.f), Vector3f(0.f), 1.f);
+        }
+    }
+
+    // Loads a model and then the texture of its first material, drawn with
+    // the placeholder texture until that is uploaded
+    void loadModelAndTexture(const std::string& path, bool withMaterials, Model* model, Image* texture) {
+        assets.loadModel(path, "Resources/", withMaterials, model, [this, model, texture]() {
+            int id = model->texture;
+            if (id < 0) return;
+            setTextureHandle(id, assets.placeholderTexture());
+            assets.loadImage("Resources/" + textureName(id), texture, streamTextures ? &textureStreamer : nullptr, [id, texture]() {
+                setTextureHandle(id, texture->handle);
+            });
+        });
+    }
+
+    // Asks the texture streamer for the levels a model drawn at 'position'
+    // needs. A sphere of that radius covers radius / (distance * tan(fov / 2))
+    // of half the viewport height; its texture wraps around it, so the
+    // visible half of the texture width spans that diameter. The sky spheres
+    // around the camera need all levels.
+    void requestTextureDetail(const Model& model, const Image& texture, Vector3f position, float scale) {
+        if (texture.streamed < 0) return;
+        float radius = model.radius * scale;
+        float distance = (position - cameraPos).length();
+        float texels = std::numeric_limits<float>::max();
+        if (distance > radius) {
+            float diameterPixels = radius / (distance * tan(degToRad(fieldOfView) / 2)) * framebufferHeight;
+            texels = (float) M_PI * diameterPixels;
+        }
+        textureStreamer.request(texture.streamed, texels);
+    }
+
+    double millisecondsSinceStart() const {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    }
+
+    // The waves are displaced in the vertex shader, the ocean buffers stay as uploaded
+    void drawOcean(ShaderProgram& shader) {
+        shader.uniform1i("wavesOn", true);
+        shader.uniform1f("waveTime", (float) glfwGetTime());
+        shader.uniform1f("waveAmplitude", waves.amplitude);
+        shader.uniform1f("waveFrequency", waves.frequency);
+        shader.uniform1f("waveSpeed", waves.speed);
+        shader.uniform1f("waveDirection", waves.direction);
+        shader.uniform1i("waveOctaves", waves.octaves);
+        shader.uniform1f("waveLacunarity", waves.lacunarity);
+        shader.uniform1f("wavePersistence", waves.persistence);
+        drawModel(shader, ocean.model, worldCenter(), Vector3f(0.f), 1.f);
+        shader.uniform1i("wavesOn", false);
+    }
 
 	struct Planet {
 		Vector3f position;
@@ -802,7 +1052,7 @@ private:
         Vector3f position;
         float scaling;
         Vector3f rotation;
-        Model model;
+        ModelHandle model;
         bool crossed = false;
     };
     
@@ -810,12 +1060,10 @@ private:
     
     struct Animation{
         clock_t startTime = clock();
-        float timePerFrame = 0.5; //seconds
+        float timePerFrame = 0.15; //seconds, all frames within game.restartTimeSecs
         bool on = false;
-        int firstFrame = 1;
-        int currentFrame = 1;
         int numFrames = 10;
-        std::vector<Model> frames;
+        Model model; // morph animation of all frames, see MorphAnimation.h
     };
     
     Animation explosion;
@@ -899,10 +1147,35 @@ private:
     
 };
 
-int main()
+int main(int argc, char* argv[])
 {
+    // Command line benchmarks run without opening a window
+    if (argc > 1 && std::string(argv[1]) == "--benchmark-terrain") {
+        noise::module::Perlin perlinGenerator;
+        int resolution = argc > 2 ? std::stoi(argv[2]) : 2000;
+        benchmarkNoise(perlinGenerator);
+        benchmarkNoiseGraph(perlinGenerator);
+        benchmarkTerrainGeneration(perlinGenerator, 2.f, resolution);
+        reportTerrainFootprint(resolution);
+        benchmarkChunkedTerrain(perlinGenerator, 2.f, 5.f, 200.f);
+        return 0;
+    }
+
     Application app;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--sync-loading") app.asyncLoading = false;
+        if (std::string(argv[i]) == "--loose-files") app.useArchive = false;
+        if (std::string(argv[i]) == "--no-texture-streaming") app.streamTextures = false;
+        if (std::string(argv[i]) == "--no-terrain-streaming") app.streamTerrain = false;
+        if (std::string(argv[i]) == "--no-terrain-lod") app.terrainLod = false;
+    }
     app.init();
+
+    if (argc > 1 && std::string(argv[1]) == "--benchmark-ocean") {
+        app.benchmarkOcean(argc > 2 ? std::stoi(argv[2]) : 500);
+        return 0;
+    }
+
     app.update();
 
     return 0;
@@ -0,0 +1,57 @@
+// Offline baker of the packed resource archive (ResourceArchive.h), run by the
+// build after MeshConverter on the copied Resources folder. Takes the files the
+// game reads at start: the binary meshes and morph animations MeshConverter
+// wrote next to the OBJ files, the compressed textures TextureCompressor wrote
+// next to the images, and the images that have none. The shaders stay loose,
+// GDT only compiles them from a path.
+//
+//   AssetBaker <archive.pak> <directory>   files are named <directory name>/<path below it>,
+//                                          "Resources/mars.mesh" for Build/Resources
+
+#include "ResourceArchive.h"
+#include "TextureCompression.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3) {
+        std::cerr << "Usage: AssetBaker <archive.pak> <directory>" << std::endl;
+        return 1;
+    }
+    std::string archivePath = argv[1];
+    std::string directory = argv[2];
+    while (directory.size() > 1 && (directory.back() == '/' || directory.back() == '\\')) directory.pop_back();
+    size_t slash = directory.find_last_of("/\\");
+    std::string prefix = slash == std::string::npos ? directory : directory.substr(slash + 1);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> paths;
+    findFiles(directory, { ".mesh", ".morph", ".dds", ".jpg", ".jpeg", ".png" }, paths);
+
+    std::vector<std::pair<std::string, std::string>> files;
+    for (const std::string& path : paths) {
+        // The game only decodes the image without a usable DDS file, from the loose one
+        bool isImage = path.size() < 4 || path.compare(path.size() - 4, 4, ".dds") != 0;
+        if (isImage && std::binary_search(paths.begin(), paths.end(), compressedTexturePath(path))) continue;
+        files.push_back(std::make_pair(prefix + path.substr(directory.size()), path));
+    }
+    if (files.empty() || !writeArchive(archivePath, files)) {
+        std::cerr << "Could not bake " << archivePath << std::endl;
+        return 1;
+    }
+
+    // What the game opened one by one before: the OBJ and MTL files and the textures
+    std::vector<std::string> looseFiles;
+    findFiles(directory, { ".obj", ".mtl", ".jpg", ".jpeg", ".png" }, looseFiles);
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Baked " << files.size() << " files into " << archivePath << " in " << ms << " ms, one file to open instead of "
+              << looseFiles.size() << " loose OBJ, MTL and image files" << std::endl;
+    return 0;
+}
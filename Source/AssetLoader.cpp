@@ -0,0 +1,193 @@
+#include "AssetLoader.h"
+#include "TextureCompression.h"
+
+#include <GDT/OpenGL.h>
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+// One worker per core but the main thread's, at least two: the OBJ parser
+// spreads a file over the shared pool by itself, the images are decoded one
+// per worker, all of them at once
+AssetLoader::AssetLoader() : pool(std::max(3u, std::thread::hardware_concurrency()) - 1)
+{
+}
+
+AssetLoader::~AssetLoader()
+{
+    // The workers may still be reading into targets that are being destroyed,
+    // wait for them. Their uploads are dropped.
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this]() { return uploads.size() == outstanding; });
+}
+
+// 'work' runs on a worker and returns the part to run on the main thread
+void AssetLoader::submit(std::function<std::function<bool()>()> work)
+{
+    outstanding++;
+    pool.submit([this, work]() {
+        std::function<bool()> upload = work();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            uploads.push_back(upload ? upload : []() { return true; });
+        }
+        finished.notify_all();
+    });
+}
+
+void AssetLoader::loadModel(const std::string& path, const std::string& matBaseDir, bool withMaterials, Model* target,
+                            std::function<void()> onUploaded)
+{
+    submit([=]() -> std::function<bool()> {
+        std::shared_ptr<ModelFile> file = std::make_shared<ModelFile>();
+        if (!readModelFile(path, matBaseDir, withMaterials, *file)) {
+            std::cerr << "Could not load " << path << ", keeping the placeholder" << std::endl;
+            return nullptr;
+        }
+        return [file, target, onUploaded]() {
+            *target = uploadModelFile(*file);
+            if (onUploaded) onUploaded();
+            return true;
+        };
+    });
+}
+
+void AssetLoader::loadMorphModel(const std::string& animationPath, const std::vector<std::string>& framePaths,
+                                 const std::string& matBaseDir, Model* target, std::function<void()> onUploaded)
+{
+    submit([=]() -> std::function<bool()> {
+        std::shared_ptr<ModelFile> file = std::make_shared<ModelFile>();
+        if (!readMorphFile(animationPath, framePaths, matBaseDir, *file)) {
+            std::cerr << "Could not load " << animationPath << ", keeping the placeholder" << std::endl;
+            return nullptr;
+        }
+        return [file, target, onUploaded]() {
+            *target = uploadModelFile(*file);
+            if (onUploaded) onUploaded();
+            return true;
+        };
+    });
+}
+
+void AssetLoader::loadImage(const std::string& path, Image* target, std::function<void()> onUploaded)
+{
+    loadImage(path, target, nullptr, onUploaded);
+}
+
+void AssetLoader::loadImage(const std::string& path, Image* target, TextureStreamer* streamer, std::function<void()> onUploaded)
+{
+    if (imagesRequested++ == 0) firstImageRequest = std::chrono::steady_clock::now();
+    imagesPending++;
+    submit([=]() -> std::function<bool()> {
+        // Pixels of an upload dropped by the destructor are freed with it
+        std::shared_ptr<Image> image(new Image(), [](Image* image) {
+            freeImagePixels(*image);
+            delete image;
+        });
+        std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+        CompressedTextureView view;
+        auto start = std::chrono::steady_clock::now();
+        if (streamer && openCompressedTexture(compressedTexturePath(path), path, *file, view) && canUploadCompressed(view.format)) {
+            image->width = view.width;
+            image->height = view.height;
+            image->blockFormat = view.format;
+            image->levelCount = view.levelCount;
+            image->decodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            return [this, path, image, file, view, streamer, target, onUploaded]() {
+                auto uploadStart = std::chrono::steady_clock::now();
+                image->streamed = streamer->add(compressedTexturePath(path), file, view);
+                image->handle = streamer->handle(image->streamed);
+                image->uploadSteps = 1;
+                image->uploadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - uploadStart).count();
+                *target = *image;
+                imageUploaded(path, *image);
+                if (onUploaded) onUploaded();
+                return true;
+            };
+        }
+        if (!decodeImage(path, *image)) {
+            return [this]() {
+                imagesPending--;
+                return true;
+            };
+        }
+        return [this, path, image, target, onUploaded]() {
+            if (!uploadImageRows(*image)) return false;
+            *target = *image;
+            imageUploaded(path, *image);
+            if (onUploaded) onUploaded();
+            return true;
+        };
+    });
+}
+
+void AssetLoader::imageUploaded(const std::string& path, const Image& image)
+{
+    const char* format = image.blockFormat != 0 ? blockFormatName((BlockFormat) image.blockFormat) : image.channels == 3 ? "RGB" : "RGBA";
+    const char* decoded = image.streamed >= 0 ? ", streamed, opened in " : image.blockFormat != 0 ? ", read in " : ", decoded in ";
+    std::cout << path << ": " << image.width << "x" << image.height << " " << format << decoded << image.decodeMs
+              << " ms on a worker, uploaded in " << image.uploadMs << " ms in " << image.uploadSteps << " steps" << std::endl;
+    imageDecodeMs += image.decodeMs;
+    imageUploadMs += image.uploadMs;
+    if (--imagesPending == 0) {
+        double readyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - firstImageRequest).count();
+        std::cout << "Textures ready: " << imagesRequested << " textures " << readyMs << " ms after the first request ("
+                  << imageDecodeMs << " ms of decoding on the workers, " << imageUploadMs << " ms of uploads on the main thread)" << std::endl;
+    }
+}
+
+// Runs one upload with the lock released, false when none is ready
+bool AssetLoader::uploadNext(std::unique_lock<std::mutex>& lock)
+{
+    if (uploads.empty()) return false;
+    std::function<bool()> upload = std::move(uploads.front());
+    uploads.pop_front();
+
+    lock.unlock();
+    bool complete = upload();
+    lock.lock();
+
+    // Steps left: after the other uploads, which may be done in fewer steps
+    if (!complete) {
+        uploads.push_back(std::move(upload));
+        return true;
+    }
+
+    // After the callbacks, so assets requested by them keep the count up
+    outstanding--;
+    return true;
+}
+
+bool AssetLoader::update(double budgetMs)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mutex);
+    while (uploadNext(lock)) {
+        double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (elapsedMs >= budgetMs) break;
+    }
+    return outstanding == 0;
+}
+
+void AssetLoader::finish()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (outstanding > 0) {
+        finished.wait(lock, [this]() { return !uploads.empty(); });
+        uploadNext(lock);
+    }
+}
+
+unsigned int AssetLoader::placeholderTexture()
+{
+    if (placeholder == 0) {
+        const unsigned char grey[4] = { 128, 128, 128, 255 };
+        glGenTextures(1, &placeholder);
+        glBindTexture(GL_TEXTURE_2D, placeholder);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    return placeholder;
+}
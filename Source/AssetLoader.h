@@ -0,0 +1,76 @@
+#pragma once
+#include "Image.h"
+#include "Model.h"
+#include "TextureStreamer.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Loads models and textures in the background: the files are read, parsed
+// and decoded on the loader's own workers (which may in turn use the shared
+// pool), the GL uploads are queued for the main thread and done in update
+// under a time budget. Textures go up in steps through the pixel unpack
+// buffer ring of Image.h, a large one is spread over several updates. Until
+// then the targets stay placeholders: models without a VAO are not drawn and
+// textures are the 1x1 grey of placeholderTexture.
+//
+// Targets have to stay at the same address until they are uploaded.
+class AssetLoader
+{
+public:
+    AssetLoader();
+    ~AssetLoader();
+
+    // 'onUploaded' runs on the main thread after the upload and may request
+    // more assets, e.g. the textures named by a model's materials. Assets
+    // that fail to load keep their placeholder and skip the callback.
+    void loadModel(const std::string& path, const std::string& matBaseDir, bool withMaterials, Model* target,
+                   std::function<void()> onUploaded = nullptr);
+    void loadMorphModel(const std::string& animationPath, const std::vector<std::string>& framePaths,
+                        const std::string& matBaseDir, Model* target, std::function<void()> onUploaded = nullptr);
+    void loadImage(const std::string& path, Image* target, std::function<void()> onUploaded = nullptr);
+
+    // With a streamer, an image with a compressed DDS file is handed to it
+    // instead, with only its small levels uploaded (target->streamed is its id)
+    void loadImage(const std::string& path, Image* target, TextureStreamer* streamer, std::function<void()> onUploaded = nullptr);
+
+    // Uploads finished assets until 'budgetMs' is used up, at least one per
+    // call. True once everything requested so far is uploaded.
+    bool update(double budgetMs);
+
+    // Blocks until everything requested, including the requests made by the
+    // callbacks, is uploaded
+    void finish();
+
+    size_t pending() const { return outstanding; }
+
+    // Texture handle to use until a texture is uploaded
+    unsigned int placeholderTexture();
+
+private:
+    void submit(std::function<std::function<bool()>()> work);
+    bool uploadNext(std::unique_lock<std::mutex>& lock);
+    void imageUploaded(const std::string& path, const Image& image);
+
+    ThreadPool pool;
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::deque<std::function<bool()>> uploads;  // GL halves of the finished loads, false while they have steps left
+    size_t outstanding = 0;                     // requested and not uploaded yet, main thread only
+    unsigned int placeholder = 0;
+
+    // Texture timings, main thread only
+    size_t imagesRequested = 0;
+    size_t imagesPending = 0;
+    double imageDecodeMs = 0;
+    double imageUploadMs = 0;
+    std::chrono::steady_clock::time_point firstImageRequest;
+};
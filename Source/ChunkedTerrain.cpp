@@ -0,0 +1,291 @@
+#include "ChunkedTerrain.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <queue>
+#include <utility>
+
+
+void ChunkedTerrain::build(Heightfield sourceHeightfield, float sourceHeightMult, float sourceScale, bool sourceIsWater, ThreadPool& pool)
+{
+    heightfield = std::move(sourceHeightfield);
+    heightMult = sourceHeightMult;
+    scale = sourceScale;
+    isWater = sourceIsWater;
+
+    // Halve the patches as long as they stay at least MIN_PATCH_CELLS wide
+    patchCells = heightfield.resolution;
+    levels = 1;
+    while (patchCells % 2 == 0 && patchCells / 2 >= MIN_PATCH_CELLS) {
+        patchCells /= 2;
+        levels++;
+    }
+
+    float cellSize = scale / heightfield.resolution;
+    if (lodDistance <= 0.f) {
+        lodDistance = 2.f * patchCells * cellSize;
+    }
+
+    patches.clear();
+    addPatch(levels - 1, 0, 0);
+
+    // Bounds and error of every patch, comparing each full resolution sample
+    // with the triangles the patch's own (coarser) grid is drawn with
+    pool.parallelFor((int) patches.size(), [&](int node) {
+        TerrainPatch& patch = patches[node];
+        int stride = 1 << patch.level;
+
+        float minHeight = heightfield.at(patch.firstRow, patch.firstCol);
+        float maxHeight = minHeight;
+        float error = 0.f;
+
+        for (int i = 0; i <= patch.cells; i++) {
+            int ci = std::min(i / stride, patchCells - 1);
+            float fi = (float) (i - ci * stride) / stride;
+
+            for (int j = 0; j <= patch.cells; j++) {
+                int cj = std::min(j / stride, patchCells - 1);
+                float fj = (float) (j - cj * stride) / stride;
+
+                int row = patch.firstRow + ci * stride;
+                int col = patch.firstCol + cj * stride;
+                float h00 = heightfield.at(row, col);
+                float h01 = heightfield.at(row, col + stride);
+                float h10 = heightfield.at(row + stride, col);
+                float h11 = heightfield.at(row + stride, col + stride);
+                Vector3f normal;
+                float interpolated = interpolateTerrainCell(h00, h10, h01, h11, fi, fj, (float) stride, normal);
+
+                float h = heightfield.at(patch.firstRow + i, patch.firstCol + j);
+                minHeight = std::min(minHeight, h);
+                maxHeight = std::max(maxHeight, h);
+                error = std::max(error, std::abs(h - interpolated));
+            }
+        }
+
+        Vector3f corner = getHeightfieldPoint(heightfield, patch.firstRow, patch.firstCol, heightMult, scale);
+        patch.boundsMin = Vector3f(corner.x, minHeight * heightMult, corner.z);
+        patch.boundsMax = Vector3f(corner.x + patch.cells * cellSize, maxHeight * heightMult, corner.z + patch.cells * cellSize);
+        patch.error = error * heightMult;
+    });
+
+    levelError.assign(levels, 0.f);
+    for (const TerrainPatch& patch : patches) {
+        levelError[patch.level] = std::max(levelError[patch.level], patch.error);
+    }
+}
+
+int ChunkedTerrain::addPatch(int level, int firstRow, int firstCol)
+{
+    TerrainPatch patch;
+    patch.level = level;
+    patch.firstRow = firstRow;
+    patch.firstCol = firstCol;
+    patch.cells = patchCells << level;
+    patch.error = 0.f;
+    for (int c = 0; c < 4; c++) patch.children[c] = -1;
+
+    int node = (int) patches.size();
+    patches.push_back(patch);
+
+    if (level > 0) {
+        int half = patch.cells / 2;
+        for (int c = 0; c < 4; c++) {
+            int child = addPatch(level - 1, firstRow + (c / 2) * half, firstCol + (c % 2) * half);
+            patches[node].children[c] = child;
+        }
+    }
+    return node;
+}
+
+static float distanceToBounds(const Vector3f& p, const Vector3f& boundsMin, const Vector3f& boundsMax)
+{
+    float dx = std::max(std::max(boundsMin.x - p.x, 0.f), p.x - boundsMax.x);
+    float dy = std::max(std::max(boundsMin.y - p.y, 0.f), p.y - boundsMax.y);
+    float dz = std::max(std::max(boundsMin.z - p.z, 0.f), p.z - boundsMax.z);
+    return std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+// A patch is split into its children while the viewer is within the range of
+// the children's level and the budget has room for three more patches. The
+// splits go by the error of the patch over its distance, largest first, so a
+// larger map spends the same triangles where they matter most.
+void ChunkedTerrain::select(const Vector3f& position, std::vector<int>& selected) const
+{
+    selected.clear();
+    if (patches.empty()) return;
+
+    size_t maxPatches = maxTriangles > 0 ? std::max((size_t) 1, maxTriangles / trianglesPerPatch()) : patches.size();
+    float cellSize = scale / heightfield.resolution;
+
+    std::priority_queue<std::pair<float, int>> candidates;
+    auto consider = [&](int node) {
+        const TerrainPatch& patch = patches[node];
+        float distance = distanceToBounds(position, patch.boundsMin, patch.boundsMax);
+        if (patch.level == 0 || distance > lodDistance * (1 << (patch.level - 1))) {
+            selected.push_back(node);
+            return;
+        }
+        candidates.push(std::make_pair(patch.error / std::max(distance, cellSize), node));
+    };
+
+    consider(0);
+    while (!candidates.empty()) {
+        int node = candidates.top().second;
+        candidates.pop();
+
+        // The patches drawn so far if this one is not split
+        size_t drawn = selected.size() + candidates.size() + 1;
+        if (drawn + 3 > maxPatches) {
+            selected.push_back(node);
+            continue;
+        }
+        for (int c = 0; c < 4; c++) {
+            consider(patches[node].children[c]);
+        }
+    }
+}
+
+const Model& ChunkedTerrain::patchModel(int node)
+{
+    TerrainPatch& patch = patches[node];
+    if (!patch.uploaded) {
+        patch.model = buildPatchMesh(patch);
+        uploadTerrain(patch.model);
+        patch.uploaded = true;
+
+        // Only the GPU copy is needed to draw an indexed model
+        patch.model.vertices = std::vector<Vector3f>();
+        patch.model.normals = std::vector<Vector3f>();
+        patch.model.diffuseColors = std::vector<Vector3f>();
+        patch.model.ambientColors = std::vector<Vector3f>();
+        patch.model.specularColors = std::vector<Vector3f>();
+        patch.model.shininessValues = std::vector<float>();
+        patch.model.indices = std::vector<GLuint>();
+    }
+    return patch.model;
+}
+
+// The grid and the skirt along its four edges
+size_t ChunkedTerrain::trianglesPerPatch() const
+{
+    return (size_t) patchCells * patchCells * 2 + 4 * patchCells * 2;
+}
+
+size_t ChunkedTerrain::triangleCount(const std::vector<int>& selected) const
+{
+    return selected.size() * trianglesPerPatch();
+}
+
+// Grid of (patchCells + 1)^2 vertices sampling every 2^level heightfield
+// samples, followed by one skirt vertex below each border vertex
+Model ChunkedTerrain::buildPatchMesh(const TerrainPatch& patch) const
+{
+    Model model;
+
+    int stride = 1 << patch.level;
+    int side = patchCells + 1;
+
+    // The skirt has to cover the cracks towards a coarser neighbour as well
+    float skirtDepth = levelError[std::min(patch.level + 1, levels - 1)];
+    skirtDepth = std::max(skirtDepth, patch.error) + 0.01f * heightMult;
+
+    for (int a = 0; a < side; a++) {
+        for (int b = 0; b < side; b++) {
+            int i = patch.firstRow + a * stride;
+            int j = patch.firstCol + b * stride;
+            model.vertices.push_back(getHeightfieldPoint(heightfield, i, j, heightMult, scale));
+            model.normals.push_back(getHeightfieldNormal(heightfield, i, j, heightMult, scale));
+            model.diffuseColors.push_back(getColor(heightfield.at(i, j), isWater));
+        }
+    }
+
+    for (int a = 0; a < patchCells; a++) {
+        for (int b = 0; b < patchCells; b++) {
+            GLuint i11 = a * side + b;
+            GLuint i12 = i11 + 1;
+            GLuint i21 = i11 + side;
+            GLuint i22 = i21 + 1;
+            GLuint cell[6] = { i11, i21, i22, i11, i22, i12 };
+            model.indices.insert(model.indices.end(), cell, cell + 6);
+        }
+    }
+
+    // Border of the grid, one edge after the other
+    for (int edge = 0; edge < 4; edge++) {
+        GLuint first = (GLuint) model.vertices.size();
+        for (int k = 0; k < side; k++) {
+            int a = edge == 0 ? 0 : edge == 1 ? patchCells : k;
+            int b = edge == 2 ? 0 : edge == 3 ? patchCells : k;
+            GLuint top = a * side + b;
+
+            Vector3f skirtPoint = model.vertices[top];
+            skirtPoint.y -= skirtDepth;
+            model.vertices.push_back(skirtPoint);
+            model.normals.push_back(model.normals[top]);
+            model.diffuseColors.push_back(model.diffuseColors[top]);
+
+            if (k > 0) {
+                GLuint prevTop = edge < 2 ? top - 1 : top - side;
+                GLuint quad[6] = { prevTop, top, first + k, prevTop, first + k, first + k - 1 };
+                model.indices.insert(model.indices.end(), quad, quad + 6);
+            }
+        }
+    }
+
+    size_t numVertices = model.vertices.size();
+    model.ambientColors.assign(numVertices, Vector3f(1.f, 1.f, 1.f));
+    model.specularColors.assign(numVertices, Vector3f(0.5f, 0.5f, 0.5f));
+    model.shininessValues.assign(numVertices, 20.f);
+
+    return model;
+}
+
+
+void benchmarkChunkedTerrain(const noise::module::Perlin& perlinGenerator, float perlinSize, float heightMult, float scale)
+{
+    // Same cell size as a 128 x 128 map of the given scale, growing the side
+    const int baseResolution = 128;
+    const int sizeMultipliers[] = { 1, 4, 10 };
+    const int numViewers = 1000;
+
+    std::cout << "Chunked terrain, " << numViewers << " random viewer positions per map, budget "
+              << ChunkedTerrain().maxTriangles << " triangles" << std::endl;
+
+    for (int multiplier : sizeMultipliers) {
+        int resolution = baseResolution * multiplier;
+        float worldScale = scale * multiplier;
+
+        ChunkedTerrain terrain;
+        terrain.build(buildHeightfield(perlinGenerator, perlinSize * multiplier, resolution, false), heightMult, worldScale, false);
+
+        srand(1);
+        std::vector<int> selected;
+        size_t totalTriangles = 0;
+        size_t maxTriangles = 0;
+        double totalSecs = 0;
+
+        for (int v = 0; v < numViewers; v++) {
+            Vector3f viewer(((float) rand() / RAND_MAX - 0.5f) * worldScale, heightMult * 2.f, ((float) rand() / RAND_MAX - 0.5f) * worldScale);
+
+            auto start = std::chrono::steady_clock::now();
+            terrain.select(viewer, selected);
+            auto end = std::chrono::steady_clock::now();
+
+            totalSecs += std::chrono::duration<double>(end - start).count();
+            size_t triangles = terrain.triangleCount(selected);
+            totalTriangles += triangles;
+            maxTriangles = std::max(maxTriangles, triangles);
+        }
+
+        size_t fullTriangles = (size_t) resolution * resolution * 2;
+        std::cout << "  world x" << multiplier * multiplier << " area (resolution " << resolution
+                  << ", " << terrain.getLevels() << " levels of " << terrain.getPatchCells() << " cells)"
+                  << ": full " << fullTriangles << " triangles"
+                  << ", chunked avg " << totalTriangles / numViewers << " max " << maxTriangles
+                  << ", selection " << totalSecs / numViewers * 1e6 << " us" << std::endl;
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "Model.h"
+#include "Terrain.h"
+
+#include <GDT/Vector3f.h>
+
+#include <vector>
+
+// Smallest number of cells per side a patch is split down to
+const int MIN_PATCH_CELLS = 16;
+
+// Node of the terrain quadtree. Every node is drawn as a patch of
+// patchCells x patchCells quads, sampling the heightfield every 2^level cells,
+// so the root covers the whole map coarsely and the leaves at full resolution.
+struct TerrainPatch
+{
+    int level;
+    int firstRow, firstCol; // heightfield sample of the patch corner
+    int cells;              // heightfield cells per side covered by the patch
+    Vector3f boundsMin, boundsMax;
+    float error;            // largest height difference to the full resolution terrain
+    int children[4];        // -1 for leaves
+
+    bool uploaded = false;
+    Model model;
+};
+
+// Quadtree of terrain patches with a level of detail chosen per patch from its
+// distance to the viewer (geomipmapping). Neighbouring patches of different
+// levels do not share their edge vertices, so every patch hangs a skirt down
+// from its border, as deep as the patch error, to hide the cracks.
+class ChunkedTerrain
+{
+public:
+    // Patches of the finest level are drawn while the viewer is closer than
+    // lodDistance (world units), each coarser level doubles that range
+    float lodDistance = 0.f;
+
+    // Triangles drawn at most, whatever the size of the map: within their
+    // ranges, the patches with the largest error over distance are split
+    // first, until the next split would not fit. 0 for no budget.
+    size_t maxTriangles = 20480;
+
+    // The heightfield resolution has to be patchCells * 2^n for some n
+    void build(Heightfield heightfield, float heightMult, float scale, bool isWater, ThreadPool& pool = ThreadPool::shared());
+
+    // Collects the patches to draw for a viewer at 'position'
+    void select(const Vector3f& position, std::vector<int>& selected) const;
+
+    // Model of a patch, generated and uploaded on first use
+    const Model& patchModel(int node);
+
+    size_t triangleCount(const std::vector<int>& selected) const;
+    size_t trianglesPerPatch() const;
+
+    int getPatchCells() const { return patchCells; }
+    int getLevels() const { return levels; }
+    const std::vector<TerrainPatch>& getPatches() const { return patches; }
+
+private:
+    int addPatch(int level, int firstRow, int firstCol);
+    Model buildPatchMesh(const TerrainPatch& patch) const;
+
+    Heightfield heightfield;
+    float heightMult = 1.f;
+    float scale = 1.f;
+    bool isWater = false;
+
+    int patchCells = 0;
+    int levels = 0;
+    std::vector<TerrainPatch> patches;
+    std::vector<float> levelError; // largest patch error of every level
+};
+
+// Builds chunked terrains of growing size and prints the triangles drawn and
+// the time spent selecting patches, no window or GL context needed
+void benchmarkChunkedTerrain(const noise::module::Perlin& perlinGenerator, float perlinSize, float heightMult, float scale);
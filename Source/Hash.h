@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Spreads the bits of a hash over all 64 of them (the finalizer of MurmurHash3)
+inline uint64_t mixHash(uint64_t hash)
+{
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// Checksum over 64-bit words, fast enough to checksum a few MB of asset data
+// on every start. Every word is mixed into all bits of the hash before the
+// next one is added, so changes to the same bits of two words (the signs of
+// two floats) do not cancel out. Not a cryptographic hash.
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+    const unsigned char* bytes = (const unsigned char*) data;
+    size_t words = size / sizeof(uint64_t);
+    for (size_t k = 0; k < words; k++) {
+        uint64_t word;
+        std::memcpy(&word, bytes + k * sizeof(uint64_t), sizeof(uint64_t));
+        hash = mixHash(hash ^ word);
+    }
+
+    // The last bytes zero padded, and the size so the padding counts
+    uint64_t tail = 0;
+    if (size > words * sizeof(uint64_t)) std::memcpy(&tail, bytes + words * sizeof(uint64_t), size - words * sizeof(uint64_t));
+    hash = mixHash(hash ^ tail);
+    return mixHash(hash ^ (uint64_t) size);
+}
@@ -1,31 +1,321 @@
 #include "Image.h"
+#include "ResourceArchive.h"
+#include "TextureCompression.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
 #include <GDT/OpenGL.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <map>
 
-Image loadImage(std::string path)
+static std::atomic<bool> s3tcSupported(false);
+
+void detectTextureCompression()
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char* name = (const char*) glGetStringi(GL_EXTENSIONS, i);
+        if (name && std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0) s3tcSupported = true;
+    }
+    if (!s3tcSupported) std::cout << "No S3TC texture compression, decoding the images" << std::endl;
+}
+
+bool canUploadCompressed(int blockFormat)
+{
+    // BC5 (RGTC) is core since GL 3.0, BC1 and BC3 need the extension
+    return blockFormat == BLOCK_BC5 || s3tcSupported;
+}
+
+// The DDS file of the image, its levels copied out of the file or archive
+static bool readCompressedImage(const std::string& path, Image& image)
+{
+    MappedFile file;
+    CompressedTextureView view;
+    if (!openCompressedTexture(compressedTexturePath(path), path, file, view)) return false;
+    if (!canUploadCompressed(view.format)) return false;
+
+    image.data = (unsigned char*) std::malloc(view.size);
+    if (!image.data) return false;
+    std::memcpy(image.data, view.blocks, view.size);
+    image.width = view.width;
+    image.height = view.height;
+    image.channels = view.format == BLOCK_BC1 ? 3 : view.format == BLOCK_BC3 ? 4 : 2;
+    image.blockFormat = view.format;
+    image.levelCount = view.levelCount;
+    return true;
+}
+
+bool decodeImage(const std::string& path, Image& image)
 {
+    auto start = std::chrono::steady_clock::now();
+    image.path = path;
+    if (readCompressedImage(path, image)) {
+        image.decodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    // Opaque images (all JPEGs) are decoded to RGB, a quarter less to copy
+    // and upload than RGBA
     int comp;
-    int width, height;
+    ArchiveBlob blob;
+    bool inArchive = findInArchive(path, blob);
+    bool known = inArchive ? stbi_info_from_memory(blob.data, (int) blob.size, &image.width, &image.height, &comp) != 0
+                           : stbi_info(path.c_str(), &image.width, &image.height, &comp) != 0;
+    image.channels = known && (comp == 1 || comp == 3) ? 3 : 4;
 
-    Image image;
-    image.data = stbi_load(path.c_str(), &image.width, &image.height, &comp, 4);
+    if (inArchive) {
+        image.data = stbi_load_from_memory(blob.data, (int) blob.size, &image.width, &image.height, &comp, image.channels);
+    } else {
+        image.data = stbi_load(path.c_str(), &image.width, &image.height, &comp, image.channels);
+    }
 
     if (!image.data) {
         std::cout << "Failed to load image at: " << path << std::endl;
-        exit(0);
+        return false;
+    }
+    image.decodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+// S3TC is an extension, not in the GL 3.3 headers
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+    #define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+    #define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+static GLuint uploadRing[TEXTURE_UPLOAD_RING_SIZE] = {};
+static size_t uploadRingSizes[TEXTURE_UPLOAD_RING_SIZE] = {};
+static int uploadRingNext = 0;
+
+const unsigned char* stageTextureUpload(const unsigned char* pixels, size_t bytes)
+{
+    GLuint& buffer = uploadRing[uploadRingNext];
+    size_t& bufferSize = uploadRingSizes[uploadRingNext];
+    uploadRingNext = (uploadRingNext + 1) % TEXTURE_UPLOAD_RING_SIZE;
+    if (buffer == 0) glGenBuffers(1, &buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    if (bufferSize < bytes) {
+        bufferSize = std::max(bytes, TEXTURE_UPLOAD_STEP);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bufferSize, nullptr, GL_STREAM_DRAW);
+    }
+
+    void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!mapped) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return pixels;
+    }
+    std::memcpy(mapped, pixels, bytes);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    return nullptr;
+}
+
+unsigned int compressedTextureFormat(int blockFormat)
+{
+    switch (blockFormat) {
+    case BLOCK_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case BLOCK_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    default: return GL_COMPRESSED_RG_RGTC2;
+    }
+}
+
+// Whole levels, as many as fit in 'maxBytes' but at least one
+static bool uploadImageLevels(Image& image, size_t maxBytes)
+{
+    BlockFormat format = (BlockFormat) image.blockFormat;
+    if (image.uploadSteps == 0) {
+        glGenTextures(1, &image.handle);
+        glBindTexture(GL_TEXTURE_2D, image.handle);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, image.levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.levelCount - 1);
+        image.uploadedLevels = 0;
+    }
+
+    size_t offset = 0;
+    for (int level = 0; level < image.uploadedLevels; level++) {
+        offset += compressedLevelBytes(format, std::max(1, image.width >> level), std::max(1, image.height >> level));
+    }
+    int first = image.uploadedLevels, last = first;
+    size_t bytes = 0;
+    while (last < image.levelCount) {
+        size_t levelBytes = compressedLevelBytes(format, std::max(1, image.width >> last), std::max(1, image.height >> last));
+        if (last > first && bytes + levelBytes > maxBytes) break;
+        bytes += levelBytes;
+        last++;
     }
 
-    glGenTextures(1, &image.handle);
     glBindTexture(GL_TEXTURE_2D, image.handle);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.data);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    const unsigned char* blocks = stageTextureUpload(image.data + offset, bytes);
+    for (int level = first; level < last; level++) {
+        int width = std::max(1, image.width >> level), height = std::max(1, image.height >> level);
+        size_t levelBytes = compressedLevelBytes(format, width, height);
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, compressedTextureFormat(image.blockFormat), width, height, 0, (GLsizei) levelBytes, blocks);
+        blocks += levelBytes;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    image.uploadedLevels = last;
+    return last >= image.levelCount;
+}
+
+void freeImagePixels(Image& image)
+{
+    if (!image.data) return;
+    if (image.blockFormat != 0) {
+        std::free(image.data);
+    } else {
+        stbi_image_free(image.data);
+    }
+    image.data = nullptr;
+}
+
+static size_t levelsBytes(const Image& image, int levels)
+{
+    size_t bytes = 0;
+    for (int level = 0; level < levels; level++) {
+        int width = std::max(1, image.width >> level), height = std::max(1, image.height >> level);
+        bytes += image.blockFormat != 0 ? compressedLevelBytes((BlockFormat) image.blockFormat, width, height) : (size_t) width * height * 4;
+    }
+    return bytes;
+}
+
+static int fullLevelCount(int width, int height)
+{
+    int levels = 1;
+    while (width > 1 || height > 1) {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        levels++;
+    }
+    return levels;
+}
+
+static void trackImageMemory(const Image& image, bool complete)
+{
+    size_t cpuBytes = 0;
+    if (image.data) cpuBytes = image.blockFormat != 0 ? levelsBytes(image, image.levelCount) : (size_t) image.width * image.height * image.channels;
+
+    // Plain images have their whole level 0 from the first step and the
+    // mipmaps after the last
+    int levels = image.blockFormat != 0 ? image.uploadedLevels : complete ? fullLevelCount(image.width, image.height) : 1;
+    trackTextureMemory(image.handle, image.path, cpuBytes, levelsBytes(image, levels));
+}
+
+bool uploadImageRows(Image& image, size_t maxBytes)
+{
+    auto start = std::chrono::steady_clock::now();
+    if (image.blockFormat != 0) {
+        bool complete = uploadImageLevels(image, maxBytes);
+        image.uploadSteps++;
+        if (complete) freeImagePixels(image);
+        trackImageMemory(image, complete);
+        image.uploadMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return complete;
+    }
+
+    GLenum format = image.channels == 3 ? GL_RGB : GL_RGBA;
+    size_t rowBytes = (size_t) image.width * image.channels;
+
+    if (image.uploadSteps == 0) {
+        glGenTextures(1, &image.handle);
+        glBindTexture(GL_TEXTURE_2D, image.handle);
+        glTexImage2D(GL_TEXTURE_2D, 0, image.channels == 3 ? GL_RGB8 : GL_RGBA8, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        image.uploadedRows = 0;
+    }
+
+    int rows = std::min(image.height - image.uploadedRows, std::max(1, (int) (maxBytes / std::max(rowBytes, (size_t) 1))));
+    size_t bytes = rows * rowBytes;
+
+    // RGB rows are not 4-byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, image.handle);
+    const unsigned char* pixels = stageTextureUpload(image.data + image.uploadedRows * rowBytes, bytes);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, image.uploadedRows, image.width, rows, format, GL_UNSIGNED_BYTE, pixels);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    image.uploadedRows += rows;
+    image.uploadSteps++;
+    bool complete = image.uploadedRows >= image.height;
+    if (complete) {
+        glGenerateMipmap(GL_TEXTURE_2D);
+        freeImagePixels(image);
+    }
+    trackImageMemory(image, complete);
+    image.uploadMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return complete;
+}
+
+void uploadImage(Image& image)
+{
+    while (!uploadImageRows(image)) {
+    }
+}
+
+Image loadImage(std::string path)
+{
+    Image image;
+    if (!decodeImage(path, image)) {
+        exit(0);
+    }
+    uploadImage(image);
 
     return image;
 }
+
+static std::map<unsigned int, TextureMemory>& trackedTextures()
+{
+    static std::map<unsigned int, TextureMemory>* textures = new std::map<unsigned int, TextureMemory>();
+    return *textures;
+}
+
+void trackTextureMemory(unsigned int handle, const std::string& path, size_t cpuBytes, size_t gpuBytes, bool streamed)
+{
+    TextureMemory& texture = trackedTextures()[handle];
+    texture.path = path;
+    texture.handle = handle;
+    texture.cpuBytes = cpuBytes;
+    texture.gpuBytes = gpuBytes;
+    texture.streamed = streamed;
+}
+
+void untrackTextureMemory(unsigned int handle)
+{
+    trackedTextures().erase(handle);
+}
+
+std::vector<TextureMemory> getTextureMemory()
+{
+    std::vector<TextureMemory> textures;
+    for (const auto& entry : trackedTextures()) textures.push_back(entry.second);
+    return textures;
+}
+
+void printTextureMemory()
+{
+    std::vector<TextureMemory> textures = getTextureMemory();
+    std::sort(textures.begin(), textures.end(), [](const TextureMemory& a, const TextureMemory& b) {
+        return a.cpuBytes + a.gpuBytes > b.cpuBytes + b.gpuBytes;
+    });
+    size_t cpuBytes = 0, gpuBytes = 0;
+    for (const TextureMemory& texture : textures) {
+        cpuBytes += texture.cpuBytes;
+        gpuBytes += texture.gpuBytes;
+    }
+    std::cout << "Texture memory: " << textures.size() << " textures, " << cpuBytes / 1024 << " KB in RAM, "
+              << gpuBytes / 1024 << " KB on the GPU" << std::endl;
+    for (const TextureMemory& texture : textures) {
+        std::cout << "    " << texture.path << " (" << texture.handle << (texture.streamed ? ", streamed" : "") << "): "
+                  << texture.cpuBytes / 1024 << " KB in RAM, " << texture.gpuBytes / 1024 << " KB on the GPU" << std::endl;
+    }
+}
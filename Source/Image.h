@@ -1,14 +1,95 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
+#include <vector>
 
 class Image
 {
 public:
     int width, height;
-    unsigned char* data;
+    std::string path;
+    int channels = 4;       // of the decoded pixels: 3 for opaque images, 4 with alpha
+    unsigned char* data = nullptr;  // owned by the image until the upload completes, then freed
 
-    unsigned int handle;
+    // Block compressed images (TextureCompression.h) have all their levels
+    // in 'data', one after the other
+    int blockFormat = 0;    // BlockFormat, 0 for plain pixels
+    int levelCount = 1;
+    int streamed = -1;      // id in the TextureStreamer owning the texture, -1 when uploaded whole
+
+    unsigned int handle = 0;
+
+    // Progress and timings of the upload, see uploadImageRows
+    int uploadedRows = 0;
+    int uploadedLevels = 0;
+    int uploadSteps = 0;
+    double decodeMs = 0;
+    double uploadMs = 0;
 };
 
 Image loadImage(std::string path);
+
+// The two halves of loadImage, for loading on worker threads: decodeImage
+// runs on any thread and is false when the file can not be read (from the
+// mounted archive when it is in there, see ResourceArchive.h), uploadImage
+// creates the texture on the main thread. decodeImage prefers the block
+// compressed DDS file TextureCompressor wrote next to the image, when the
+// GPU can sample it.
+bool decodeImage(const std::string& path, Image& image);
+void uploadImage(Image& image);
+
+// Looks for the texture compression extensions, on the main thread once the
+// context exists. Until then decodeImage only decodes the images.
+void detectTextureCompression();
+
+// False for the formats of TextureCompression.h the GPU can not sample
+bool canUploadCompressed(int blockFormat);
+
+// GL internal format of a BlockFormat
+unsigned int compressedTextureFormat(int blockFormat);
+
+// Frees the decoded pixels of an image that is not going to be uploaded
+void freeImagePixels(Image& image);
+
+// Bytes of pixels copied per call of uploadImageRows
+const size_t TEXTURE_UPLOAD_STEP = 4 * 1024 * 1024;
+
+// Pixel unpack buffers the uploads rotate through, so a step never waits for
+// the GPU to finish reading the buffer of the step before
+const int TEXTURE_UPLOAD_RING_SIZE = 3;
+
+// uploadImage in steps that fit in a frame: copies the next rows, at most
+// about 'maxBytes' of them, into a pixel unpack buffer of the ring and lets
+// the GPU fetch them from there while the frame goes on. The texture is
+// created on the first call and gets its mipmaps after the last rows. Block
+// compressed images go up a whole level at a time, with the mip levels of
+// the file. True once it is complete, the pixels are freed by then.
+bool uploadImageRows(Image& image, size_t maxBytes = TEXTURE_UPLOAD_STEP);
+
+// Copies 'bytes' into the next buffer of the ring and leaves it bound as the
+// pixel unpack buffer, to be unbound after the upload. Returns what the
+// upload takes as its pixels: offset 0 in that buffer, or 'pixels' itself
+// (with no buffer bound) when it can not be mapped.
+const unsigned char* stageTextureUpload(const unsigned char* pixels, size_t bytes);
+
+// What a texture holds in RAM (decoded pixels waiting for their upload) and
+// on the GPU (estimated from its levels and format, RGB textures counted as
+// RGBA like drivers store them). Streamed textures read their levels from a
+// mapped file or the archive, they hold no pixels of their own.
+struct TextureMemory
+{
+    std::string path;
+    unsigned int handle = 0;
+    size_t cpuBytes = 0;
+    size_t gpuBytes = 0;
+    bool streamed = false;
+};
+
+// The textures made by uploadImageRows and TextureStreamer report their
+// memory here, by handle, on the main thread
+void trackTextureMemory(unsigned int handle, const std::string& path, size_t cpuBytes, size_t gpuBytes, bool streamed = false);
+void untrackTextureMemory(unsigned int handle);
+
+std::vector<TextureMemory> getTextureMemory();
+void printTextureMemory();
@@ -0,0 +1,222 @@
+// Offline converter from OBJ/MTL to the binary mesh files the game maps at
+// start (see MeshData.h), with the triangles and vertices reordered for the
+// GPU caches (MeshOptimizer.h). Run by the build on the copied Resources folder.
+//
+//   MeshConverter <file.obj | directory>...              converts, directories recursively
+//   MeshConverter --benchmark <file.obj | directory>...  times the OBJ against the binary path
+//   MeshConverter --benchmark-parser <file.obj | directory>...  times the OBJ parser on 1, 2, 4, ... threads
+//   MeshConverter --morph <directory>...                 the OBJ files of every directory as the frames
+//                                                        of one morph animation (MorphAnimation.h)
+
+#include "MeshData.h"
+#include "MeshOptimizer.h"
+#include "MorphAnimation.h"
+#include "ObjParser.h"
+#include "ResourceArchive.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// OBJ files below 'path' (or 'path' itself), sorted
+static void findObjFiles(const std::string& path, std::vector<std::string>& files)
+{
+    findFiles(path, std::vector<std::string>(1, ".obj"), files);
+}
+
+// MTL files are looked up next to the OBJ
+static std::string directoryOf(const std::string& path)
+{
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string("./") : path.substr(0, slash + 1);
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static int convert(const std::vector<std::string>& files)
+{
+    int failures = 0;
+    for (const std::string& path : files) {
+        MeshData mesh;
+        std::string output = binaryMeshPath(path);
+        if (!loadObjMesh(path, directoryOf(path), mesh)) {
+            std::cerr << "Could not convert " << path << std::endl;
+            failures++;
+            continue;
+        }
+
+        VertexCacheStats before = analyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+        optimizeMesh(mesh);
+        VertexCacheStats after = analyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+        packMesh(mesh);
+
+        if (!writeBinaryMesh(output, path, mesh)) {
+            std::cerr << "Could not convert " << path << std::endl;
+            failures++;
+            continue;
+        }
+        // Against one vertex per corner, without indices, in the float layout
+        // with the colours in every vertex
+        const size_t floatVertexSize = 18 * sizeof(float);
+        size_t indexBytes = mesh.vertices.size() <= 65536 ? sizeof(uint16_t) : sizeof(uint32_t);
+        size_t bytes = mesh.packedVertices.size() * sizeof(PackedVertex) + mesh.indices.size() * indexBytes;
+        std::cout << path << " -> " << output << " (" << mesh.vertices.size() << " vertices for "
+                  << mesh.indices.size() << " corners, " << mesh.materials.size() << " materials)" << std::endl;
+        std::cout << "    " << bytes / 1024 << " KB of vertices and indices, "
+                  << (double) (mesh.indices.size() * floatVertexSize) / bytes << "x less than unindexed, "
+                  << (double) (mesh.vertices.size() * floatVertexSize + mesh.indices.size() * indexBytes) / bytes
+                  << "x less than indexed float vertices, "
+                  << (mesh.texCoordFormat == TEXCOORD_UNORM16 ? "unorm16" : "half") << " texture coordinates" << std::endl;
+        // Against the colours and shininess in every vertex
+        std::cout << "    materials: " << mesh.materials.size() * MATERIAL_TABLE_ENTRY_SIZE << " bytes in the material table instead of "
+                  << mesh.vertices.size() * 10 * sizeof(float) / 1024 << " KB per vertex" << std::endl;
+        std::cout << "    ACMR " << before.acmr << " -> " << after.acmr
+                  << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+// CPU side of both loaders, the GPU upload is the same for both paths
+static int benchmark(const std::vector<std::string>& files)
+{
+    double totalObjMs = 0, totalBinaryMs = 0;
+    for (const std::string& path : files) {
+        auto start = std::chrono::steady_clock::now();
+        MeshData mesh;
+        if (!loadObjMesh(path, directoryOf(path), mesh)) continue;
+        optimizeMesh(mesh);
+        packMesh(mesh);
+        double objMs = millisecondsSince(start);
+
+        std::string binaryPath = binaryMeshPath(path);
+        if (!writeBinaryMesh(binaryPath, path, mesh)) continue;
+
+        start = std::chrono::steady_clock::now();
+        MappedFile file;
+        MeshView view;
+        std::vector<tinyobj::material_t> materials;
+        if (!openBinaryMesh(binaryPath, path, file, view, materials)) continue;
+        double binaryMs = millisecondsSince(start);
+
+        totalObjMs += objMs;
+        totalBinaryMs += binaryMs;
+        std::cout << path << ": " << view.vertexCount << " vertices for " << view.indexCount << " corners, OBJ " << objMs << " ms, binary "
+                  << binaryMs << " ms (" << objMs / std::max(binaryMs, 1e-3) << "x), "
+                  << file.size() / 1024 << " KB" << std::endl;
+    }
+    std::cout << "Total: OBJ " << totalObjMs << " ms, binary " << totalBinaryMs << " ms ("
+              << totalObjMs / std::max(totalBinaryMs, 1e-3) << "x)" << std::endl;
+    return 0;
+}
+
+// "Resources/spacecraftExplosion/" -> "Resources/spacecraftExplosion/spacecraftExplosion"
+static std::string animationPathOf(std::string directory)
+{
+    while (directory.size() > 1 && (directory.back() == '/' || directory.back() == '\\')) directory.pop_back();
+    size_t slash = directory.find_last_of("/\\");
+    return directory + "/" + (slash == std::string::npos ? directory : directory.substr(slash + 1));
+}
+
+// Converts and compares against loading every frame as a mesh of its own, the
+// way the frames were loaded before. The binary time of the separate meshes
+// needs the frames converted to .mesh files first.
+static int convertMorphs(const std::vector<std::string>& directories)
+{
+    int failures = 0;
+    for (const std::string& directory : directories) {
+        std::vector<std::string> frames;
+        findObjFiles(directory, frames);
+        std::string animationPath = animationPathOf(directory);
+
+        size_t separateBytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (const std::string& path : frames) {
+            MeshData mesh;
+            if (!loadObjMesh(path, directoryOf(path), mesh)) break;
+            optimizeMesh(mesh);
+            packMesh(mesh);
+            separateBytes += mesh.packedVertices.size() * sizeof(PackedVertex) + mesh.indices.size() * (mesh.vertices.size() <= 65536 ? 2 : 4);
+        }
+        double separateObjMs = millisecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        bool separateBinary = !frames.empty();
+        for (const std::string& path : frames) {
+            MappedFile file;
+            MeshView view;
+            std::vector<tinyobj::material_t> materials;
+            separateBinary = separateBinary && openBinaryMesh(binaryMeshPath(path), path, file, view, materials);
+        }
+        double separateBinaryMs = millisecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        MorphAnimation animation;
+        if (frames.empty() || !loadObjMorph(frames, directoryOf(frames[0]), animation)) {
+            std::cerr << "Could not convert the frames in " << directory << std::endl;
+            failures++;
+            continue;
+        }
+        double morphObjMs = millisecondsSince(start);
+
+        if (!writeMorph(animationPath, frames, animation)) {
+            std::cerr << "Could not convert the frames in " << directory << std::endl;
+            failures++;
+            continue;
+        }
+
+        start = std::chrono::steady_clock::now();
+        MappedFile meshFile, morphFile;
+        MeshView view;
+        MorphView morph;
+        std::vector<tinyobj::material_t> materials;
+        bool opened = openMorph(animationPath, frames, meshFile, view, materials, morphFile, morph);
+        double morphBinaryMs = millisecondsSince(start);
+
+        const MeshData& base = animation.base;
+        size_t baseBytes = base.packedVertices.size() * sizeof(PackedVertex) + base.indices.size() * (base.vertices.size() <= 65536 ? 2 : 4);
+        size_t deltaBytes = animation.deltas.size() * sizeof(MorphDelta);
+        std::cout << directory << " -> " << binaryMeshPath(animationPath) << " and " << morphPath(animationPath) << " ("
+                  << animation.frameCount << " frames, " << base.vertices.size() << " vertices for " << base.indices.size() << " corners)" << std::endl;
+        std::cout << "    separate meshes: " << separateBytes / 1024 << " KB, OBJ " << separateObjMs << " ms, binary ";
+        if (separateBinary) std::cout << separateBinaryMs << " ms" << std::endl;
+        else std::cout << "not converted" << std::endl;
+        std::cout << "    morph targets: " << (baseBytes + deltaBytes) / 1024 << " KB (" << baseBytes / 1024 << " KB base, "
+                  << deltaBytes / 1024 << " KB deltas, " << (double) separateBytes / (baseBytes + deltaBytes) << "x less), OBJ "
+                  << morphObjMs << " ms, binary ";
+        if (opened) std::cout << morphBinaryMs << " ms" << std::endl;
+        else std::cout << "failed" << std::endl;
+        std::cout << "    positions within " << animation.deltaScale / 2 << " of the frames" << std::endl;
+        if (!opened) failures++;
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string mode = argc > 1 && argv[1][0] == '-' ? argv[1] : "";
+    if (mode == "--morph" && argc > 2) {
+        return convertMorphs(std::vector<std::string>(argv + 2, argv + argc));
+    }
+
+    std::vector<std::string> files;
+    for (int i = mode.empty() ? 1 : 2; i < argc; i++) {
+        findObjFiles(argv[i], files);
+    }
+
+    if (files.empty() || (!mode.empty() && mode != "--benchmark" && mode != "--benchmark-parser")) {
+        std::cerr << "Usage: MeshConverter [--benchmark | --benchmark-parser] <file.obj | directory>..." << std::endl;
+        std::cerr << "       MeshConverter --morph <directory>..." << std::endl;
+        return 1;
+    }
+
+    if (mode == "--benchmark-parser") {
+        benchmarkObjParser(files);
+        return 0;
+    }
+    return mode == "--benchmark" ? benchmark(files) : convert(files);
+}
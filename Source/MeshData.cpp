@@ -0,0 +1,384 @@
+#include "MeshData.h"
+#include "Hash.h"
+#include "ObjParser.h"
+#include "ResourceArchive.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+static_assert(sizeof(PackedVertex) == 20, "PackedVertex is stored without padding");
+
+// Octahedral encoding: the normal is projected onto the octahedron |x| + |y| + |z| = 1
+// and the lower half folded over the upper one, leaving x and y in [-1, 1]
+uint32_t packNormal(const float* normal, uint32_t material)
+{
+    float x = normal[0], y = normal[1], z = normal[2];
+    float length = std::fabs(x) + std::fabs(y) + std::fabs(z);
+    if (length > 0) {
+        x /= length;
+        y /= length;
+    }
+    if (z < 0) {
+        float foldedX = (1 - std::fabs(y)) * (x >= 0 ? 1 : -1);
+        float foldedY = (1 - std::fabs(x)) * (y >= 0 ? 1 : -1);
+        x = foldedX;
+        y = foldedY;
+    }
+    int32_t packedX = (int32_t) std::lround(x * 511);
+    int32_t packedY = (int32_t) std::lround(y * 511);
+    return ((uint32_t) packedX & 0x3ff) | (((uint32_t) packedY & 0x3ff) << 10) | ((material & 0x3ff) << 20);
+}
+
+// IEEE half float, rounded to nearest
+static uint16_t toHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int exponent = (int) ((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (exponent <= 0) {
+        // Subnormal half, or zero
+        if (exponent < -10) return (uint16_t) sign;
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1) half++;
+        return (uint16_t) (sign | half);
+    }
+    if (exponent >= 31) return (uint16_t) (sign | 0x7c00);
+
+    // A carry out of the mantissa correctly moves on to the exponent
+    uint32_t half = sign | ((uint32_t) exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000) half++;
+    return (uint16_t) half;
+}
+
+void packMesh(MeshData& mesh)
+{
+    mesh.texCoordFormat = TEXCOORD_UNORM16;
+    for (const MeshVertex& vertex : mesh.vertices) {
+        for (int k = 0; k < 2; k++) {
+            if (vertex.texCoord[k] < 0.f || vertex.texCoord[k] > 1.f) mesh.texCoordFormat = TEXCOORD_HALF;
+        }
+    }
+
+    if (mesh.materials.size() > MAX_PACKED_MATERIAL + 1) {
+        std::cerr << "Only " << MAX_PACKED_MATERIAL + 1 << " of the " << mesh.materials.size() << " materials can be used" << std::endl;
+    }
+
+    mesh.packedVertices.resize(mesh.vertices.size());
+    for (size_t v = 0; v < mesh.vertices.size(); v++) {
+        const MeshVertex& vertex = mesh.vertices[v];
+        PackedVertex& packed = mesh.packedVertices[v];
+        std::memcpy(packed.position, vertex.position, sizeof(packed.position));
+        packed.normal = packNormal(vertex.normal, std::min(vertex.material, MAX_PACKED_MATERIAL));
+        for (int k = 0; k < 2; k++) {
+            packed.texCoord[k] = mesh.texCoordFormat == TEXCOORD_UNORM16
+                               ? (uint16_t) std::lround(vertex.texCoord[k] * 65535.f)
+                               : toHalf(vertex.texCoord[k]);
+        }
+    }
+}
+
+MeshView viewMesh(const MeshData& mesh)
+{
+    MeshView view;
+    view.vertices = mesh.packedVertices.data();
+    view.vertexCount = mesh.packedVertices.size();
+    view.indices = mesh.indices.data();
+    view.indexCount = mesh.indices.size();
+    view.indexSize = sizeof(uint32_t);
+    view.hasTexCoords = mesh.hasTexCoords;
+    view.texCoordFormat = mesh.texCoordFormat;
+    return view;
+}
+
+struct ObjCorner
+{
+    int vertex, normal, texCoord, material;
+    bool operator==(const ObjCorner& other) const
+    {
+        return vertex == other.vertex && normal == other.normal && texCoord == other.texCoord && material == other.material;
+    }
+};
+
+struct ObjCornerHash
+{
+    size_t operator()(const ObjCorner& corner) const
+    {
+        return (size_t) mixHash(hashBytes(&corner, sizeof(corner)));
+    }
+};
+
+bool loadObjMesh(const std::string& path, const std::string& matBaseDir, MeshData& mesh)
+{
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::string err;
+
+    std::ifstream ifs(path.c_str());
+    if (!ifs.is_open())
+    {
+        std::cerr << "Failed to find file: " << path << std::endl;
+        return false;
+    }
+
+    bool ret = loadObjParallel(&attrib, &shapes, &mesh.materials, &err, path.c_str(), matBaseDir.c_str());
+
+    if (!err.empty()) {
+        std::cerr << err << std::endl;
+    }
+
+    if (!ret) {
+        std::cerr << "Failed to load object: " << path << std::endl;
+        return false;
+    }
+
+    if (attrib.normals.size() == 0)
+    {
+        std::cerr << "Model does not have normal vectors, please re-export with normals." << std::endl;
+    }
+
+    // Faces without a material get the one tinyobj uses for missing materials,
+    // added to the table when it is first needed
+    int defaultMaterialId = -1;
+
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    mesh.hasTexCoords = attrib.texcoords.size() > 0;
+
+    // Corners with the same position, normal, texture coordinate and material
+    // share one vertex
+    std::unordered_map<ObjCorner, uint32_t, ObjCornerHash> uniqueVertices;
+
+    // Loop over shapes
+    for (size_t s = 0; s < shapes.size(); s++) {
+        // Loop over faces(polygon)
+        size_t index_offset = 0;
+        for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
+            int fv = shapes[s].mesh.num_face_vertices[f];
+
+            int materialId = shapes[s].mesh.material_ids[f];
+            if (materialId < 0) {
+                if (defaultMaterialId < 0) {
+                    defaultMaterialId = (int) mesh.materials.size();
+                    mesh.materials.push_back(tinyobj::material_t());
+                    initObjMaterial(&mesh.materials.back());
+                }
+                materialId = defaultMaterialId;
+            }
+
+            // Loop over vertices in the face.
+            for (int v = 0; v < fv; v++) {
+                tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
+
+                ObjCorner corner = { idx.vertex_index, idx.normal_index, idx.texcoord_index, materialId };
+                auto inserted = uniqueVertices.insert(std::make_pair(corner, (uint32_t) mesh.vertices.size()));
+                mesh.indices.push_back(inserted.first->second);
+                if (!inserted.second) continue;
+
+                MeshVertex vertex;
+                std::memset(&vertex, 0, sizeof(vertex));
+
+                for (int k = 0; k < 3; k++) {
+                    vertex.position[k] = attrib.vertices[3 * idx.vertex_index + k];
+                    if (idx.normal_index >= 0) vertex.normal[k] = attrib.normals[3 * idx.normal_index + k];
+                }
+                vertex.material = (uint32_t) materialId;
+
+                if (mesh.hasTexCoords && idx.texcoord_index >= 0) {
+                    vertex.texCoord[0] = attrib.texcoords[2 * idx.texcoord_index + 0];
+                    vertex.texCoord[1] = 1 - attrib.texcoords[2 * idx.texcoord_index + 1];
+                }
+
+                mesh.vertices.push_back(vertex);
+            }
+            index_offset += fv;
+        }
+    }
+
+    return true;
+}
+
+
+const char BINARY_MESH_MAGIC[4] = { 'M', 'E', 'S', 'H' };
+
+// Followed by the payload: materialCount BinaryMeshMaterial, vertexCount
+// PackedVertex and indexCount indices of indexSize bytes
+struct BinaryMeshHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceSize;        // of the OBJ file the mesh was converted from
+    int64_t sourceTime;
+    uint32_t vertexSize;
+    uint32_t hasTexCoords;
+    uint32_t texCoordFormat;
+    uint64_t vertexCount;
+    uint64_t indexCount;
+    uint32_t indexSize;
+    uint32_t materialCount;
+    uint64_t payloadBytes;
+    uint64_t checksum;
+};
+
+struct BinaryMeshMaterial
+{
+    float ambient[3];
+    float diffuse[3];
+    float specular[3];
+    float shininess;
+    char name[64];
+    char diffuseTexname[128];
+};
+
+std::string binaryMeshPath(const std::string& objPath)
+{
+    size_t dot = objPath.find_last_of('.');
+    size_t slash = objPath.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return objPath + ".mesh";
+    return objPath.substr(0, dot) + ".mesh";
+}
+
+static bool copyName(char* destination, size_t capacity, const std::string& name)
+{
+    if (name.size() >= capacity) return false;
+    std::memcpy(destination, name.c_str(), name.size() + 1);
+    return true;
+}
+
+static std::string storedName(const char* name, size_t capacity)
+{
+    return std::string(name, std::find(name, name + capacity, '\0'));
+}
+
+bool writeBinaryMesh(const std::string& path, const std::string& sourcePath, const MeshData& mesh)
+{
+    BinaryMeshHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, BINARY_MESH_MAGIC, sizeof(BINARY_MESH_MAGIC));
+    header.version = BINARY_MESH_VERSION;
+    getSourceStamp(sourcePath, header.sourceSize, header.sourceTime);
+    header.vertexSize = sizeof(PackedVertex);
+    header.hasTexCoords = mesh.hasTexCoords;
+    header.texCoordFormat = mesh.texCoordFormat;
+    header.vertexCount = mesh.packedVertices.size();
+    header.indexCount = mesh.indices.size();
+    header.materialCount = (uint32_t) mesh.materials.size();
+
+    std::vector<unsigned char> payload;
+    auto append = [&](const void* data, size_t bytes) {
+        const unsigned char* begin = (const unsigned char*) data;
+        payload.insert(payload.end(), begin, begin + bytes);
+    };
+
+    for (const tinyobj::material_t& material : mesh.materials) {
+        BinaryMeshMaterial stored;
+        std::memset(&stored, 0, sizeof(stored));
+        for (int k = 0; k < 3; k++) {
+            stored.ambient[k] = material.ambient[k];
+            stored.diffuse[k] = material.diffuse[k];
+            stored.specular[k] = material.specular[k];
+        }
+        stored.shininess = material.shininess;
+        if (!copyName(stored.name, sizeof(stored.name), material.name)
+            || !copyName(stored.diffuseTexname, sizeof(stored.diffuseTexname), material.diffuse_texname)) {
+            std::cerr << "Material name too long for a binary mesh: " << material.name << std::endl;
+            return false;
+        }
+        append(&stored, sizeof(stored));
+    }
+
+    append(mesh.packedVertices.data(), mesh.packedVertices.size() * sizeof(PackedVertex));
+
+    // Indices are stored in the type they are uploaded in
+    if (mesh.packedVertices.size() <= 65536) {
+        std::vector<uint16_t> shortIndices(mesh.indices.begin(), mesh.indices.end());
+        header.indexSize = sizeof(uint16_t);
+        append(shortIndices.data(), shortIndices.size() * sizeof(uint16_t));
+    } else {
+        header.indexSize = sizeof(uint32_t);
+        append(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+    }
+
+    header.payloadBytes = payload.size();
+    header.checksum = hashBytes(payload.data(), payload.size());
+    return writeAssetFile(path, &header, sizeof(header), payload);
+}
+
+bool openBinaryMesh(const std::string& path, const std::string& sourcePath, MappedFile& file,
+                    MeshView& view, std::vector<tinyobj::material_t>& materials)
+{
+    ArchiveBlob blob;
+    if (!findInArchive(path, blob)) {
+        if (!file.open(path)) return false;
+        blob.data = file.data();
+        blob.size = file.size();
+    }
+
+    BinaryMeshHeader header;
+    if (blob.size < sizeof(header)) {
+        std::cerr << path << " is truncated, loading the OBJ instead" << std::endl;
+        return false;
+    }
+    std::memcpy(&header, blob.data, sizeof(header));
+
+    if (std::memcmp(header.magic, BINARY_MESH_MAGIC, sizeof(BINARY_MESH_MAGIC)) != 0
+        || header.version != BINARY_MESH_VERSION || header.vertexSize != sizeof(PackedVertex)
+        || (header.texCoordFormat != TEXCOORD_UNORM16 && header.texCoordFormat != TEXCOORD_HALF)) {
+        std::cerr << path << " is from another version, loading the OBJ instead" << std::endl;
+        return false;
+    }
+
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if (getSourceStamp(sourcePath, sourceSize, sourceTime) && (sourceSize != header.sourceSize || sourceTime != header.sourceTime)) {
+        std::cerr << path << " is out of date, loading the OBJ instead" << std::endl;
+        return false;
+    }
+
+    uint64_t expectedBytes = header.materialCount * sizeof(BinaryMeshMaterial)
+                           + header.vertexCount * sizeof(PackedVertex)
+                           + header.indexCount * header.indexSize;
+    if ((header.indexSize != sizeof(uint16_t) && header.indexSize != sizeof(uint32_t))
+        || header.payloadBytes != expectedBytes || blob.size != sizeof(header) + header.payloadBytes) {
+        std::cerr << path << " is corrupt (bad sizes), loading the OBJ instead" << std::endl;
+        return false;
+    }
+
+    const unsigned char* payload = blob.data + sizeof(header);
+    if (!blob.verified && hashBytes(payload, (size_t) header.payloadBytes) != header.checksum) {
+        std::cerr << path << " is corrupt (checksum mismatch), loading the OBJ instead" << std::endl;
+        return false;
+    }
+
+    const BinaryMeshMaterial* stored = (const BinaryMeshMaterial*) payload;
+    materials.resize(header.materialCount);
+    for (uint32_t m = 0; m < header.materialCount; m++) {
+        initObjMaterial(&materials[m]);
+        for (int k = 0; k < 3; k++) {
+            materials[m].ambient[k] = stored[m].ambient[k];
+            materials[m].diffuse[k] = stored[m].diffuse[k];
+            materials[m].specular[k] = stored[m].specular[k];
+        }
+        materials[m].shininess = stored[m].shininess;
+        materials[m].name = storedName(stored[m].name, sizeof(stored[m].name));
+        materials[m].diffuse_texname = storedName(stored[m].diffuseTexname, sizeof(stored[m].diffuseTexname));
+    }
+
+    view.vertices = (const PackedVertex*) (stored + header.materialCount);
+    view.vertexCount = (size_t) header.vertexCount;
+    view.indices = view.vertices + view.vertexCount;
+    view.indexCount = (size_t) header.indexCount;
+    view.indexSize = header.indexSize;
+    view.hasTexCoords = header.hasTexCoords != 0;
+    view.texCoordFormat = (TexCoordFormat) header.texCoordFormat;
+    return true;
+}
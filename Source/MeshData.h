@@ -0,0 +1,107 @@
+#pragma once
+#include "MappedFile.h"
+#include "tiny_obj_loader.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// CPU side of the meshes loaded from OBJ files, without any OpenGL so the
+// offline tools can use it too. Model.h uploads it.
+
+// Full precision vertex of a parsed mesh, what MeshOptimizer works on. The
+// colours are in the material table, not in the vertices.
+struct MeshVertex
+{
+    float position[3];
+    float normal[3];
+    float texCoord[2];
+    uint32_t material;  // index into MeshData::materials
+};
+
+// Vertex of the binary mesh files and of the vertex buffer of loaded models,
+// 20 bytes against 72 for the floats of the colours and normals:
+// - normal: GL_INT_2_10_10_10_REV with the octahedral encoding of the normal
+//   in x and y (scaled to +-511) and the material index in z, shader.vert
+//   decodes both
+// - texCoord: unorm16 when all coordinates are in [0, 1], else half floats
+struct PackedVertex
+{
+    float position[3];
+    uint32_t normal;
+    uint16_t texCoord[2];
+};
+
+enum TexCoordFormat : uint32_t
+{
+    TEXCOORD_UNORM16,
+    TEXCOORD_HALF
+};
+
+// Largest material index a packed vertex can hold
+const uint32_t MAX_PACKED_MATERIAL = 511;
+
+// Bytes per material in the material table of the loaded models (Model.h)
+const size_t MATERIAL_TABLE_ENTRY_SIZE = 48;
+
+struct MeshData
+{
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> indices;     // 3 per triangle
+    std::vector<tinyobj::material_t> materials;
+    bool hasTexCoords = false;
+
+    // Filled by packMesh
+    std::vector<PackedVertex> packedVertices;
+    TexCoordFormat texCoordFormat = TEXCOORD_UNORM16;
+};
+
+// Vertices and indices of a mesh wherever they are stored (a MeshData, the
+// pages of a mapped binary mesh file)
+struct MeshView
+{
+    const PackedVertex* vertices = nullptr;
+    size_t vertexCount = 0;
+    const void* indices = nullptr;
+    size_t indexCount = 0;
+    size_t indexSize = sizeof(uint32_t);  // 2 or 4 bytes
+    bool hasTexCoords = false;
+    TexCoordFormat texCoordFormat = TEXCOORD_UNORM16;
+};
+
+// Octahedral normal and material index in the layout of PackedVertex::normal
+uint32_t packNormal(const float* normal, uint32_t material);
+
+// Quantises mesh.vertices into mesh.packedVertices, after the last change to
+// the vertices (MeshOptimizer.h). Picks the texture coordinate format.
+void packMesh(MeshData& mesh);
+
+// The packed vertices, packMesh has to be called first
+MeshView viewMesh(const MeshData& mesh);
+
+// Parses an OBJ file, its MTL files are looked up in 'matBaseDir'. Face
+// corners with the same position, normal, texture coordinate and material
+// share a vertex, the triangles are in 'indices'. Faces without a material
+// get the tinyobj default one, appended to the materials. False (with the
+// reason printed) when the file can not be read.
+bool loadObjMesh(const std::string& path, const std::string& matBaseDir, MeshData& mesh);
+
+// Binary mesh files (.mesh), written by MeshConverter next to the OBJ files:
+// a header, the material table, the packed vertices and the indices
+const uint32_t BINARY_MESH_VERSION = 5;
+
+// "Resources/mars.obj" -> "Resources/mars.mesh"
+std::string binaryMeshPath(const std::string& objPath);
+
+// 'sourcePath' is the OBJ the file was converted from, its size and
+// modification time are stored to detect files that are out of date. Writes
+// the packed vertices, so packMesh has to be called first.
+bool writeBinaryMesh(const std::string& path, const std::string& sourcePath, const MeshData& mesh);
+
+// Maps a binary mesh and validates it, from the mounted archive when it is
+// in there (ResourceArchive.h). The view points into the archive or 'file',
+// which has to stay open while it is used. False when the file is missing, older
+// than 'sourcePath' (when that exists), from another version or corrupt.
+bool openBinaryMesh(const std::string& path, const std::string& sourcePath, MappedFile& file,
+                    MeshView& view, std::vector<tinyobj::material_t>& materials);
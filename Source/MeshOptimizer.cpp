@@ -0,0 +1,258 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+// The caches below are simulated with timestamps: a vertex is in the FIFO as
+// long as fewer than 'cacheSize' vertices were added after it. Adding
+// cacheSize + 1 to the timestamp empties the cache.
+static bool isCached(const std::vector<unsigned>& cacheTime, unsigned timestamp, uint32_t vertex, unsigned cacheSize)
+{
+    return timestamp - cacheTime[vertex] <= cacheSize;
+}
+
+// Misses of one triangle, which is added to the cache
+static unsigned addTriangle(std::vector<unsigned>& cacheTime, unsigned& timestamp, const uint32_t* triangle, unsigned cacheSize)
+{
+    unsigned misses = 0;
+    for (int k = 0; k < 3; k++) {
+        if (!isCached(cacheTime, timestamp, triangle[k], cacheSize)) {
+            cacheTime[triangle[k]] = timestamp++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, unsigned cacheSize)
+{
+    VertexCacheStats stats;
+    std::vector<unsigned> cacheTime(vertexCount, 0);
+    unsigned timestamp = cacheSize + 1;
+    std::vector<bool> used(vertexCount, false);
+
+    size_t misses = 0, usedVertices = 0;
+    for (size_t i = 0; i + 2 < indexCount; i += 3) {
+        misses += addTriangle(cacheTime, timestamp, &indices[i], cacheSize);
+        for (int k = 0; k < 3; k++) {
+            if (!used[indices[i + k]]) {
+                used[indices[i + k]] = true;
+                usedVertices++;
+            }
+        }
+    }
+
+    if (indexCount >= 3) stats.acmr = (double) misses / (indexCount / 3);
+    if (usedVertices > 0) stats.atvr = (double) misses / usedVertices;
+    return stats;
+}
+
+void optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, unsigned cacheSize, std::vector<size_t>* clusters)
+{
+    size_t triangleCount = indexCount / 3;
+    if (clusters) clusters->clear();
+    if (triangleCount == 0) return;
+
+    // Triangles of every vertex, and how many of them are not emitted yet
+    std::vector<uint32_t> liveCount(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++) {
+        liveCount[indices[i]]++;
+    }
+    std::vector<size_t> firstTriangle(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++) {
+        firstTriangle[v + 1] = firstTriangle[v] + liveCount[v];
+    }
+    std::vector<uint32_t> triangles(triangleCount * 3);
+    std::vector<size_t> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; i++) {
+        triangles[filled[indices[i]]++] = (uint32_t) (i / 3);
+    }
+
+    std::vector<unsigned> cacheTime(vertexCount, 0);
+    unsigned timestamp = cacheSize + 1;
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnds;   // vertices of emitted triangles, most recent last
+    std::vector<uint32_t> candidates; // vertices of the triangles of the current fan
+    std::vector<uint32_t> result;
+    result.reserve(triangleCount * 3);
+
+    size_t cursor = 0;
+    long fanning = -1;
+    while (cursor < vertexCount && fanning < 0) {
+        if (liveCount[cursor] > 0) fanning = (long) cursor;
+        cursor++;
+    }
+
+    bool jumped = true;
+    while (fanning >= 0) {
+        if (jumped && clusters) clusters->push_back(result.size() / 3);
+
+        // Emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (size_t k = firstTriangle[fanning]; k < firstTriangle[fanning + 1]; k++) {
+            uint32_t t = triangles[k];
+            if (emitted[t]) continue;
+            emitted[t] = true;
+            for (int c = 0; c < 3; c++) {
+                uint32_t v = indices[3 * t + c];
+                result.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                liveCount[v]--;
+                if (!isCached(cacheTime, timestamp, v, cacheSize)) cacheTime[v] = timestamp++;
+            }
+        }
+
+        // Continue with the oldest vertex of the fan that will still be in the
+        // cache once all its triangles are emitted, else with any of them
+        long next = -1;
+        long bestPriority = -1;
+        for (uint32_t v : candidates) {
+            if (liveCount[v] == 0) continue;
+            long priority = 0;
+            if (timestamp - cacheTime[v] + 2 * liveCount[v] <= cacheSize) priority = timestamp - cacheTime[v];
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+
+        // Dead end: back to the most recent vertex with triangles left, or to
+        // the next unconnected part of the mesh
+        jumped = next < 0;
+        while (next < 0 && !deadEnds.empty()) {
+            uint32_t v = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveCount[v] > 0) next = v;
+        }
+        while (next < 0 && cursor < vertexCount) {
+            if (liveCount[cursor] > 0) next = (long) cursor;
+            cursor++;
+        }
+        fanning = next;
+    }
+
+    std::copy(result.begin(), result.end(), indices);
+}
+
+void optimizeOverdraw(uint32_t* indices, size_t indexCount, const MeshVertex* vertices, size_t vertexCount,
+                      const std::vector<size_t>& clusters, float threshold, unsigned cacheSize)
+{
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0 || clusters.empty()) return;
+
+    // Split the clusters wherever the part so far is within the threshold of
+    // the ACMR of the whole cluster, each part starting from an empty cache
+    std::vector<size_t> parts;
+    std::vector<unsigned> cacheTime(vertexCount, 0);
+    unsigned timestamp = cacheSize + 1;
+    for (size_t c = 0; c < clusters.size(); c++) {
+        size_t start = clusters[c];
+        size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+        timestamp += cacheSize + 1;
+        unsigned clusterMisses = 0;
+        for (size_t t = start; t < end; t++) {
+            clusterMisses += addTriangle(cacheTime, timestamp, &indices[3 * t], cacheSize);
+        }
+        float partThreshold = threshold * clusterMisses / (end - start);
+
+        timestamp += cacheSize + 1;
+        parts.push_back(start);
+        unsigned partMisses = 0, partSize = 0;
+        for (size_t t = start; t < end; t++) {
+            partMisses += addTriangle(cacheTime, timestamp, &indices[3 * t], cacheSize);
+            partSize++;
+            if (t + 1 < end && partMisses <= partThreshold * partSize) {
+                parts.push_back(t + 1);
+                timestamp += cacheSize + 1;
+                partMisses = partSize = 0;
+            }
+        }
+    }
+    parts.push_back(triangleCount);
+
+    // Area weighted centroid and normal of every part and of the mesh
+    auto cross = [](const float* a, const float* b, const float* c, float* n) {
+        float u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        n[0] = u[1] * v[2] - u[2] * v[1];
+        n[1] = u[2] * v[0] - u[0] * v[2];
+        n[2] = u[0] * v[1] - u[1] * v[0];
+    };
+
+    size_t partCount = parts.size() - 1;
+    std::vector<float> centroids(partCount * 3, 0.f), normals(partCount * 3, 0.f), areas(partCount, 0.f);
+    float meshCentroid[3] = { 0, 0, 0 };
+    float meshArea = 0;
+    for (size_t p = 0; p < partCount; p++) {
+        for (size_t t = parts[p]; t < parts[p + 1]; t++) {
+            const float* a = vertices[indices[3 * t + 0]].position;
+            const float* b = vertices[indices[3 * t + 1]].position;
+            const float* c = vertices[indices[3 * t + 2]].position;
+            float n[3];
+            cross(a, b, c, n);
+            float area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int k = 0; k < 3; k++) {
+                centroids[3 * p + k] += area * (a[k] + b[k] + c[k]) / 3;
+                normals[3 * p + k] += n[k];
+            }
+            areas[p] += area;
+        }
+        for (int k = 0; k < 3; k++) meshCentroid[k] += centroids[3 * p + k];
+        meshArea += areas[p];
+    }
+    for (int k = 0; k < 3; k++) meshCentroid[k] /= meshArea > 0 ? meshArea : 1;
+
+    // How far out a part lies along its own normal
+    std::vector<float> sortKeys(partCount, 0.f);
+    for (size_t p = 0; p < partCount; p++) {
+        float* n = &normals[3 * p];
+        float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (areas[p] <= 0 || length <= 0) continue;
+        for (int k = 0; k < 3; k++) {
+            sortKeys[p] += (centroids[3 * p + k] / areas[p] - meshCentroid[k]) * n[k] / length;
+        }
+    }
+
+    std::vector<size_t> order(partCount);
+    for (size_t p = 0; p < partCount; p++) order[p] = p;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<uint32_t> result;
+    result.reserve(triangleCount * 3);
+    for (size_t p : order) {
+        result.insert(result.end(), indices + 3 * parts[p], indices + 3 * parts[p + 1]);
+    }
+    std::copy(result.begin(), result.end(), indices);
+}
+
+void optimizeVertexFetch(MeshData& mesh, std::vector<uint32_t>* sourceVertices)
+{
+    const uint32_t unused = ~0u;
+    std::vector<uint32_t> remap(mesh.vertices.size(), unused);
+    std::vector<MeshVertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+    if (sourceVertices) sourceVertices->clear();
+
+    for (uint32_t& index : mesh.indices) {
+        if (remap[index] == unused) {
+            remap[index] = (uint32_t) vertices.size();
+            vertices.push_back(mesh.vertices[index]);
+            if (sourceVertices) sourceVertices->push_back(index);
+        }
+        index = remap[index];
+    }
+    mesh.vertices = std::move(vertices);
+}
+
+void optimizeMesh(MeshData& mesh, bool reduceOverdraw, std::vector<uint32_t>* sourceVertices)
+{
+    std::vector<size_t> clusters;
+    optimizeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size(), VERTEX_CACHE_SIZE,
+                        reduceOverdraw ? &clusters : nullptr);
+    if (reduceOverdraw) {
+        optimizeOverdraw(mesh.indices.data(), mesh.indices.size(), mesh.vertices.data(), mesh.vertices.size(), clusters);
+    }
+    optimizeVertexFetch(mesh, sourceVertices);
+}
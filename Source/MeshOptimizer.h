@@ -0,0 +1,52 @@
+#pragma once
+#include "MeshData.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Triangle and vertex reordering of indexed meshes, run by MeshConverter
+// (and on OBJ files loaded without a binary mesh) before the upload. Nothing
+// is added or removed, only the order changes.
+
+// Size of the simulated post-transform cache. A FIFO of 16 is the usual
+// middle ground: the results hold up on both smaller and larger caches.
+const unsigned VERTEX_CACHE_SIZE = 16;
+
+// Clusters whose ACMR may grow by this factor when they are split up to be
+// sorted for overdraw
+const float OVERDRAW_THRESHOLD = 1.05f;
+
+struct VertexCacheStats
+{
+    double acmr = 0;  // vertex shader runs per triangle, 0.5 at best for large meshes, 3 at worst
+    double atvr = 0;  // vertex shader runs per vertex, 1 at best
+};
+
+// Runs the indices through a FIFO cache of 'cacheSize' vertices
+VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount,
+                                    unsigned cacheSize = VERTEX_CACHE_SIZE);
+
+// Reorders the triangles for the post-transform cache with Tipsify (Sander,
+// Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced
+// Overdraw"). 'clusters' gets the first triangle of every run that started
+// after a jump to an unconnected part of the mesh.
+void optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount,
+                         unsigned cacheSize = VERTEX_CACHE_SIZE, std::vector<size_t>* clusters = nullptr);
+
+// Splits the clusters of optimizeVertexCache where that costs less than
+// 'threshold' in ACMR and sorts them so the ones facing away from the centre
+// of the mesh come first. Seen from outside, near surfaces are then mostly
+// drawn before the ones they hide.
+void optimizeOverdraw(uint32_t* indices, size_t indexCount, const MeshVertex* vertices, size_t vertexCount,
+                      const std::vector<size_t>& clusters, float threshold = OVERDRAW_THRESHOLD,
+                      unsigned cacheSize = VERTEX_CACHE_SIZE);
+
+// Renumbers the vertices in the order the triangles first use them, so the
+// vertex fetches walk the buffer forward. Unused vertices are dropped.
+// 'sourceVertices' gets the old index of every new vertex, for data kept
+// next to the mesh (the frames of a MorphAnimation).
+void optimizeVertexFetch(MeshData& mesh, std::vector<uint32_t>* sourceVertices = nullptr);
+
+// All three passes, overdraw only when 'reduceOverdraw' is set
+void optimizeMesh(MeshData& mesh, bool reduceOverdraw = true, std::vector<uint32_t>* sourceVertices = nullptr);
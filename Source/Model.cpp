@@ -1,8 +1,12 @@
 #include "Model.h"
-
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
-
+#include "MeshData.h"
+#include "MeshOptimizer.h"
+#include "TextureRegistry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
 #include <iostream>
 
 // For random number generators
@@ -15,459 +19,305 @@
 
 #include <noise/noise.h> // used for the Perlin noise generation
 
-Model loadModelWithMaterials(std::string path, std::string matBaseDir)
+// Creates the VAO of a loaded mesh with all vertices in one interleaved
+// buffer of PackedVertex. Models with materials get the attribute layout of
+// shader.vert, the others the one of shaderSkySphere.vert (texture
+// coordinates at 2).
+static void uploadMesh(Model& model, const MeshView& mesh, bool withMaterials)
 {
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    
-    std::string err;
-    
-    std::ifstream ifs(path.c_str());
-    
-    if (!ifs.is_open())
-    {
-        std::cerr << "Failed to find file: " << path << std::endl;
-        exit(1);
-    }
-    
-    
-    bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, path.c_str(), matBaseDir.c_str());
-    
-    if (!err.empty()) {
-        std::cerr << err << std::endl;
-    }
-    
-    if (!ret) {
-        std::cerr << "Failed to load object: " << path << std::endl;
-        exit(1);
-    }
-    
-    Model model;
-    
-    if (attrib.normals.size() == 0)
-    {
-        std::cerr << "Model does not have normal vectors, please re-export with normals." << std::endl;
+    glGenVertexArrays(1, &model.vao);
+    glBindVertexArray(model.vao);
+
+    glGenBuffers(1, &model.vbo);
+    model.buffers.push_back(model.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, model.vbo);
+    glBufferData(GL_ARRAY_BUFFER, mesh.vertexCount * sizeof(PackedVertex), mesh.vertices, GL_STATIC_DRAW);
+
+    auto attribute = [](GLuint location, GLint components, GLenum type, GLboolean normalized, size_t offset) {
+        glVertexAttribPointer(location, components, type, normalized, sizeof(PackedVertex), (const void*) offset);
+        glEnableVertexAttribArray(location);
+    };
+    attribute(0, 3, GL_FLOAT, GL_FALSE, offsetof(PackedVertex, position));
+    // Not normalised, shader.vert gets the octahedral coordinates and the material index as integers
+    attribute(1, 4, GL_INT_2_10_10_10_REV, GL_FALSE, offsetof(PackedVertex, normal));
+    if (mesh.hasTexCoords) {
+        bool unorm = mesh.texCoordFormat == TEXCOORD_UNORM16;
+        attribute(withMaterials ? 6 : 2, 2, unorm ? GL_UNSIGNED_SHORT : GL_HALF_FLOAT, unorm ? GL_TRUE : GL_FALSE,
+                  offsetof(PackedVertex, texCoord));
     }
-    
-    // Loop over shapes
-    for (size_t s = 0; s < shapes.size(); s++) {
-        // Loop over faces(polygon)
-        size_t index_offset = 0;
-        for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-            int fv = shapes[s].mesh.num_face_vertices[f];
-            
-            
-            tinyobj::material_t mat = materials[shapes[s].mesh.material_ids[f]];
-            
-            // Materials to set
-            
-            // Loop over vertices in the face.
-            for (size_t v = 0; v < fv; v++) {
-                // access to vertex
-                tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-                tinyobj::real_t vx = attrib.vertices[3 * idx.vertex_index + 0];
-                tinyobj::real_t vy = attrib.vertices[3 * idx.vertex_index + 1];
-                tinyobj::real_t vz = attrib.vertices[3 * idx.vertex_index + 2];
-                model.vertices.push_back(Vector3f(vx, vy, vz));
-                tinyobj::real_t nx = attrib.normals[3 * idx.normal_index + 0];
-                tinyobj::real_t ny = attrib.normals[3 * idx.normal_index + 1];
-                tinyobj::real_t nz = attrib.normals[3 * idx.normal_index + 2];
-                model.normals.push_back(Vector3f(nx, ny, nz));
-                
-                model.diffuseColors.push_back(Vector3f(mat.diffuse[0], mat.diffuse[1], mat.diffuse[2]));
-                model.ambientColors.push_back(Vector3f(mat.ambient[0], mat.ambient[1], mat.ambient[2]));
-                model.specularColors.push_back(Vector3f(mat.specular[0], mat.specular[1], mat.specular[2]));
-                model.shininessValues.push_back(20.f);//mat.shininess);
-                
-                if (attrib.texcoords.size() > 0 && idx.texcoord_index >= 0) {
-                    tinyobj::real_t tx = attrib.texcoords[2 * idx.texcoord_index + 0];
-                    tinyobj::real_t ty = attrib.texcoords[2 * idx.texcoord_index + 1];
-                    model.texCoords.push_back(Vector2f(tx, 1-ty));
-                }
-                
-                
-            }
-            index_offset += fv;
-            
-            
-        }
+
+    model.vertexCount = (GLsizei) mesh.vertexCount;
+    model.hasTexCoords = mesh.hasTexCoords;
+    model.packedVertices = true;
+
+    if (mesh.indexSize == sizeof(GLuint) && indexSize(mesh.vertexCount) == sizeof(GLushort)) {
+        const GLuint* indices = (const GLuint*) mesh.indices;
+        std::vector<GLushort> shortIndices(indices, indices + mesh.indexCount);
+        uploadIndices(model, shortIndices.data(), GL_UNSIGNED_SHORT, shortIndices.size());
+    } else if (mesh.indexCount > 0) {
+        uploadIndices(model, mesh.indices, mesh.indexSize == sizeof(GLushort) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, mesh.indexCount);
     }
-    
-    model.shapes = shapes;
-    model.materials = materials;
-    
-    glGenVertexArrays(1, &model.vao);
+}
+
+// Puts the deltas of all frames in one buffer next to the base mesh, the
+// attributes are set by setMorphFrames
+static void uploadMorph(Model& model, const MorphView& morph)
+{
     glBindVertexArray(model.vao);
-    
-    GLuint vbo;
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, model.vertices.size() * sizeof(Vector3f), model.vertices.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(0);
-    GLuint nbo;
-    glGenBuffers(1, &nbo);
-    glBindBuffer(GL_ARRAY_BUFFER, nbo);
-    glBufferData(GL_ARRAY_BUFFER, model.normals.size() * sizeof(Vector3f), model.normals.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(1);
-    GLuint diffuse_bo;
-    glGenBuffers(1, &diffuse_bo);
-    glBindBuffer(GL_ARRAY_BUFFER, diffuse_bo);
-    glBufferData(GL_ARRAY_BUFFER, model.diffuseColors.size() * sizeof(Vector3f), model.diffuseColors.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(2);
-    GLuint ambient_bo;
-    glGenBuffers(1, &ambient_bo);
-    glBindBuffer(GL_ARRAY_BUFFER, ambient_bo);
-    glBufferData(GL_ARRAY_BUFFER, model.ambientColors.size() * sizeof(Vector3f), model.ambientColors.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(3);
-    GLuint specular_bo;
-    glGenBuffers(1, &specular_bo);
-    glBindBuffer(GL_ARRAY_BUFFER, specular_bo);
-    glBufferData(GL_ARRAY_BUFFER, model.specularColors.size() * sizeof(Vector3f), model.specularColors.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(4);
-    GLuint shininess_bo;
-    glGenBuffers(1, &shininess_bo);
-    glBindBuffer(GL_ARRAY_BUFFER, shininess_bo);
-    glBufferData(GL_ARRAY_BUFFER, model.shininessValues.size() * sizeof(Vector3f), model.shininessValues.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(5);
-    
-    
-    if (model.texCoords.size() > 0)
-    {
-        GLuint tbo;
-        glGenBuffers(1, &tbo);
-        glBindBuffer(GL_ARRAY_BUFFER, tbo);
-        glBufferData(GL_ARRAY_BUFFER, model.texCoords.size() * sizeof(Vector2f), model.texCoords.data(), GL_STATIC_DRAW);
-        glVertexAttribPointer(6, 2, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(6);
+    glGenBuffers(1, &model.morphBuffer);
+    model.buffers.push_back(model.morphBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, model.morphBuffer);
+    glBufferData(GL_ARRAY_BUFFER, morph.frameCount * morph.vertexCount * sizeof(MorphDelta), morph.deltas, GL_STATIC_DRAW);
+
+    for (GLuint location = 7; location <= 10; location++) {
+        glEnableVertexAttribArray(location);
     }
-    
-    return model;
+    model.morphFrames = (GLsizei) morph.frameCount;
+    model.morphScale = morph.deltaScale;
+    setMorphFrames(model, 0, 0);
 }
 
-Model loadModel(std::string path)
+void setMorphFrames(const Model& model, int frameA, int frameB)
 {
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
+    if (model.morphBuffer == 0) return;
+    glBindVertexArray(model.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, model.morphBuffer);
+
+    int frames[2] = { frameA, frameB };
+    for (int k = 0; k < 2; k++) {
+        int frame = std::min(std::max(frames[k], 0), model.morphFrames - 1);
+        size_t offset = (size_t) frame * model.vertexCount * sizeof(MorphDelta);
+        // Not normalised, shader.vert scales the offsets by morphScale
+        glVertexAttribPointer(7 + 2 * k, 3, GL_SHORT, GL_FALSE, sizeof(MorphDelta), (const void*) (offset + offsetof(MorphDelta, position)));
+        glVertexAttribPointer(8 + 2 * k, 4, GL_INT_2_10_10_10_REV, GL_FALSE, sizeof(MorphDelta), (const void*) (offset + offsetof(MorphDelta, normal)));
+    }
+}
 
-    std::string err;
+// One material of the table in the std140 layout of shader.frag: the vec3s
+// take 16 bytes each, except for the last one which shares its slot with
+// the shininess
+struct TableMaterial
+{
+    float diffuseColor[3];
+    float padding0;
+    float ambientColor[3];
+    float padding1;
+    float specularColor[3];
+    float shininess;
+};
+
+static_assert(sizeof(TableMaterial) == MATERIAL_TABLE_ENTRY_SIZE, "TableMaterial has the std140 layout");
+
+static std::vector<TableMaterial> materialTable;
+static GLuint materialTableBuffer = 0;
+
+// Adds the materials of a model to the table, or finds the same run of
+// materials added by an earlier model, and returns where they start
+static GLint addToMaterialTable(const std::string& path, const std::vector<tinyobj::material_t>& materials, size_t vertexCount)
+{
+    std::vector<TableMaterial> entries(materials.size());
+    for (size_t m = 0; m < materials.size(); m++) {
+        TableMaterial& entry = entries[m];
+        std::memset(&entry, 0, sizeof(entry));
+        for (int k = 0; k < 3; k++) {
+            entry.diffuseColor[k] = materials[m].diffuse[k];
+            entry.ambientColor[k] = materials[m].ambient[k];
+            entry.specularColor[k] = materials[m].specular[k];
+        }
+        entry.shininess = 20.f;//materials[m].shininess;
+    }
+    if (entries.empty()) return 0;
 
-    std::ifstream ifs(path.c_str());
+    // Against the colours and shininess in every vertex
+    size_t perVertexBytes = vertexCount * (3 * sizeof(Vector3f) + sizeof(float));
+    size_t bytes = entries.size() * sizeof(TableMaterial);
 
-    if (!ifs.is_open())
-    {
-        std::cerr << "Failed to find file: " << path << std::endl;
-        exit(1);
+    for (size_t base = 0; base + entries.size() <= materialTable.size(); base++) {
+        if (std::memcmp(&materialTable[base], entries.data(), bytes) == 0) {
+            std::cout << path << ": " << entries.size() << " materials shared in the material table instead of "
+                      << perVertexBytes / 1024 << " KB of per-vertex colours" << std::endl;
+            return (GLint) base;
+        }
     }
 
-    bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, path.c_str(), "Resources/");
-	
-    if (!err.empty()) {
-        std::cerr << err << std::endl;
+    if (materialTable.size() + entries.size() > MAX_TABLE_MATERIALS) {
+        std::cerr << "The material table is full, " << path << " gets the colours of other models" << std::endl;
+        return 0;
     }
 
-    if (!ret) {
-        std::cerr << "Failed to load object: " << path << std::endl;
-        exit(1);
+    if (materialTableBuffer == 0) {
+        glGenBuffers(1, &materialTableBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, materialTableBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, MAX_TABLE_MATERIALS * sizeof(TableMaterial), nullptr, GL_STATIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_TABLE_BINDING, materialTableBuffer);
     }
-    
-    Model model;
 
-    if (attrib.normals.size() == 0)
-    {
-        std::cerr << "Model does not have normal vectors, please re-export with normals." << std::endl;
+    GLint base = (GLint) materialTable.size();
+    glBindBuffer(GL_UNIFORM_BUFFER, materialTableBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, base * sizeof(TableMaterial), bytes, entries.data());
+    materialTable.insert(materialTable.end(), entries.begin(), entries.end());
+
+    std::cout << path << ": " << entries.size() << " materials in the material table (" << bytes << " bytes) instead of "
+              << perVertexBytes / 1024 << " KB of per-vertex colours" << std::endl;
+    return base;
+}
+
+void connectMaterialTable()
+{
+    GLint program = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+    GLuint block = glGetUniformBlockIndex((GLuint) program, "MaterialTable");
+    if (block != GL_INVALID_INDEX) {
+        glUniformBlockBinding((GLuint) program, block, MATERIAL_TABLE_BINDING);
     }
+}
 
-    // Loop over shapes
-    for (size_t s = 0; s < shapes.size(); s++) {
-        // Loop over faces(polygon)
-        size_t index_offset = 0;
-        for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-            int fv = shapes[s].mesh.num_face_vertices[f];
-
-            // Loop over vertices in the face.
-            for (size_t v = 0; v < fv; v++) {
-                // access to vertex
-                tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-                tinyobj::real_t vx = attrib.vertices[3 * idx.vertex_index + 0];
-                tinyobj::real_t vy = attrib.vertices[3 * idx.vertex_index + 1];
-                tinyobj::real_t vz = attrib.vertices[3 * idx.vertex_index + 2];
-                model.vertices.push_back(Vector3f(vx, vy, vz));
-                tinyobj::real_t nx = attrib.normals[3 * idx.normal_index + 0];
-                tinyobj::real_t ny = attrib.normals[3 * idx.normal_index + 1];
-                tinyobj::real_t nz = attrib.normals[3 * idx.normal_index + 2];
-                model.normals.push_back(Vector3f(nx, ny, nz));
-
-                if (attrib.texcoords.size() > 0 && idx.texcoord_index >= 0) {
-                    tinyobj::real_t tx = attrib.texcoords[2 * idx.texcoord_index + 0];
-                    tinyobj::real_t ty = attrib.texcoords[2 * idx.texcoord_index + 1];
-                    model.texCoords.push_back(Vector2f(tx, 1-ty));
-                }
-                
-            }
-            index_offset += fv;
-
-            // per-face material
-            shapes[s].mesh.material_ids[f];
-        }
+// Maps the converted binary mesh of 'path' when there is an up to date one,
+// otherwise parses the OBJ
+bool readModelFile(const std::string& path, const std::string& matBaseDir, bool withMaterials, ModelFile& file)
+{
+    file.path = path;
+    file.withMaterials = withMaterials;
+    if (openBinaryMesh(binaryMeshPath(path), path, file.binary, file.view, file.materials)) {
+        return true;
     }
 
-	model.shapes = shapes;
-	model.materials = materials;
+    if (!loadObjMesh(path, matBaseDir, file.mesh)) {
+        return false;
+    }
+    optimizeMesh(file.mesh);
+    packMesh(file.mesh);
+    file.view = viewMesh(file.mesh);
+    file.materials = std::move(file.mesh.materials);
+    return true;
+}
 
-    glGenVertexArrays(1, &model.vao);
-    glBindVertexArray(model.vao);
+// Maps the converted base mesh and deltas when they are up to date, otherwise
+// parses and matches all frames
+bool readMorphFile(const std::string& animationPath, const std::vector<std::string>& framePaths,
+                   const std::string& matBaseDir, ModelFile& file)
+{
+    file.path = animationPath;
+    file.withMaterials = true;
+    if (openMorph(animationPath, framePaths, file.binary, file.view, file.materials, file.morphBinary, file.morphView)) {
+        return true;
+    }
 
-    GLuint vbo;
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, model.vertices.size() * sizeof(Vector3f), model.vertices.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(0);
-    GLuint nbo;
-    glGenBuffers(1, &nbo);
-    glBindBuffer(GL_ARRAY_BUFFER, nbo);
-    glBufferData(GL_ARRAY_BUFFER, model.normals.size() * sizeof(Vector3f), model.normals.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(1);
-    if (model.texCoords.size() > 0)
-    {
-        GLuint tbo;
-        glGenBuffers(1, &tbo);
-        glBindBuffer(GL_ARRAY_BUFFER, tbo);
-        glBufferData(GL_ARRAY_BUFFER, model.texCoords.size() * sizeof(Vector2f), model.texCoords.data(), GL_STATIC_DRAW);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(2);
+    if (!loadObjMorph(framePaths, matBaseDir, file.morph)) {
+        return false;
     }
+    file.view = viewMesh(file.morph.base);
+    file.morphView = viewMorph(file.morph);
+    file.materials = std::move(file.morph.base.materials);
+    return true;
+}
 
+// Uploads the vertices straight from the mapped pages or the converted OBJ
+Model uploadModelFile(ModelFile& file)
+{
+    Model model;
+    uploadMesh(model, file.view, file.withMaterials);
+    for (size_t v = 0; v < file.view.vertexCount; v++) {
+        const float* p = file.view.vertices[v].position;
+        model.radius = std::max(model.radius, std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]));
+    }
+    model.materials = std::move(file.materials);
+    if (model.hasTexCoords && !model.materials.empty()) model.texture = registerTexture(model.materials[0].diffuse_texname);
+    if (file.withMaterials) model.materialBase = addToMaterialTable(file.path, model.materials, file.view.vertexCount);
+    if (file.morphView.frameCount > 0) {
+        uploadMorph(model, file.morphView);
+        size_t indexBytes = file.view.indexCount * indexSize(file.view.vertexCount);
+        std::cout << file.path << ": " << file.morphView.frameCount << " frames as morph targets, "
+                  << (file.view.vertexCount * sizeof(PackedVertex) + indexBytes) / 1024 << " KB base mesh and "
+                  << file.morphView.frameCount * file.morphView.vertexCount * sizeof(MorphDelta) / 1024 << " KB of deltas" << std::endl;
+    }
     return model;
 }
 
-
-
-float getNoiseValue(noise::module::Perlin perlinGenerator, float posX, float posZ, bool isWater){
-    float elevation;
-    if (!isWater) {
-        elevation = 1 * perlinGenerator.GetValue(1 * posX, 0, 1 * posZ)
-        + 0.5 * perlinGenerator.GetValue(2 * posX, 0, 2 * posZ)
-        + 0.25 * perlinGenerator.GetValue(4 * posX, 0, 4 * posZ);
-        elevation = pow(elevation, 3);
-    } else {
-        elevation = 1 * perlinGenerator.GetValue(6 * posX, 0, 6 * posZ);
+static Model loadMeshModel(const std::string& path, const std::string& matBaseDir, bool withMaterials)
+{
+    ModelFile file;
+    if (!readModelFile(path, matBaseDir, withMaterials, file)) {
+        exit(1);
     }
-    return elevation;
+    return uploadModelFile(file);
 }
 
-float getHeightMapPoint(Vector3f point, noise::module::Perlin perlinGenerator, float perlinSize, float scale, float heightMult){
-    float adjX = ((point.x + (scale/2))/scale)*perlinSize;
-    float adjZ = ((point.z + (scale/2))/scale)*perlinSize;
-    float value = getNoiseValue(perlinGenerator, adjX, adjZ, false);
-    return heightMult * value;
+Model loadModelWithMaterials(std::string path, std::string matBaseDir)
+{
+    return loadMeshModel(path, matBaseDir, true);
+}
+
+Model loadModel(std::string path)
+{
+    return loadMeshModel(path, "Resources/", false);
 }
 
 
-Vector3f WATER = Vector3f(0.2f, 0.6f, 1.f) * 0.5;
-Vector3f BEACH = Vector3f(1.f, 0.8f, 0.4f) * 0.5;
-Vector3f FOREST = Vector3f(0.f, 0.2f, 0.f) * 0.5;
-Vector3f JUNGLE = Vector3f(0.2f, 0.8f, 0.2f) * 0.5;
-Vector3f SAVANNAH = Vector3f(1.f, 0.8f, 0.f) * 0.5;
-Vector3f DESERT = Vector3f(1.f, 0.4f, 0.f) * 0.5;
-Vector3f SNOW = Vector3f(1.f, 1.f, 1.f) * 0.5;
-
-Vector3f getColor(float e, bool isWater){
-    if (!isWater){
-        if (e < 0.1) return WATER;
-        else if (e < 0.2) return BEACH;
-        else if (e < 0.3) return FOREST;
-        else if (e < 0.5) return JUNGLE;
-        else if (e < 0.7) return SAVANNAH;
-        else if (e < 0.9) return DESERT;
-        else return SNOW;
+
+// Largest vertex count that can still be addressed with 16-bit indices
+const size_t MAX_SHORT_INDEXED_VERTICES = 65536;
+
+size_t indexSize(size_t vertexCount)
+{
+    return vertexCount <= MAX_SHORT_INDEXED_VERTICES ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+// Uploads model.indices into an element buffer of the model's VAO, narrowed to
+// 16-bit indices when every vertex fits
+void uploadIndices(Model& model)
+{
+    if (indexSize(model.vertices.size()) == sizeof(GLushort)) {
+        std::vector<GLushort> shortIndices(model.indices.begin(), model.indices.end());
+        uploadIndices(model, shortIndices.data(), GL_UNSIGNED_SHORT, shortIndices.size());
     } else {
-        return WATER;
+        uploadIndices(model, model.indices.data(), GL_UNSIGNED_INT, model.indices.size());
     }
 }
 
-void updateMapValues(Model& model){
-    std::vector<Vector3f> updatedVertices;
-    for (std::vector<Vector3f>::iterator it = model.vertices.begin() ; it != model.vertices.end(); ++it){
-        Vector3f vertex = *it;
-        vertex.y = vertex.y ;//+ 0.005;
-        updatedVertices.push_back(vertex);
-    }
-    model.vertices = updatedVertices;
-    
+// Creates the element buffer from indices already in their GPU type
+void uploadIndices(Model& model, const void* indices, GLenum indexType, size_t indexCount)
+{
+    model.indexCount = (GLsizei) indexCount;
+    model.indexType = indexType;
+
     glBindVertexArray(model.vao);
-    glBindBuffer(GL_ARRAY_BUFFER, model.vbo);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, model.vertices.size() * sizeof(Vector3f), model.vertices.data());
-    
+    glGenBuffers(1, &model.ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.ebo);
+    size_t bytes = indexCount * (indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint));
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, bytes, indices, GL_STATIC_DRAW);
 }
 
+// Issues the draw call for the model's VAO, indexed if it has an element
+// buffer. Models still being loaded have no VAO and are skipped.
+void drawGeometry(const Model& model)
+{
+    if (model.vao == 0) return;
+    glBindVertexArray(model.vao);
+    if (model.indexCount > 0) {
+        glDrawElements(GL_TRIANGLES, model.indexCount, model.indexType, 0);
+    } else {
+        glDrawArrays(GL_TRIANGLES, 0, model.vertices.empty() ? model.vertexCount : (GLsizei) model.vertices.size());
+    }
+}
 
-// Makes map
-// Resolution refers to the number of squares (x2 number of triangles) per side
-// Maps is always generated as a square of size 1
-Model makeTerrain(noise::module::Perlin perlinGenerator, float perlinSize, int resolution, float heightMult, float scale, bool isWater)
+// Frees the GPU objects of a model, only the ones registered in model.buffers
+// and the element buffer are known
+void destroyModel(Model& model)
 {
-    
-    Model model;
-    
-    float sampling_offset = (float) perlinSize/resolution;
-    float terrain_offset = (float) scale/resolution;
-    
-    for (int i = 0; i < resolution; i++) {
-        for (int j = 0; j < resolution; j++) {
-            
-            float s1x = i * sampling_offset;
-            float s2x = ((i + 1) * sampling_offset);
-            float s1z = j * sampling_offset;
-            float s2z = ((j + 1) * sampling_offset);
-            
-            float pos1x = i * terrain_offset - (scale/2);
-            float pos2x = ((i + 1) * terrain_offset) - (scale/2);
-            float pos1z = j * terrain_offset - (scale/2);
-            float pos2z = ((j + 1) * terrain_offset) - (scale/2);
-            
-            float perlin11 = getNoiseValue(perlinGenerator, s1x, s1z, isWater);
-            Vector3f color11 = getColor(perlin11, isWater);
-            Vector3f point11 = Vector3f(pos1x, heightMult * perlin11, pos1z);
-            
-            float perlin12 = getNoiseValue(perlinGenerator, s1x, s2z, isWater);
-            Vector3f color12 = getColor(perlin12, isWater);
-            Vector3f point12 = Vector3f(pos1x, heightMult * perlin12, pos2z);
-            
-            float perlin21 = getNoiseValue(perlinGenerator, s2x, s1z, isWater);
-            Vector3f color21 = getColor(perlin21, isWater);
-            Vector3f point21 = Vector3f(pos2x, heightMult * perlin21, pos1z);
-            
-            float perlin22 = getNoiseValue(perlinGenerator, s2x, s2z, isWater);
-            Vector3f color22 = getColor(perlin22, isWater);
-            Vector3f point22 = Vector3f(pos2x, heightMult * perlin22, pos2z);
-            
-            Vector3f P, Q;
-            Vector3f normalVec;
-            
-            /*** First triangle ***/
-            model.vertices.push_back(point11);
-            model.vertices.push_back(point21);
-            model.vertices.push_back(point22);
-            
-            P = point21 - point11;
-            Q = point22 - point21;
-            
-            normalVec = -cross(P, Q);
-            
-            model.normals.push_back(normalVec);
-            model.normals.push_back(normalVec);
-            model.normals.push_back(normalVec);
-            
-            model.diffuseColors.push_back(color11);
-            model.diffuseColors.push_back(color21);
-            model.diffuseColors.push_back(color22);
-            
-            model.ambientColors.push_back(Vector3f(1.f, 1.f, 1.f));
-            model.ambientColors.push_back(Vector3f(1.f, 1.f, 1.f));
-            model.ambientColors.push_back(Vector3f(1.f, 1.f, 1.f));
-            
-            model.specularColors.push_back(Vector3f(0.5f, 0.5f, 0.5f));
-            model.specularColors.push_back(Vector3f(0.5f, 0.5f, 0.5f));
-            model.specularColors.push_back(Vector3f(0.5f, 0.5f, 0.5f));
-            
-            model.shininessValues.push_back(20.f);
-            model.shininessValues.push_back(20.f);
-            model.shininessValues.push_back(20.f);
-            
-            /*** Second triangle ***/
-            model.vertices.push_back(point11);
-            model.vertices.push_back(point22);
-            model.vertices.push_back(point12);
-            
-            P = point12 - point22;
-            Q = point11 - point12;
-            
-            normalVec = -cross(P, Q);
-            
-            model.normals.push_back(normalVec);
-            model.normals.push_back(normalVec);
-            model.normals.push_back(normalVec);
-            
-            model.diffuseColors.push_back(color11);
-            model.diffuseColors.push_back(color22);
-            model.diffuseColors.push_back(color12);
-            
-            model.ambientColors.push_back(Vector3f(1.f, 1.f, 1.f));
-            model.ambientColors.push_back(Vector3f(1.f, 1.f, 1.f));
-            model.ambientColors.push_back(Vector3f(1.f, 1.f, 1.f));
-            
-            model.specularColors.push_back(Vector3f(0.5f, 0.5f, 0.5f));
-            model.specularColors.push_back(Vector3f(0.5f, 0.5f, 0.5f));
-            model.specularColors.push_back(Vector3f(0.5f, 0.5f, 0.5f));
-            
-            model.shininessValues.push_back(20.f);
-            model.shininessValues.push_back(20.f);
-            model.shininessValues.push_back(20.f);
-        }
+    if (!model.buffers.empty()) {
+        glDeleteBuffers((GLsizei) model.buffers.size(), model.buffers.data());
+        model.buffers.clear();
     }
-    
-    glGenVertexArrays(1, &model.vao);
-    glBindVertexArray(model.vao);
-    
-    glGenBuffers(1, &model.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, model.vbo);
-    glBufferData(GL_ARRAY_BUFFER, model.vertices.size() * sizeof(Vector3f), model.vertices.data(), GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(0);
-    
-    glGenBuffers(1, &model.nbo);
-    glBindBuffer(GL_ARRAY_BUFFER, model.nbo);
-    glBufferData(GL_ARRAY_BUFFER, model.normals.size() * sizeof(Vector3f), model.normals.data(), GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(1);
-    
-    GLuint diffuse_bo;
-    glGenBuffers(1, &diffuse_bo);
-    glBindBuffer(GL_ARRAY_BUFFER, diffuse_bo);
-    glBufferData(GL_ARRAY_BUFFER, model.diffuseColors.size() * sizeof(Vector3f), model.diffuseColors.data(), GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(2);
-    GLuint ambient_bo;
-    glGenBuffers(1, &ambient_bo);
-    glBindBuffer(GL_ARRAY_BUFFER, ambient_bo);
-    glBufferData(GL_ARRAY_BUFFER, model.ambientColors.size() * sizeof(Vector3f), model.ambientColors.data(), GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(3);
-    GLuint specular_bo;
-    glGenBuffers(1, &specular_bo);
-    glBindBuffer(GL_ARRAY_BUFFER, specular_bo);
-    glBufferData(GL_ARRAY_BUFFER, model.specularColors.size() * sizeof(Vector3f), model.specularColors.data(), GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(4);
-    GLuint shininess_bo;
-    glGenBuffers(1, &shininess_bo);
-    glBindBuffer(GL_ARRAY_BUFFER, shininess_bo);
-    glBufferData(GL_ARRAY_BUFFER, model.shininessValues.size() * sizeof(Vector3f), model.shininessValues.data(), GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(5);
-    
-    
-    if (model.texCoords.size() > 0)
-    {
-        GLuint tbo;
-        glGenBuffers(1, &tbo);
-        glBindBuffer(GL_ARRAY_BUFFER, tbo);
-        glBufferData(GL_ARRAY_BUFFER, model.texCoords.size() * sizeof(Vector2f), model.texCoords.data(), GL_DYNAMIC_DRAW);
-        glVertexAttribPointer(6, 2, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(6);
+    if (model.ebo != 0) {
+        glDeleteBuffers(1, &model.ebo);
+        model.ebo = 0;
     }
-    
-    return model;
+    glDeleteVertexArrays(1, &model.vao);
+    model.vao = 0;
+    model.indexCount = 0;
+    model.morphBuffer = 0;
+    model.morphFrames = 0;
 }
 
 
@@ -575,6 +425,7 @@ Model makeQuad(){
     model.texCoords.push_back(Vector2f(0.0f, 1.0f));
     model.texCoords.push_back(Vector2f(1.0f, 0.0f));
     model.texCoords.push_back(Vector2f(1.0f, 1.0f));
+    model.hasTexCoords = true;
     
     
     glGenVertexArrays(1, &model.vao);
@@ -2,6 +2,9 @@
 	#pragma comment(lib, "libnoise.lib")
 #endif
 #pragma once
+#include "MeshData.h"
+#include "MappedFile.h"
+#include "MorphAnimation.h"
 #include "tiny_obj_loader.h"
 
 
@@ -26,18 +29,78 @@ public:
     std::vector<float> shininessValues;
     GLuint vbo;
     GLuint nbo;
+    std::vector<GLuint> buffers; // attribute buffers to free with the model
+
+    // Element buffer, only used when the model is indexed (indexCount > 0)
+    std::vector<GLuint> indices;
+    GLuint ebo = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    GLsizei indexCount = 0;
     
-	std::vector<tinyobj::shape_t> shapes;
+    // Loaded models keep their vertices on the GPU only, as PackedVertex
+    // (MeshData.h). Their materials are at materialBase in the material table.
+    GLsizei vertexCount = 0;
+    bool hasTexCoords = false;
+    bool packedVertices = false;
+    GLint materialBase = 0;
+    float radius = 0;  // of the bounding sphere around the object space origin
+    int texture = -1;  // diffuse texture of the first material in the TextureRegistry, -1 without
+
+    // Morph animations (MorphAnimation.h): the deltas of all frames, two of
+    // them are bound at a time by setMorphFrames
+    GLuint morphBuffer = 0;
+    GLsizei morphFrames = 0;
+    float morphScale = 1;
+
 	std::vector<tinyobj::material_t> materials;
 
-    GLuint vao;
+    GLuint vao = 0;
 };
 
+// The materials of all models loaded with materials are stored once, in a
+// uniform buffer read by the MaterialTable block of shader.frag. Models with
+// the same materials share them. The size matches the array of the block.
+const size_t MAX_TABLE_MATERIALS = 256;
+const GLuint MATERIAL_TABLE_BINDING = 0;
+
+// Points the MaterialTable block of the program in use at the table
+void connectMaterialTable();
+
 Model loadModel(std::string path);
 Model loadModelWithMaterials(std::string path, std::string matBaseDir);
-Model makeTerrain(noise::module::Perlin perlinGenerator, float perlinSize, int resolution, float heightMult, float scale, bool isWater);
-void updateMapValues(Model& model);
-float getHeightMapPoint(Vector3f point, noise::module::Perlin perlinGenerator, float perlinSize, float scale, float heightMult);
+
+// The two halves of loadModel(WithMaterials), for loading on worker threads:
+// readModelFile does the file work and runs on any thread, uploadModelFile
+// the GL work on the main thread
+struct ModelFile
+{
+    std::string path;
+    bool withMaterials = false;
+    MappedFile binary;  // pages of the binary mesh, when there is one
+    MeshData mesh;      // the converted OBJ otherwise
+    MeshView view;      // into one of the two
+    std::vector<tinyobj::material_t> materials;
+
+    // Morph animations only
+    MappedFile morphBinary;
+    MorphAnimation morph;
+    MorphView morphView;
+};
+
+bool readModelFile(const std::string& path, const std::string& matBaseDir, bool withMaterials, ModelFile& file);
+
+// The same for a morph animation and its frames, always with materials
+bool readMorphFile(const std::string& animationPath, const std::vector<std::string>& framePaths,
+                   const std::string& matBaseDir, ModelFile& file);
+Model uploadModelFile(ModelFile& file);
+
+// Points the morph attributes of shader.vert (7 to 10) at the deltas of two
+// frames, blended by the morphWeight uniform
+void setMorphFrames(const Model& model, int frameA, int frameB);
 Model loadCube();
 Model makeQuad();
-Vector3f getColor(float height);
+void uploadIndices(Model& model);
+void uploadIndices(Model& model, const void* indices, GLenum indexType, size_t indexCount);
+size_t indexSize(size_t vertexCount);
+void drawGeometry(const Model& model);
+void destroyModel(Model& model);
@@ -0,0 +1,71 @@
+#include "ModelCache.h"
+
+#include <iostream>
+#include <unordered_map>
+
+struct ModelCache
+{
+    std::unordered_map<std::string, std::weak_ptr<const Model>> models;
+    ModelCacheStats stats;
+};
+
+// Never destroyed: handles held by static objects may still be released
+// after the other statics are gone
+static ModelCache& modelCache()
+{
+    static ModelCache* cache = new ModelCache();
+    return *cache;
+}
+
+static ModelHandle acquire(const std::string& path, const std::string& matBaseDir, bool withMaterials)
+{
+    ModelCache& cache = modelCache();
+    std::string key = path + (withMaterials ? "|materials|" + matBaseDir : "|plain");
+
+    auto found = cache.models.find(key);
+    if (found != cache.models.end()) {
+        if (ModelHandle model = found->second.lock()) {
+            cache.stats.shared++;
+            return model;
+        }
+    }
+
+    Model* model = new Model(withMaterials ? loadModelWithMaterials(path, matBaseDir) : loadModel(path));
+    ModelHandle handle(model, [key](const Model* released) {
+        ModelCache& cache = modelCache();
+        auto entry = cache.models.find(key);
+        if (entry != cache.models.end() && entry->second.expired()) cache.models.erase(entry);
+        cache.stats.resident--;
+
+        Model* owned = const_cast<Model*>(released);
+        destroyModel(*owned);
+        delete owned;
+    });
+
+    cache.models[key] = handle;
+    cache.stats.loads++;
+    cache.stats.resident++;
+    return handle;
+}
+
+ModelHandle acquireModel(const std::string& path)
+{
+    return acquire(path, "", false);
+}
+
+ModelHandle acquireModelWithMaterials(const std::string& path, const std::string& matBaseDir)
+{
+    return acquire(path, matBaseDir, true);
+}
+
+ModelCacheStats getModelCacheStats()
+{
+    return modelCache().stats;
+}
+
+void printModelCacheStats()
+{
+    ModelCacheStats stats = getModelCacheStats();
+    std::cout << "Model cache: " << stats.loads << " loads, " << stats.shared << " shared, "
+              << stats.resident << " models resident" << std::endl;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "Model.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// Models shared by everything that draws the same file: loading a path with
+// the same options again returns the model that is already on the GPU. The
+// cache only holds weak references, the model (buffers and materials) is
+// destroyed with its last handle, so handles have to be released on the GL
+// thread.
+typedef std::shared_ptr<const Model> ModelHandle;
+
+// loadModel and loadModelWithMaterials through the cache
+ModelHandle acquireModel(const std::string& path);
+ModelHandle acquireModelWithMaterials(const std::string& path, const std::string& matBaseDir);
+
+struct ModelCacheStats
+{
+    size_t loads = 0;     // files loaded
+    size_t shared = 0;    // acquires answered with a resident model
+    size_t resident = 0;  // models alive right now
+};
+
+ModelCacheStats getModelCacheStats();
+void printModelCacheStats();
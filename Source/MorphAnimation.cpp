@@ -0,0 +1,306 @@
+#include "MorphAnimation.h"
+#include "Hash.h"
+#include "MeshOptimizer.h"
+#include "ResourceArchive.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+
+static_assert(sizeof(MorphDelta) == 12, "MorphDelta is stored without padding");
+
+MorphView viewMorph(const MorphAnimation& animation)
+{
+    MorphView view;
+    view.deltas = animation.deltas.data();
+    view.vertexCount = animation.base.packedVertices.size();
+    view.frameCount = animation.frameCount;
+    view.deltaScale = animation.deltaScale;
+    return view;
+}
+
+// Centroid of triangle 't' of a list of corners
+static std::array<float, 3> centroid(const std::vector<MeshVertex>& corners, size_t t)
+{
+    std::array<float, 3> c = { { 0, 0, 0 } };
+    for (int j = 0; j < 3; j++) {
+        for (int k = 0; k < 3; k++) c[k] += corners[3 * t + j].position[k] / 3;
+    }
+    return c;
+}
+
+static float distanceSq(const std::array<float, 3>& a, const std::array<float, 3>& b)
+{
+    return (a[0] - b[0]) * (a[0] - b[0]) + (a[1] - b[1]) * (a[1] - b[1]) + (a[2] - b[2]) * (a[2] - b[2]);
+}
+
+// Sorted edge lengths in thousandths, the same for a triangle that only moved or turned
+static std::array<long, 3> shapeOf(const std::vector<MeshVertex>& corners, size_t t)
+{
+    std::array<long, 3> shape;
+    for (int j = 0; j < 3; j++) {
+        const float* a = corners[3 * t + j].position;
+        const float* b = corners[3 * t + (j + 1) % 3].position;
+        float length = std::sqrt((a[0] - b[0]) * (a[0] - b[0]) + (a[1] - b[1]) * (a[1] - b[1]) + (a[2] - b[2]) * (a[2] - b[2]));
+        shape[j] = std::lround(length * 1000);
+    }
+    std::sort(shape.begin(), shape.end());
+    return shape;
+}
+
+// Reorders the triangles of 'frame' to the order of 'previous' (already in
+// slot order), each triangle rotated so its corners follow the ones before
+static std::vector<MeshVertex> matchTriangles(const std::vector<MeshVertex>& previous, const std::vector<MeshVertex>& frame)
+{
+    size_t triangleCount = frame.size() / 3;
+    const size_t none = ~(size_t) 0;
+    std::vector<size_t> slotOf(triangleCount, none);
+    std::vector<bool> taken(triangleCount, false);
+
+    std::vector<std::array<float, 3>> previousCentroids(triangleCount), centroids(triangleCount);
+    std::map<std::array<long, 3>, std::vector<size_t>> slotsByShape;
+    for (size_t s = 0; s < triangleCount; s++) {
+        previousCentroids[s] = centroid(previous, s);
+        slotsByShape[shapeOf(previous, s)].push_back(s);
+    }
+    for (size_t t = 0; t < triangleCount; t++) {
+        centroids[t] = centroid(frame, t);
+    }
+
+    // Pieces that kept their shape go to the nearest slot of the same shape
+    for (size_t t = 0; t < triangleCount; t++) {
+        auto slots = slotsByShape.find(shapeOf(frame, t));
+        if (slots == slotsByShape.end()) continue;
+        size_t best = none;
+        for (size_t s : slots->second) {
+            if (!taken[s] && (best == none || distanceSq(centroids[t], previousCentroids[s]) < distanceSq(centroids[t], previousCentroids[best]))) best = s;
+        }
+        if (best == none) continue;
+        slotOf[t] = best;
+        taken[best] = true;
+    }
+
+    // The others, broken up or merged, to the nearest free slot
+    for (size_t t = 0; t < triangleCount; t++) {
+        if (slotOf[t] != none) continue;
+        size_t best = none;
+        for (size_t s = 0; s < triangleCount; s++) {
+            if (!taken[s] && (best == none || distanceSq(centroids[t], previousCentroids[s]) < distanceSq(centroids[t], previousCentroids[best]))) best = s;
+        }
+        slotOf[t] = best;
+        taken[best] = true;
+    }
+
+    std::vector<MeshVertex> matched(frame.size());
+    for (size_t t = 0; t < triangleCount; t++) {
+        size_t s = slotOf[t];
+        int bestRotation = 0;
+        float bestError = 0;
+        for (int r = 0; r < 3; r++) {
+            float error = 0;
+            for (int j = 0; j < 3; j++) {
+                for (int k = 0; k < 3; k++) {
+                    float d = (frame[3 * t + (j + r) % 3].position[k] - centroids[t][k])
+                            - (previous[3 * s + j].position[k] - previousCentroids[s][k]);
+                    error += d * d;
+                }
+            }
+            if (r == 0 || error < bestError) {
+                bestError = error;
+                bestRotation = r;
+            }
+        }
+        for (int j = 0; j < 3; j++) {
+            matched[3 * s + j] = frame[3 * t + (j + bestRotation) % 3];
+        }
+    }
+    return matched;
+}
+
+bool loadObjMorph(const std::vector<std::string>& framePaths, const std::string& matBaseDir, MorphAnimation& animation)
+{
+    if (framePaths.empty()) return false;
+
+    // Every frame as a list of corners, 3 per triangle
+    std::vector<std::vector<MeshVertex>> frames(framePaths.size());
+    MeshData first;
+    for (size_t f = 0; f < framePaths.size(); f++) {
+        MeshData mesh;
+        if (!loadObjMesh(framePaths[f], matBaseDir, mesh)) return false;
+        if (f == 0) {
+            first.materials = mesh.materials;
+            first.hasTexCoords = mesh.hasTexCoords;
+        } else if (mesh.indices.size() != frames[0].size() || mesh.materials.size() != first.materials.size()) {
+            std::cerr << framePaths[f] << " has other triangles or materials than " << framePaths[0] << std::endl;
+            return false;
+        }
+        for (uint32_t index : mesh.indices) {
+            frames[f].push_back(mesh.vertices[index]);
+        }
+        if (f > 0) frames[f] = matchTriangles(frames[f - 1], frames[f]);
+    }
+
+    // Corners that are the same in every frame share a vertex
+    size_t cornerCount = frames[0].size();
+    size_t frameCount = frames.size();
+    MeshData& base = animation.base;
+    base = std::move(first);
+    std::vector<size_t> cornerOfVertex;
+    std::unordered_map<std::string, uint32_t> uniqueVertices;
+    std::string key(frameCount * sizeof(MeshVertex), '\0');
+    for (size_t c = 0; c < cornerCount; c++) {
+        for (size_t f = 0; f < frameCount; f++) {
+            std::memcpy(&key[f * sizeof(MeshVertex)], &frames[f][c], sizeof(MeshVertex));
+        }
+        auto inserted = uniqueVertices.insert(std::make_pair(key, (uint32_t) base.vertices.size()));
+        base.indices.push_back(inserted.first->second);
+        if (inserted.second) {
+            base.vertices.push_back(frames[0][c]);
+            cornerOfVertex.push_back(c);
+        }
+    }
+
+    std::vector<uint32_t> sourceVertices;
+    optimizeMesh(base, true, &sourceVertices);
+    packMesh(base);
+
+    // One scale for all offsets, the largest one is stored as 32767
+    size_t vertexCount = base.vertices.size();
+    float largest = 0;
+    for (size_t f = 0; f < frameCount; f++) {
+        for (size_t v = 0; v < vertexCount; v++) {
+            const MeshVertex& vertex = frames[f][cornerOfVertex[sourceVertices[v]]];
+            for (int k = 0; k < 3; k++) {
+                largest = std::max(largest, std::fabs(vertex.position[k] - base.vertices[v].position[k]));
+            }
+        }
+    }
+    animation.frameCount = (uint32_t) frameCount;
+    animation.deltaScale = largest > 0 ? largest / 32767 : 1;
+
+    animation.deltas.resize(frameCount * vertexCount);
+    for (size_t f = 0; f < frameCount; f++) {
+        for (size_t v = 0; v < vertexCount; v++) {
+            const MeshVertex& vertex = frames[f][cornerOfVertex[sourceVertices[v]]];
+            MorphDelta& delta = animation.deltas[f * vertexCount + v];
+            for (int k = 0; k < 3; k++) {
+                float offset = (vertex.position[k] - base.vertices[v].position[k]) / animation.deltaScale;
+                delta.position[k] = (int16_t) std::max(-32767L, std::min(32767L, std::lround(offset)));
+            }
+            delta.padding = 0;
+            delta.normal = packNormal(vertex.normal, std::min(vertex.material, MAX_PACKED_MATERIAL));
+        }
+    }
+    return true;
+}
+
+
+const char MORPH_MAGIC[4] = { 'M', 'R', 'P', 'H' };
+
+// Followed by the payload: frameCount * vertexCount MorphDelta
+struct MorphHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;     // of the sizes and modification times of the frames
+    uint64_t vertexCount;
+    uint32_t frameCount;
+    float deltaScale;
+    uint64_t payloadBytes;
+    uint64_t checksum;
+};
+
+std::string morphPath(const std::string& animationPath)
+{
+    return animationPath + ".morph";
+}
+
+// False when a frame is missing
+static bool hashSourceStamps(const std::vector<std::string>& framePaths, uint64_t& hash)
+{
+    hash = hashBytes(nullptr, 0);
+    for (const std::string& path : framePaths) {
+        uint64_t stamp[2];
+        int64_t time;
+        if (!getSourceStamp(path, stamp[0], time)) return false;
+        stamp[1] = (uint64_t) time;
+        hash = hashBytes(stamp, sizeof(stamp), hash);
+    }
+    return true;
+}
+
+bool writeMorph(const std::string& animationPath, const std::vector<std::string>& framePaths, const MorphAnimation& animation)
+{
+    if (!writeBinaryMesh(binaryMeshPath(animationPath), framePaths.front(), animation.base)) return false;
+
+    MorphHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MORPH_MAGIC, sizeof(MORPH_MAGIC));
+    header.version = MORPH_VERSION;
+    hashSourceStamps(framePaths, header.sourceHash);
+    header.vertexCount = animation.base.packedVertices.size();
+    header.frameCount = animation.frameCount;
+    header.deltaScale = animation.deltaScale;
+
+    const unsigned char* deltas = (const unsigned char*) animation.deltas.data();
+    std::vector<unsigned char> payload(deltas, deltas + animation.deltas.size() * sizeof(MorphDelta));
+    header.payloadBytes = payload.size();
+    header.checksum = hashBytes(payload.data(), payload.size());
+    return writeAssetFile(morphPath(animationPath), &header, sizeof(header), payload);
+}
+
+bool openMorph(const std::string& animationPath, const std::vector<std::string>& framePaths,
+               MappedFile& meshFile, MeshView& view, std::vector<tinyobj::material_t>& materials,
+               MappedFile& morphFile, MorphView& morph)
+{
+    if (framePaths.empty() || !openBinaryMesh(binaryMeshPath(animationPath), framePaths.front(), meshFile, view, materials)) return false;
+
+    std::string path = morphPath(animationPath);
+    ArchiveBlob blob;
+    if (!findInArchive(path, blob)) {
+        if (!morphFile.open(path)) return false;
+        blob.data = morphFile.data();
+        blob.size = morphFile.size();
+    }
+
+    MorphHeader header;
+    if (blob.size < sizeof(header)) {
+        std::cerr << path << " is truncated, loading the OBJ files instead" << std::endl;
+        return false;
+    }
+    std::memcpy(&header, blob.data, sizeof(header));
+
+    if (std::memcmp(header.magic, MORPH_MAGIC, sizeof(MORPH_MAGIC)) != 0 || header.version != MORPH_VERSION) {
+        std::cerr << path << " is from another version, loading the OBJ files instead" << std::endl;
+        return false;
+    }
+
+    uint64_t sourceHash;
+    if (hashSourceStamps(framePaths, sourceHash) && sourceHash != header.sourceHash) {
+        std::cerr << path << " is out of date, loading the OBJ files instead" << std::endl;
+        return false;
+    }
+
+    if (header.vertexCount != view.vertexCount || header.frameCount == 0
+        || header.payloadBytes != header.frameCount * header.vertexCount * sizeof(MorphDelta)
+        || blob.size != sizeof(header) + header.payloadBytes) {
+        std::cerr << path << " is corrupt (bad sizes), loading the OBJ files instead" << std::endl;
+        return false;
+    }
+
+    const unsigned char* payload = blob.data + sizeof(header);
+    if (!blob.verified && hashBytes(payload, (size_t) header.payloadBytes) != header.checksum) {
+        std::cerr << path << " is corrupt (checksum mismatch), loading the OBJ files instead" << std::endl;
+        return false;
+    }
+
+    morph.deltas = (const MorphDelta*) payload;
+    morph.vertexCount = (size_t) header.vertexCount;
+    morph.frameCount = header.frameCount;
+    morph.deltaScale = header.deltaScale;
+    return true;
+}
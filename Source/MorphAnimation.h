@@ -0,0 +1,74 @@
+#pragma once
+#include "MappedFile.h"
+#include "MeshData.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Vertex animations stored as morph targets: one base mesh (the first frame)
+// and, for every frame, the offset of each vertex from it. shader.vert blends
+// two frames, so the animation plays smoothly at any frame rate. No OpenGL,
+// MeshConverter writes the files.
+
+// One vertex in one frame, 12 bytes against the 20 of a PackedVertex and the
+// indices of a whole mesh per frame:
+// - position: offset from the base position in units of the deltaScale of the
+//   animation, uploaded as GL_SHORT
+// - normal: the normal and material of the vertex in this frame, packed as in
+//   PackedVertex
+struct MorphDelta
+{
+    int16_t position[3];
+    int16_t padding;
+    uint32_t normal;
+};
+
+struct MorphAnimation
+{
+    MeshData base;                  // optimised and packed
+    uint32_t frameCount = 0;
+    float deltaScale = 1;           // object space size of one delta unit
+    std::vector<MorphDelta> deltas; // frameCount runs of base.packedVertices.size()
+};
+
+// The deltas wherever they are stored (a MorphAnimation, a mapped .morph file)
+struct MorphView
+{
+    const MorphDelta* deltas = nullptr;
+    size_t vertexCount = 0;
+    uint32_t frameCount = 0;
+    float deltaScale = 1;
+};
+
+MorphView viewMorph(const MorphAnimation& animation);
+
+// Parses the frames, OBJ files of the same number of triangles and materials
+// (MTL files in 'matBaseDir'). The triangles of every frame are matched to the
+// ones of the frame before, first to triangles of the same shape (pieces that
+// only moved), then to the nearest of the others, so the blends between two
+// frames move every triangle the shortest way. False (with the reason
+// printed) when a frame can not be read or does not match the first one.
+bool loadObjMorph(const std::vector<std::string>& framePaths, const std::string& matBaseDir, MorphAnimation& animation);
+
+// Morph animations are written by MeshConverter to two files next to the
+// frames: the base mesh as a binary mesh (binaryMeshPath(animationPath)) and
+// the deltas (morphPath(animationPath)), e.g. "Resources/spacecraftExplosion/
+// spacecraftExplosion.mesh" and ".morph"
+const uint32_t MORPH_VERSION = 2;
+
+// "Resources/spacecraftExplosion/spacecraftExplosion" -> "Resources/spacecraftExplosion/spacecraftExplosion.morph"
+std::string morphPath(const std::string& animationPath);
+
+// The sizes and modification times of all frames are stored to detect files
+// that are out of date
+bool writeMorph(const std::string& animationPath, const std::vector<std::string>& framePaths, const MorphAnimation& animation);
+
+// Maps and validates both files, from the mounted archive when they are in
+// there (ResourceArchive.h). The views point into the archive or the files. False when a
+// file is missing, older than the frames (when those exist), from another
+// version or corrupt.
+bool openMorph(const std::string& animationPath, const std::vector<std::string>& framePaths,
+               MappedFile& meshFile, MeshView& view, std::vector<tinyobj::material_t>& materials,
+               MappedFile& morphFile, MorphView& morph);
@@ -0,0 +1,562 @@
+#include "NoiseBatch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#if defined(__AVX2__)
+#define NOISE_BATCH_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NOISE_BATCH_SSE2
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+
+// libnoise defines its gradient table in a header without 'static', so it is
+// wrapped in a namespace here to not clash with the copy inside the library
+namespace libnoise_table {
+#include <noise/vectortable.h>
+}
+
+// Same constants as noisegen.cpp (NOISE_VERSION 2)
+static const int X_NOISE_GEN = 1619;
+static const int Y_NOISE_GEN = 31337;
+static const int Z_NOISE_GEN = 6971;
+static const int SEED_NOISE_GEN = 1013;
+static const int SHIFT_NOISE_GEN = 8;
+
+// Rows of (x, y, z, 0), aligned so a row is a single SIMD load
+struct GradientTable
+{
+    alignas(32) float vectors[256 * 4];
+
+    GradientTable()
+    {
+        for (int i = 0; i < 256 * 4; i++) {
+            vectors[i] = (float) libnoise_table::noise::g_randomVectors[i];
+        }
+    }
+};
+
+static const GradientTable gradientTable;
+
+
+// Every backend offers the same few operations on a block of 'width' lanes,
+// the kernels below are written once on top of them
+
+struct ScalarLanes
+{
+    typedef float F;
+    typedef unsigned int I; // unsigned so the hash may wrap around
+    static const int width = 1;
+
+    static F load(const float* p) { return *p; }
+    static void store(float* p, F a) { *p = a; }
+    static F set(float a) { return a; }
+    static I seti(int a) { return (I) a; }
+
+    static F add(F a, F b) { return a + b; }
+    static F sub(F a, F b) { return a - b; }
+    static F mul(F a, F b) { return a * b; }
+    static F abs(F a) { return std::abs(a); }
+    static F min(F a, F b) { return std::min(a, b); }
+    static F max(F a, F b) { return std::max(a, b); }
+    static I addi(I a, I b) { return a + b; }
+    static I muli(I a, I b) { return a * b; }
+
+    // Lower corner of the unit cube, (int)a for positive a and (int)a - 1 otherwise, as in libnoise
+    static I lowerCorner(F a) { return (I) ((int) a - (a > 0.f ? 0 : 1)); }
+    static F toFloat(I a) { return (float) (int) a; }
+
+    static void gradient(I hash, F& gx, F& gy, F& gz)
+    {
+        const float* row = &gradientTable.vectors[((hash ^ (hash >> SHIFT_NOISE_GEN)) & 0xff) << 2];
+        gx = row[0];
+        gy = row[1];
+        gz = row[2];
+    }
+};
+
+#if defined(NOISE_BATCH_SSE2)
+struct Sse2Lanes
+{
+    typedef __m128 F;
+    typedef __m128i I;
+    static const int width = 4;
+
+    static F load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, F a) { _mm_storeu_ps(p, a); }
+    static F set(float a) { return _mm_set1_ps(a); }
+    static I seti(int a) { return _mm_set1_epi32(a); }
+
+    static F add(F a, F b) { return _mm_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+    static F abs(F a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+    static F min(F a, F b) { return _mm_min_ps(a, b); }
+    static F max(F a, F b) { return _mm_max_ps(a, b); }
+    static I addi(I a, I b) { return _mm_add_epi32(a, b); }
+
+    // SSE2 has no 32-bit low multiply, take the low halves of two 64-bit ones
+    static I muli(I a, I b)
+    {
+        __m128i even = _mm_mul_epu32(a, b);
+        __m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+        return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+    }
+
+    static I lowerCorner(F a)
+    {
+        __m128i notPositive = _mm_castps_si128(_mm_cmple_ps(a, _mm_setzero_ps()));
+        return _mm_add_epi32(_mm_cvttps_epi32(a), notPositive); // the mask is -1 where a <= 0
+    }
+    static F toFloat(I a) { return _mm_cvtepi32_ps(a); }
+
+    // Loads the four table rows and transposes them into x, y and z vectors
+    static void gradient(I hash, F& gx, F& gy, F& gz)
+    {
+        __m128i index = _mm_and_si128(_mm_xor_si128(hash, _mm_srli_epi32(hash, SHIFT_NOISE_GEN)), _mm_set1_epi32(0xff));
+        alignas(16) int rows[4];
+        _mm_store_si128((__m128i*) rows, index);
+
+        __m128 r0 = _mm_load_ps(&gradientTable.vectors[rows[0] << 2]);
+        __m128 r1 = _mm_load_ps(&gradientTable.vectors[rows[1] << 2]);
+        __m128 r2 = _mm_load_ps(&gradientTable.vectors[rows[2] << 2]);
+        __m128 r3 = _mm_load_ps(&gradientTable.vectors[rows[3] << 2]);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        gx = r0;
+        gy = r1;
+        gz = r2;
+    }
+};
+typedef Sse2Lanes Lanes;
+#elif defined(NOISE_BATCH_AVX2)
+struct Avx2Lanes
+{
+    typedef __m256 F;
+    typedef __m256i I;
+    static const int width = 8;
+
+    static F load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, F a) { _mm256_storeu_ps(p, a); }
+    static F set(float a) { return _mm256_set1_ps(a); }
+    static I seti(int a) { return _mm256_set1_epi32(a); }
+
+    static F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static F abs(F a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a); }
+    static F min(F a, F b) { return _mm256_min_ps(a, b); }
+    static F max(F a, F b) { return _mm256_max_ps(a, b); }
+    static I addi(I a, I b) { return _mm256_add_epi32(a, b); }
+    static I muli(I a, I b) { return _mm256_mullo_epi32(a, b); }
+
+    static I lowerCorner(F a)
+    {
+        __m256i notPositive = _mm256_castps_si256(_mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_LE_OQ));
+        return _mm256_add_epi32(_mm256_cvttps_epi32(a), notPositive); // the mask is -1 where a <= 0
+    }
+    static F toFloat(I a) { return _mm256_cvtepi32_ps(a); }
+
+    static void gradient(I hash, F& gx, F& gy, F& gz)
+    {
+        __m256i index = _mm256_and_si256(_mm256_xor_si256(hash, _mm256_srli_epi32(hash, SHIFT_NOISE_GEN)), _mm256_set1_epi32(0xff));
+        __m256i row = _mm256_slli_epi32(index, 2);
+        gx = _mm256_i32gather_ps(gradientTable.vectors, row, 4);
+        gy = _mm256_i32gather_ps(gradientTable.vectors + 1, row, 4);
+        gz = _mm256_i32gather_ps(gradientTable.vectors + 2, row, 4);
+    }
+};
+typedef Avx2Lanes Lanes;
+#else
+typedef ScalarLanes Lanes;
+#endif
+
+
+// Kernels, following GradientCoherentNoise3D and Perlin::GetValue step by step
+
+template <class L>
+static inline typename L::F gradientNoise(typename L::I hash, typename L::F dx, typename L::F dy, typename L::F dz)
+{
+    typename L::F gx, gy, gz;
+    L::gradient(hash, gx, gy, gz);
+    typename L::F dot = L::add(L::add(L::mul(gx, dx), L::mul(gy, dy)), L::mul(gz, dz));
+    return L::mul(dot, L::set(2.12f));
+}
+
+template <class L>
+static inline typename L::F linearInterp(typename L::F n0, typename L::F n1, typename L::F a)
+{
+    return L::add(L::mul(L::sub(L::set(1.f), a), n0), L::mul(a, n1));
+}
+
+template <class L>
+static inline typename L::F sCurve(typename L::F a, noise::NoiseQuality quality)
+{
+    switch (quality) {
+        case noise::QUALITY_FAST:
+            return a;
+        case noise::QUALITY_STD:
+            return L::mul(L::mul(a, a), L::sub(L::set(3.f), L::mul(L::set(2.f), a)));
+        default: {
+            typename L::F a3 = L::mul(L::mul(a, a), a);
+            typename L::F a4 = L::mul(a3, a);
+            typename L::F a5 = L::mul(a4, a);
+            return L::add(L::sub(L::mul(L::set(6.f), a5), L::mul(L::set(15.f), a4)), L::mul(L::set(10.f), a3));
+        }
+    }
+}
+
+template <class L>
+static inline typename L::F coherentNoise(typename L::F x, typename L::F y, typename L::F z, typename L::I seed, noise::NoiseQuality quality)
+{
+    typedef typename L::F F;
+    typedef typename L::I I;
+
+    I x0 = L::lowerCorner(x);
+    I y0 = L::lowerCorner(y);
+    I z0 = L::lowerCorner(z);
+
+    // Distance to the lower corner, the upper one is one less
+    F dx0 = L::sub(x, L::toFloat(x0));
+    F dy0 = L::sub(y, L::toFloat(y0));
+    F dz0 = L::sub(z, L::toFloat(z0));
+    F dx1 = L::sub(dx0, L::set(1.f));
+    F dy1 = L::sub(dy0, L::set(1.f));
+    F dz1 = L::sub(dz0, L::set(1.f));
+
+    F xs = sCurve<L>(dx0, quality);
+    F ys = sCurve<L>(dy0, quality);
+    F zs = sCurve<L>(dz0, quality);
+
+    // The lattice hash is linear in the corner, so the other corners are
+    // the lower one's hash plus a constant
+    I h000 = L::addi(L::addi(L::muli(x0, L::seti(X_NOISE_GEN)), L::muli(y0, L::seti(Y_NOISE_GEN))),
+                     L::addi(L::muli(z0, L::seti(Z_NOISE_GEN)), L::muli(seed, L::seti(SEED_NOISE_GEN))));
+    I h100 = L::addi(h000, L::seti(X_NOISE_GEN));
+    I h010 = L::addi(h000, L::seti(Y_NOISE_GEN));
+    I h110 = L::addi(h010, L::seti(X_NOISE_GEN));
+    I h001 = L::addi(h000, L::seti(Z_NOISE_GEN));
+    I h101 = L::addi(h001, L::seti(X_NOISE_GEN));
+    I h011 = L::addi(h001, L::seti(Y_NOISE_GEN));
+    I h111 = L::addi(h011, L::seti(X_NOISE_GEN));
+
+    F ix0 = linearInterp<L>(gradientNoise<L>(h000, dx0, dy0, dz0), gradientNoise<L>(h100, dx1, dy0, dz0), xs);
+    F ix1 = linearInterp<L>(gradientNoise<L>(h010, dx0, dy1, dz0), gradientNoise<L>(h110, dx1, dy1, dz0), xs);
+    F iy0 = linearInterp<L>(ix0, ix1, ys);
+    ix0 = linearInterp<L>(gradientNoise<L>(h001, dx0, dy0, dz1), gradientNoise<L>(h101, dx1, dy0, dz1), xs);
+    ix1 = linearInterp<L>(gradientNoise<L>(h011, dx0, dy1, dz1), gradientNoise<L>(h111, dx1, dy1, dz1), xs);
+    F iy1 = linearInterp<L>(ix0, ix1, ys);
+
+    return linearInterp<L>(iy0, iy1, zs);
+}
+
+// coherentNoise in the y = 0 plane. libnoise puts y = 0 on the upper face of
+// the cell below (y0 = -1) and its S-curve weight is exactly 1 there, so only
+// the 4 corners with iy = 0 contribute, where the y terms of the hash and the
+// dot product are 0. The result is bit-identical to coherentNoise(x, 0, z).
+template <class L>
+static inline typename L::F coherentNoise2D(typename L::F x, typename L::F z, typename L::I seed, noise::NoiseQuality quality)
+{
+    typedef typename L::F F;
+    typedef typename L::I I;
+
+    I x0 = L::lowerCorner(x);
+    I z0 = L::lowerCorner(z);
+
+    F dx0 = L::sub(x, L::toFloat(x0));
+    F dz0 = L::sub(z, L::toFloat(z0));
+    F dx1 = L::sub(dx0, L::set(1.f));
+    F dz1 = L::sub(dz0, L::set(1.f));
+    F dy = L::set(0.f);
+
+    F xs = sCurve<L>(dx0, quality);
+    F zs = sCurve<L>(dz0, quality);
+
+    I h00 = L::addi(L::muli(x0, L::seti(X_NOISE_GEN)), L::addi(L::muli(z0, L::seti(Z_NOISE_GEN)), L::muli(seed, L::seti(SEED_NOISE_GEN))));
+    I h10 = L::addi(h00, L::seti(X_NOISE_GEN));
+    I h01 = L::addi(h00, L::seti(Z_NOISE_GEN));
+    I h11 = L::addi(h01, L::seti(X_NOISE_GEN));
+
+    F ix0 = linearInterp<L>(gradientNoise<L>(h00, dx0, dy, dz0), gradientNoise<L>(h10, dx1, dy, dz0), xs);
+    F ix1 = linearInterp<L>(gradientNoise<L>(h01, dx0, dy, dz1), gradientNoise<L>(h11, dx1, dy, dz1), xs);
+
+    return linearInterp<L>(ix0, ix1, zs);
+}
+
+// The parameters of the fractal generator modules, which all sum octaves
+// of coherent noise with a seed incremented per octave. The frequency and
+// weight of every octave are computed in double once, multiplying the
+// coordinates by the lacunarity octave after octave in float would add up
+// the rounding errors.
+enum FractalType { FRACTAL_PERLIN, FRACTAL_BILLOW, FRACTAL_RIDGED };
+
+static const int MAX_OCTAVES = 30; // PERLIN_MAX_OCTAVE, BILLOW_MAX_OCTAVE and RIDGED_MAX_OCTAVE
+
+struct FractalSettings
+{
+    FractalType type;
+    int octaveCount, seed;
+    noise::NoiseQuality quality;
+    float octaveFrequency[MAX_OCTAVES];
+    float octaveWeight[MAX_OCTAVES];
+};
+
+static FractalSettings makeSettings(FractalType type, double frequency, double lacunarity, double persistence, int octaveCount, int seed, noise::NoiseQuality quality)
+{
+    FractalSettings settings;
+    settings.type = type;
+    settings.octaveCount = octaveCount;
+    settings.seed = seed;
+    settings.quality = quality;
+
+    double weight = 1.0;
+    for (int octave = 0; octave < MAX_OCTAVES; octave++) {
+        settings.octaveFrequency[octave] = (float) frequency;
+        settings.octaveWeight[octave] = (float) weight;
+        frequency *= lacunarity;
+        // Ridged octaves are weighted by their frequency^-1 (spectral weights)
+        weight *= type == FRACTAL_RIDGED ? 1.0 / lacunarity : persistence;
+    }
+    return settings;
+}
+
+static FractalSettings getSettings(const noise::module::Perlin& perlinGenerator)
+{
+    return makeSettings(FRACTAL_PERLIN, perlinGenerator.GetFrequency(), perlinGenerator.GetLacunarity(), perlinGenerator.GetPersistence(),
+                        perlinGenerator.GetOctaveCount(), perlinGenerator.GetSeed(), perlinGenerator.GetNoiseQuality());
+}
+
+static FractalSettings getSettings(const noise::module::Billow& billowGenerator)
+{
+    return makeSettings(FRACTAL_BILLOW, billowGenerator.GetFrequency(), billowGenerator.GetLacunarity(), billowGenerator.GetPersistence(),
+                        billowGenerator.GetOctaveCount(), billowGenerator.GetSeed(), billowGenerator.GetNoiseQuality());
+}
+
+static FractalSettings getSettings(const noise::module::RidgedMulti& ridgedGenerator)
+{
+    return makeSettings(FRACTAL_RIDGED, ridgedGenerator.GetFrequency(), ridgedGenerator.GetLacunarity(), 1.0,
+                        ridgedGenerator.GetOctaveCount(), ridgedGenerator.GetSeed(), ridgedGenerator.GetNoiseQuality());
+}
+
+// Perlin::GetValue, Billow::GetValue and RidgedMulti::GetValue on a block of
+// points, in the y = 0 plane when 'planar' is set (ys is not read then)
+template <class L>
+static inline void fractalBlock(const FractalSettings& settings, bool planar, const float* xs, const float* ys, const float* zs, float* out)
+{
+    typedef typename L::F F;
+
+    F inX = L::load(xs);
+    F inY = planar ? L::set(0.f) : L::load(ys);
+    F inZ = L::load(zs);
+
+    F value = L::set(0.f);
+    F weight = L::set(1.f);
+    for (int curOctave = 0; curOctave < settings.octaveCount; curOctave++) {
+        F frequency = L::set(settings.octaveFrequency[curOctave]);
+        F x = L::mul(inX, frequency);
+        F z = L::mul(inZ, frequency);
+
+        int seed = settings.seed + curOctave;
+        if (settings.type == FRACTAL_RIDGED) seed &= 0x7fffffff;
+
+        F signal = planar ? coherentNoise2D<L>(x, z, L::seti(seed), settings.quality)
+                          : coherentNoise<L>(x, L::mul(inY, frequency), z, L::seti(seed), settings.quality);
+
+        if (settings.type == FRACTAL_BILLOW) {
+            signal = L::sub(L::mul(L::set(2.f), L::abs(signal)), L::set(1.f));
+        } else if (settings.type == FRACTAL_RIDGED) {
+            // Sharp ridges, weighted by the previous octave (offset 1, gain 2)
+            signal = L::sub(L::set(1.f), L::abs(signal));
+            signal = L::mul(signal, signal);
+            signal = L::mul(signal, weight);
+            weight = L::min(L::max(L::mul(signal, L::set(2.f)), L::set(0.f)), L::set(1.f));
+        }
+        value = L::add(value, L::mul(signal, L::set(settings.octaveWeight[curOctave])));
+    }
+
+    if (settings.type == FRACTAL_BILLOW) {
+        value = L::add(value, L::set(0.5f));
+    } else if (settings.type == FRACTAL_RIDGED) {
+        value = L::sub(L::mul(value, L::set(1.25f)), L::set(1.f));
+    }
+
+    L::store(out, value);
+}
+
+// Runs 'block' on every full block of points, the last few points are copied
+// into a padded block so they go through exactly the same arithmetic
+template <class Block>
+static void forEachBlock(const float* xs, const float* ys, const float* zs, float* out, size_t n, Block block)
+{
+    const size_t width = Lanes::width;
+    size_t k = 0;
+    for (; k + width <= n; k += width) {
+        block(xs + k, ys ? ys + k : nullptr, zs + k, out + k);
+    }
+
+    if (k < n) {
+        float px[width] = {}, py[width] = {}, pz[width] = {}, pout[width];
+        for (size_t t = 0; k + t < n; t++) {
+            px[t] = xs[k + t];
+            py[t] = ys ? ys[k + t] : 0.f;
+            pz[t] = zs[k + t];
+        }
+        block(px, py, pz, pout);
+        std::copy(pout, pout + (n - k), out + k);
+    }
+}
+
+template <class Generator>
+static void getFractalValues(const Generator& generator, bool planar, const float* xs, const float* ys, const float* zs, float* out, size_t n)
+{
+    FractalSettings settings = getSettings(generator);
+    forEachBlock(xs, ys, zs, out, n, [&](const float* bx, const float* by, const float* bz, float* bout) {
+        fractalBlock<Lanes>(settings, planar, bx, by, bz, bout);
+    });
+}
+
+
+void getPerlinValues(const noise::module::Perlin& perlinGenerator, const float* xs, const float* ys, const float* zs, float* out, size_t n)
+{
+    getFractalValues(perlinGenerator, false, xs, ys, zs, out, n);
+}
+
+void getBillowValues(const noise::module::Billow& billowGenerator, const float* xs, const float* ys, const float* zs, float* out, size_t n)
+{
+    getFractalValues(billowGenerator, false, xs, ys, zs, out, n);
+}
+
+void getRidgedMultiValues(const noise::module::RidgedMulti& ridgedGenerator, const float* xs, const float* ys, const float* zs, float* out, size_t n)
+{
+    getFractalValues(ridgedGenerator, false, xs, ys, zs, out, n);
+}
+
+void getGradientCoherentNoise(const float* xs, const float* ys, const float* zs, int seed, noise::NoiseQuality quality, float* out, size_t n)
+{
+    forEachBlock(xs, ys, zs, out, n, [&](const float* bx, const float* by, const float* bz, float* bout) {
+        Lanes::store(bout, coherentNoise<Lanes>(Lanes::load(bx), Lanes::load(by), Lanes::load(bz), Lanes::seti(seed), quality));
+    });
+}
+
+void getGradientCoherentNoise2D(const float* xs, const float* zs, int seed, noise::NoiseQuality quality, float* out, size_t n)
+{
+    forEachBlock(xs, nullptr, zs, out, n, [&](const float* bx, const float*, const float* bz, float* bout) {
+        Lanes::store(bout, coherentNoise2D<Lanes>(Lanes::load(bx), Lanes::load(bz), Lanes::seti(seed), quality));
+    });
+}
+
+void getValues2D(const noise::module::Perlin& perlinGenerator, const float* xs, const float* zs, float* out, size_t n)
+{
+    getFractalValues(perlinGenerator, true, xs, nullptr, zs, out, n);
+}
+
+void getValues2D(const noise::module::Billow& billowGenerator, const float* xs, const float* zs, float* out, size_t n)
+{
+    getFractalValues(billowGenerator, true, xs, nullptr, zs, out, n);
+}
+
+void getValues2D(const noise::module::RidgedMulti& ridgedGenerator, const float* xs, const float* zs, float* out, size_t n)
+{
+    getFractalValues(ridgedGenerator, true, xs, nullptr, zs, out, n);
+}
+
+float getValue2D(const noise::module::Perlin& perlinGenerator, float x, float z)
+{
+    float value;
+    getValues2D(perlinGenerator, &x, &z, &value, 1);
+    return value;
+}
+
+float getValue2D(const noise::module::Billow& billowGenerator, float x, float z)
+{
+    float value;
+    getValues2D(billowGenerator, &x, &z, &value, 1);
+    return value;
+}
+
+float getValue2D(const noise::module::RidgedMulti& ridgedGenerator, float x, float z)
+{
+    float value;
+    getValues2D(ridgedGenerator, &x, &z, &value, 1);
+    return value;
+}
+
+const char* noiseBatchKernel()
+{
+#if defined(NOISE_BATCH_AVX2)
+    return "AVX2";
+#elif defined(NOISE_BATCH_SSE2)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+
+void benchmarkNoise(const noise::module::Perlin& perlinGenerator)
+{
+    // Points of a 256 x 256 heightfield in the y = 0 plane, like the terrain
+    const int side = 256;
+    const size_t numPoints = (size_t) side * side;
+    const int repetitions = 5;
+
+    std::vector<float> xs(numPoints), ys(numPoints, 0.f), zs(numPoints);
+    for (size_t k = 0; k < numPoints; k++) {
+        xs[k] = (k / side) * 8.f / side;
+        zs[k] = (k % side) * 8.f / side;
+    }
+
+    // Average ns per point of 'evaluate', which fills 'values'
+    auto timePerSample = [&](std::vector<float>& values, const std::function<void(float*)>& evaluate) {
+        values.resize(numPoints);
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < repetitions; r++) {
+            evaluate(values.data());
+        }
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(end - start).count() / ((double) numPoints * repetitions);
+    };
+
+    std::vector<float> reference, scalarLanes, batched, planar;
+    FractalSettings settings = getSettings(perlinGenerator);
+
+    double referenceNs = timePerSample(reference, [&](float* out) {
+        for (size_t k = 0; k < numPoints; k++) {
+            out[k] = (float) perlinGenerator.GetValue(xs[k], ys[k], zs[k]);
+        }
+    });
+    // The portable loop, to see what the SIMD kernel adds on top of it
+    double scalarNs = timePerSample(scalarLanes, [&](float* out) {
+        for (size_t k = 0; k < numPoints; k++) {
+            fractalBlock<ScalarLanes>(settings, false, &xs[k], &ys[k], &zs[k], &out[k]);
+        }
+    });
+    double batchedNs = timePerSample(batched, [&](float* out) {
+        getPerlinValues(perlinGenerator, xs.data(), ys.data(), zs.data(), out, numPoints);
+    });
+    double planarNs = timePerSample(planar, [&](float* out) {
+        getValues2D(perlinGenerator, xs.data(), zs.data(), out, numPoints);
+    });
+
+    float maxError = 0.f;
+    size_t planarMismatches = 0;
+    for (size_t k = 0; k < numPoints; k++) {
+        maxError = std::max(maxError, std::abs(batched[k] - reference[k]));
+        maxError = std::max(maxError, std::abs(scalarLanes[k] - reference[k]));
+        if (planar[k] != batched[k]) planarMismatches++;
+    }
+
+    std::cout << "Perlin noise, " << perlinGenerator.GetOctaveCount() << " octaves, " << numPoints << " points" << std::endl;
+    std::cout << "  Perlin::GetValue " << referenceNs << " ns/sample" << std::endl;
+    std::cout << "  getPerlinValues (scalar lanes) " << scalarNs << " ns/sample, x" << referenceNs / scalarNs << std::endl;
+    std::cout << "  getPerlinValues (" << noiseBatchKernel() << ") " << batchedNs << " ns/sample, x" << referenceNs / batchedNs << std::endl;
+    std::cout << "  getValues2D (" << noiseBatchKernel() << ") " << planarNs << " ns/sample, x" << batchedNs / planarNs
+              << " over the y = 0 3D path, " << planarMismatches << " values differ from it" << std::endl;
+    std::cout << "  largest difference " << maxError << " (tolerance " << PERLIN_BATCH_TOLERANCE << ")" << std::endl;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <noise/noise.h> // used for the Perlin noise generation
+
+// Batched, single precision versions of the libnoise gradient noise. The points
+// are evaluated a SIMD block at a time (8 lanes with AVX2, 4 with SSE2) and a
+// scalar loop with the same arithmetic is used on other CPUs. The kernel is
+// chosen at compile time: the NOISE_AVX2 CMake option (on by default on
+// x86-64) builds NoiseBatch.cpp with -mavx2 (/arch:AVX2) for the wide one.
+//
+// The lattice hashing and gradient table are the ones of libnoise, only the
+// precision differs: within PERLIN_BATCH_TOLERANCE of the libnoise modules as
+// long as the coordinates of the highest octave stay below 2^13, after that
+// the float coordinates lose their fraction bits. Unlike libnoise, coordinates
+// are not wrapped into the 32-bit integer range (MakeInt32Range).
+
+const float PERLIN_BATCH_TOLERANCE = 1e-4f;
+
+// out[k] = perlinGenerator.GetValue(xs[k], ys[k], zs[k]) for k < n
+void getPerlinValues(const noise::module::Perlin& perlinGenerator, const float* xs, const float* ys, const float* zs, float* out, size_t n);
+
+// The same for the Billow and RidgedMulti generators
+void getBillowValues(const noise::module::Billow& billowGenerator, const float* xs, const float* ys, const float* zs, float* out, size_t n);
+void getRidgedMultiValues(const noise::module::RidgedMulti& ridgedGenerator, const float* xs, const float* ys, const float* zs, float* out, size_t n);
+
+// out[k] = noise::GradientCoherentNoise3D(xs[k], ys[k], zs[k], seed, quality) for k < n
+void getGradientCoherentNoise(const float* xs, const float* ys, const float* zs, int seed, noise::NoiseQuality quality, float* out, size_t n);
+
+// The same in the y = 0 plane, where only the 4 lattice corners with y = 0
+// contribute. Bit-identical to passing y = 0 to the 3D versions above.
+void getGradientCoherentNoise2D(const float* xs, const float* zs, int seed, noise::NoiseQuality quality, float* out, size_t n);
+
+// out[k] = generator.GetValue(xs[k], 0, zs[k]) for k < n, for heightfields
+void getValues2D(const noise::module::Perlin& perlinGenerator, const float* xs, const float* zs, float* out, size_t n);
+void getValues2D(const noise::module::Billow& billowGenerator, const float* xs, const float* zs, float* out, size_t n);
+void getValues2D(const noise::module::RidgedMulti& ridgedGenerator, const float* xs, const float* zs, float* out, size_t n);
+
+float getValue2D(const noise::module::Perlin& perlinGenerator, float x, float z);
+float getValue2D(const noise::module::Billow& billowGenerator, float x, float z);
+float getValue2D(const noise::module::RidgedMulti& ridgedGenerator, float x, float z);
+
+// "AVX2", "SSE2" or "scalar"
+const char* noiseBatchKernel();
+
+// Prints ns/sample of Perlin::GetValue against getPerlinValues and
+// getValues2D and the largest difference between them, no window needed
+void benchmarkNoise(const noise::module::Perlin& perlinGenerator);
@@ -0,0 +1,387 @@
+#include "NoiseGraph.h"
+#include "NoiseBatch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <tuple>
+
+using namespace noise::module;
+
+
+// Coordinate registers of the points a module is evaluated at
+struct NoisePoint
+{
+    int x, y, z;
+};
+
+struct NoiseGraphCompiler
+{
+    NoiseProgram& program;
+    std::map<std::tuple<const Module*, int, int, int>, int> compiled; // (module, point) -> result register
+
+    int emit(NoiseOp op, int a = -1, int b = -1, int c = -1, float p0 = 0.f, float p1 = 0.f, float p2 = 0.f)
+    {
+        NoiseInstruction instruction;
+        instruction.op = op;
+        instruction.result = program.numRegisters++;
+        instruction.args[0] = a;
+        instruction.args[1] = b;
+        instruction.args[2] = c;
+        instruction.point[0] = instruction.point[1] = instruction.point[2] = -1;
+        instruction.params[0] = p0;
+        instruction.params[1] = p1;
+        instruction.params[2] = p2;
+        program.instructions.push_back(instruction);
+        return instruction.result;
+    }
+
+    int emitAt(NoiseOp op, const Module& module, NoisePoint point)
+    {
+        int result = emit(op);
+        NoiseInstruction& instruction = program.instructions.back();
+        instruction.module = &module;
+        instruction.point[0] = point.x;
+        instruction.point[1] = point.y;
+        instruction.point[2] = point.z;
+        return result;
+    }
+
+    // Coordinate transforms, -1 stands for a coordinate that is 0 everywhere
+    int offsetCoordinate(int coordinate, double offset)
+    {
+        if (offset == 0.0) return coordinate;
+        if (coordinate < 0) return emit(NOISE_CONST, -1, -1, -1, (float) offset);
+        return emit(NOISE_SCALE_BIAS, coordinate, -1, -1, 1.f, (float) offset);
+    }
+
+    int scaleCoordinate(int coordinate, double scale)
+    {
+        if (coordinate < 0 || scale == 1.0) return coordinate;
+        return emit(NOISE_SCALE_BIAS, coordinate, -1, -1, (float) scale, 0.f);
+    }
+
+    int displaceCoordinate(int coordinate, int displacement)
+    {
+        if (coordinate < 0) return displacement;
+        return emit(NOISE_ADD, coordinate, displacement);
+    }
+
+    int compile(const Module& module, NoisePoint point)
+    {
+        auto key = std::make_tuple(&module, point.x, point.y, point.z);
+        auto found = compiled.find(key);
+        if (found != compiled.end()) return found->second;
+
+        int result = compileModule(module, point);
+        compiled[key] = result;
+        return result;
+    }
+
+    int compileModule(const Module& module, NoisePoint point)
+    {
+        // Generators
+        if (auto constant = dynamic_cast<const Const*>(&module)) {
+            return emit(NOISE_CONST, -1, -1, -1, (float) constant->GetConstValue());
+        }
+        if (dynamic_cast<const Perlin*>(&module)) return emitAt(NOISE_PERLIN, module, point);
+        if (dynamic_cast<const Billow*>(&module)) return emitAt(NOISE_BILLOW, module, point);
+        if (dynamic_cast<const RidgedMulti*>(&module)) return emitAt(NOISE_RIDGED, module, point);
+
+        // Modifiers
+        if (dynamic_cast<const Cache*>(&module)) {
+            return compile(module.GetSourceModule(0), point);
+        }
+        if (dynamic_cast<const Abs*>(&module)) {
+            return emit(NOISE_ABS, compile(module.GetSourceModule(0), point));
+        }
+        if (dynamic_cast<const Invert*>(&module)) {
+            return emit(NOISE_INVERT, compile(module.GetSourceModule(0), point));
+        }
+        if (auto scaleBias = dynamic_cast<const ScaleBias*>(&module)) {
+            return emit(NOISE_SCALE_BIAS, compile(module.GetSourceModule(0), point), -1, -1, (float) scaleBias->GetScale(), (float) scaleBias->GetBias());
+        }
+        if (auto clamp = dynamic_cast<const Clamp*>(&module)) {
+            return emit(NOISE_CLAMP, compile(module.GetSourceModule(0), point), -1, -1, (float) clamp->GetLowerBound(), (float) clamp->GetUpperBound());
+        }
+        if (auto exponent = dynamic_cast<const Exponent*>(&module)) {
+            return emit(NOISE_EXPONENT, compile(module.GetSourceModule(0), point), -1, -1, (float) exponent->GetExponent());
+        }
+
+        // Combiners
+        NoiseOp combiner = NOISE_MODULE;
+        if (dynamic_cast<const Add*>(&module)) combiner = NOISE_ADD;
+        else if (dynamic_cast<const Multiply*>(&module)) combiner = NOISE_MULTIPLY;
+        else if (dynamic_cast<const Min*>(&module)) combiner = NOISE_MIN;
+        else if (dynamic_cast<const Max*>(&module)) combiner = NOISE_MAX;
+        else if (dynamic_cast<const Power*>(&module)) combiner = NOISE_POWER;
+        if (combiner != NOISE_MODULE) {
+            return emit(combiner, compile(module.GetSourceModule(0), point), compile(module.GetSourceModule(1), point));
+        }
+
+        // Selectors
+        if (dynamic_cast<const Blend*>(&module)) {
+            return emit(NOISE_BLEND, compile(module.GetSourceModule(0), point), compile(module.GetSourceModule(1), point), compile(module.GetSourceModule(2), point));
+        }
+        if (auto select = dynamic_cast<const Select*>(&module)) {
+            return emit(NOISE_SELECT, compile(module.GetSourceModule(0), point), compile(module.GetSourceModule(1), point), compile(module.GetSourceModule(2), point),
+                        (float) select->GetLowerBound(), (float) select->GetUpperBound(), (float) select->GetEdgeFalloff());
+        }
+
+        // Transformers, the source module is compiled at the moved points
+        if (auto scalePoint = dynamic_cast<const ScalePoint*>(&module)) {
+            NoisePoint scaled = { scaleCoordinate(point.x, scalePoint->GetXScale()),
+                                  scaleCoordinate(point.y, scalePoint->GetYScale()),
+                                  scaleCoordinate(point.z, scalePoint->GetZScale()) };
+            return compile(module.GetSourceModule(0), scaled);
+        }
+        if (auto translatePoint = dynamic_cast<const TranslatePoint*>(&module)) {
+            NoisePoint translated = { offsetCoordinate(point.x, translatePoint->GetXTranslation()),
+                                      offsetCoordinate(point.y, translatePoint->GetYTranslation()),
+                                      offsetCoordinate(point.z, translatePoint->GetZTranslation()) };
+            return compile(module.GetSourceModule(0), translated);
+        }
+        if (dynamic_cast<const Displace*>(&module)) {
+            NoisePoint displaced = { displaceCoordinate(point.x, compile(module.GetSourceModule(1), point)),
+                                     displaceCoordinate(point.y, compile(module.GetSourceModule(2), point)),
+                                     displaceCoordinate(point.z, compile(module.GetSourceModule(3), point)) };
+            return compile(module.GetSourceModule(0), displaced);
+        }
+        if (auto turbulence = dynamic_cast<const Turbulence*>(&module)) {
+            return compile(module.GetSourceModule(0), compileTurbulence(*turbulence, point));
+        }
+
+        // Anything else (Curve, Terrace, Voronoi, ...) keeps its virtual call
+        program.fallbacks++;
+        return emitAt(NOISE_MODULE, module, point);
+    }
+
+    // Same as Turbulence::GetValue: every coordinate is moved by a Perlin
+    // generator of its own, sampled at slightly offset points
+    NoisePoint compileTurbulence(const Turbulence& turbulence, NoisePoint point)
+    {
+        static const double offsets[3][3] = {
+            { 12414.0 / 65536.0, 65124.0 / 65536.0, 31337.0 / 65536.0 },
+            { 26519.0 / 65536.0, 18128.0 / 65536.0, 60493.0 / 65536.0 },
+            { 53820.0 / 65536.0, 11213.0 / 65536.0, 44845.0 / 65536.0 }
+        };
+
+        int coordinates[3] = { point.x, point.y, point.z };
+        int distorted[3];
+        for (int axis = 0; axis < 3; axis++) {
+            std::shared_ptr<Perlin> generator = std::make_shared<Perlin>();
+            generator->SetFrequency(turbulence.GetFrequency());
+            generator->SetOctaveCount(turbulence.GetRoughnessCount());
+            generator->SetSeed(turbulence.GetSeed() + axis);
+            program.turbulenceGenerators.push_back(generator);
+
+            NoisePoint offsetPoint = { offsetCoordinate(point.x, offsets[axis][0]),
+                                       offsetCoordinate(point.y, offsets[axis][1]),
+                                       offsetCoordinate(point.z, offsets[axis][2]) };
+            int distortion = emitAt(NOISE_PERLIN, *generator, offsetPoint);
+            distortion = emit(NOISE_SCALE_BIAS, distortion, -1, -1, (float) turbulence.GetPower(), 0.f);
+            distorted[axis] = displaceCoordinate(coordinates[axis], distortion);
+        }
+
+        NoisePoint result = { distorted[0], distorted[1], distorted[2] };
+        return result;
+    }
+};
+
+NoiseProgram compileNoiseGraph(const Module& root, bool planar)
+{
+    NoiseProgram program;
+    program.planar = planar;
+    program.numRegisters = 3; // the input points
+
+    NoiseGraphCompiler compiler = { program, {} };
+    NoisePoint input = { 0, planar ? -1 : 1, 2 };
+    program.output = compiler.compile(root, input);
+    return program;
+}
+
+
+static float sCurve3(float a)
+{
+    return a * a * (3.f - 2.f * a);
+}
+
+static float linearInterp(float n0, float n1, float a)
+{
+    return (1.f - a) * n0 + a * n1;
+}
+
+// Select::GetValue for one point
+static float selectValue(float value0, float value1, float control, float lowerBound, float upperBound, float edgeFalloff)
+{
+    if (edgeFalloff > 0.f) {
+        if (control < lowerBound - edgeFalloff) {
+            return value0;
+        } else if (control < lowerBound + edgeFalloff) {
+            float alpha = sCurve3((control - (lowerBound - edgeFalloff)) / (2.f * edgeFalloff));
+            return linearInterp(value0, value1, alpha);
+        } else if (control < upperBound - edgeFalloff) {
+            return value1;
+        } else if (control < upperBound + edgeFalloff) {
+            float alpha = sCurve3((control - (upperBound - edgeFalloff)) / (2.f * edgeFalloff));
+            return linearInterp(value1, value0, alpha);
+        } else {
+            return value0;
+        }
+    }
+    return (control < lowerBound || control > upperBound) ? value0 : value1;
+}
+
+void evaluateNoiseProgram(const NoiseProgram& program, const float* xs, const float* ys, const float* zs, float* out, size_t n)
+{
+    std::vector<float> registers((size_t) program.numRegisters * NOISE_BLOCK_SIZE);
+    auto reg = [&](int index) { return &registers[(size_t) index * NOISE_BLOCK_SIZE]; };
+
+    for (size_t first = 0; first < n; first += NOISE_BLOCK_SIZE) {
+        int count = (int) std::min((size_t) NOISE_BLOCK_SIZE, n - first);
+
+        std::copy(xs + first, xs + first + count, reg(0));
+        if (!program.planar) std::copy(ys + first, ys + first + count, reg(1));
+        std::copy(zs + first, zs + first + count, reg(2));
+
+        for (const NoiseInstruction& instruction : program.instructions) {
+            float* result = reg(instruction.result);
+            const float* a = instruction.args[0] >= 0 ? reg(instruction.args[0]) : nullptr;
+            const float* b = instruction.args[1] >= 0 ? reg(instruction.args[1]) : nullptr;
+            const float* c = instruction.args[2] >= 0 ? reg(instruction.args[2]) : nullptr;
+            const float* px = instruction.point[0] >= 0 ? reg(instruction.point[0]) : nullptr;
+            const float* py = instruction.point[1] >= 0 ? reg(instruction.point[1]) : nullptr;
+            const float* pz = instruction.point[2] >= 0 ? reg(instruction.point[2]) : nullptr;
+            const float* params = instruction.params;
+
+            switch (instruction.op) {
+                case NOISE_CONST:
+                    std::fill(result, result + count, params[0]);
+                    break;
+                case NOISE_PERLIN: {
+                    const Perlin& generator = static_cast<const Perlin&>(*instruction.module);
+                    if (py) getPerlinValues(generator, px, py, pz, result, count);
+                    else getValues2D(generator, px, pz, result, count);
+                    break;
+                }
+                case NOISE_BILLOW: {
+                    const Billow& generator = static_cast<const Billow&>(*instruction.module);
+                    if (py) getBillowValues(generator, px, py, pz, result, count);
+                    else getValues2D(generator, px, pz, result, count);
+                    break;
+                }
+                case NOISE_RIDGED: {
+                    const RidgedMulti& generator = static_cast<const RidgedMulti&>(*instruction.module);
+                    if (py) getRidgedMultiValues(generator, px, py, pz, result, count);
+                    else getValues2D(generator, px, pz, result, count);
+                    break;
+                }
+                case NOISE_MODULE:
+                    for (int k = 0; k < count; k++) {
+                        result[k] = (float) instruction.module->GetValue(px ? px[k] : 0.0, py ? py[k] : 0.0, pz ? pz[k] : 0.0);
+                    }
+                    break;
+                case NOISE_ABS:
+                    for (int k = 0; k < count; k++) result[k] = std::abs(a[k]);
+                    break;
+                case NOISE_INVERT:
+                    for (int k = 0; k < count; k++) result[k] = -a[k];
+                    break;
+                case NOISE_SCALE_BIAS:
+                    for (int k = 0; k < count; k++) result[k] = a[k] * params[0] + params[1];
+                    break;
+                case NOISE_CLAMP:
+                    for (int k = 0; k < count; k++) result[k] = a[k] < params[0] ? params[0] : (a[k] > params[1] ? params[1] : a[k]);
+                    break;
+                case NOISE_EXPONENT:
+                    for (int k = 0; k < count; k++) result[k] = std::pow(std::abs((a[k] + 1.f) / 2.f), params[0]) * 2.f - 1.f;
+                    break;
+                case NOISE_ADD:
+                    for (int k = 0; k < count; k++) result[k] = a[k] + b[k];
+                    break;
+                case NOISE_MULTIPLY:
+                    for (int k = 0; k < count; k++) result[k] = a[k] * b[k];
+                    break;
+                case NOISE_MIN:
+                    for (int k = 0; k < count; k++) result[k] = std::min(a[k], b[k]);
+                    break;
+                case NOISE_MAX:
+                    for (int k = 0; k < count; k++) result[k] = std::max(a[k], b[k]);
+                    break;
+                case NOISE_POWER:
+                    for (int k = 0; k < count; k++) result[k] = std::pow(a[k], b[k]);
+                    break;
+                case NOISE_BLEND:
+                    for (int k = 0; k < count; k++) result[k] = linearInterp(a[k], b[k], (c[k] + 1.f) / 2.f);
+                    break;
+                case NOISE_SELECT:
+                    for (int k = 0; k < count; k++) result[k] = selectValue(a[k], b[k], c[k], params[0], params[1], params[2]);
+                    break;
+            }
+        }
+
+        std::copy(reg(program.output), reg(program.output) + count, out + first);
+    }
+}
+
+
+void benchmarkNoiseGraph(const Perlin& perlinGenerator)
+{
+    // Mountains and plains picked by a low frequency control, with the
+    // border roughened by turbulence
+    RidgedMulti mountains;
+    Billow plainsBase;
+    plainsBase.SetFrequency(2.0);
+    ScaleBias plains;
+    plains.SetSourceModule(0, plainsBase);
+    plains.SetScale(0.125);
+    plains.SetBias(-0.75);
+
+    Select terrainType;
+    terrainType.SetSourceModule(0, plains);
+    terrainType.SetSourceModule(1, mountains);
+    terrainType.SetControlModule(perlinGenerator);
+    terrainType.SetBounds(0.0, 1000.0);
+    terrainType.SetEdgeFalloff(0.125);
+
+    Turbulence biomes;
+    biomes.SetSourceModule(0, terrainType);
+    biomes.SetFrequency(4.0);
+    biomes.SetPower(0.125);
+
+    const int side = 128;
+    const size_t numPoints = (size_t) side * side;
+    std::vector<float> xs(numPoints), ys(numPoints, 0.f), zs(numPoints);
+    for (size_t k = 0; k < numPoints; k++) {
+        xs[k] = (k / side) * 4.f / side;
+        zs[k] = (k % side) * 4.f / side;
+    }
+
+    std::cout << "Noise graph (Turbulence > Select > RidgedMulti, ScaleBias > Billow, Perlin), " << numPoints << " points" << std::endl;
+
+    std::vector<float> reference(numPoints), compiled(numPoints);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < numPoints; k++) {
+        reference[k] = (float) biomes.GetValue(xs[k], ys[k], zs[k]);
+    }
+    double referenceNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / numPoints;
+    std::cout << "  Module::GetValue " << referenceNs << " ns/sample" << std::endl;
+
+    for (int planar = 0; planar < 2; planar++) {
+        NoiseProgram program = compileNoiseGraph(biomes, planar == 1);
+
+        start = std::chrono::steady_clock::now();
+        evaluateNoiseProgram(program, xs.data(), ys.data(), zs.data(), compiled.data(), numPoints);
+        double compiledNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / numPoints;
+
+        float maxError = 0.f;
+        for (size_t k = 0; k < numPoints; k++) {
+            maxError = std::max(maxError, std::abs(compiled[k] - reference[k]));
+        }
+        std::cout << "  compiled" << (planar ? " planar" : "") << " (" << program.instructions.size() << " instructions, "
+                  << program.fallbacks << " fallbacks) " << compiledNs << " ns/sample, x" << referenceNs / compiledNs
+                  << ", largest difference " << maxError << std::endl;
+    }
+}
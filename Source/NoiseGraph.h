@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <noise/noise.h> // used for the Perlin noise generation
+
+// Points evaluated per instruction, small enough for all registers of a
+// program to stay in the cache
+const int NOISE_BLOCK_SIZE = 256;
+
+enum NoiseOp
+{
+    NOISE_CONST,      // params[0]
+    NOISE_PERLIN,     // generators, batched and vectorised (NoiseBatch.h)
+    NOISE_BILLOW,
+    NOISE_RIDGED,
+    NOISE_MODULE,     // any other module, through its virtual GetValue per point
+    NOISE_ABS,
+    NOISE_INVERT,
+    NOISE_SCALE_BIAS, // args[0] * params[0] + params[1]
+    NOISE_CLAMP,      // between params[0] and params[1]
+    NOISE_EXPONENT,   // exponent params[0]
+    NOISE_ADD,
+    NOISE_MULTIPLY,
+    NOISE_MIN,
+    NOISE_MAX,
+    NOISE_POWER,
+    NOISE_BLEND,      // args[0] to args[1], controlled by args[2]
+    NOISE_SELECT      // args[0] or args[1] by args[2], bounds params[0], params[1], edge falloff params[2]
+};
+
+struct NoiseInstruction
+{
+    NoiseOp op;
+    int result;        // register written
+    int args[3];       // registers read, -1 when unused
+    int point[3];      // x, y and z registers of generators and modules, -1 for a coordinate that is 0
+    float params[3];
+    const noise::module::Module* module = nullptr; // generator or module to evaluate
+};
+
+// A tree of libnoise modules flattened into a list of instructions, each
+// running on a block of points at once. Point transforms (ScalePoint,
+// TranslatePoint, Displace, Turbulence) become instructions on coordinate
+// registers, modules used more than once at the same points are evaluated
+// once and modules without an instruction of their own are still evaluated,
+// just through GetValue.
+//
+// The program points into the module tree, which has to outlive it, and
+// copies the module parameters: compile again after changing them.
+struct NoiseProgram
+{
+    std::vector<NoiseInstruction> instructions;
+    int numRegisters = 0;
+    int output = -1;
+    bool planar = false;   // the input points all have y = 0
+    size_t fallbacks = 0;  // NOISE_MODULE instructions
+
+    // Distortion generators of the Turbulence modules, which libnoise keeps private
+    std::vector<std::shared_ptr<noise::module::Perlin>> turbulenceGenerators;
+};
+
+// With 'planar' set the program only takes x and z, which lets the generators
+// use the cheaper 2D noise for as long as no transform moves the points off
+// the y = 0 plane
+NoiseProgram compileNoiseGraph(const noise::module::Module& root, bool planar = false);
+
+// out[k] = root.GetValue(xs[k], ys[k], zs[k]) for k < n, within the precision
+// of NoiseBatch.h. ys is ignored (and may be null) for planar programs.
+void evaluateNoiseProgram(const NoiseProgram& program, const float* xs, const float* ys, const float* zs, float* out, size_t n);
+
+// Prints ns/sample of a biome-like module graph evaluated through GetValue
+// against its compiled program, no window needed
+void benchmarkNoiseGraph(const noise::module::Perlin& perlinGenerator);
@@ -0,0 +1,446 @@
+#include "ObjParser.h"
+#include "MappedFile.h"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+// Smallest chunk handed to a worker, smaller files are parsed on one thread
+const size_t OBJ_MIN_CHUNK_BYTES = 64 * 1024;
+
+// Records that change how the faces after them are grouped into shapes,
+// applied in file order when the chunks are merged
+struct ObjEvent
+{
+    enum Type { USEMTL, MTLLIB, GROUP, OBJECT };
+    Type type;
+    size_t face;        // number of faces of the chunk before the record
+    std::string text;   // material, file list or shape name
+};
+
+struct ObjChunk
+{
+    std::vector<tinyobj::real_t> v, vn, vt;
+    std::vector<tinyobj::index_t> corners;
+    std::vector<unsigned char> faceSizes;
+    std::vector<ObjEvent> events;
+
+    // Corners with a negative (relative) index, resolved against the counts
+    // of this chunk only, still missing the counts of the chunks before it
+    std::vector<size_t> relativeV, relativeVn, relativeVt;
+
+    bool hasTags = false;
+};
+
+// parseTriple of tinyobjloader without resolving the indices, INT_MIN for
+// the ones that are not there
+static void parseRawTriple(const char** token, int raw[3])
+{
+    raw[0] = atoi(*token);
+    raw[1] = raw[2] = INT_MIN;
+    (*token) += strcspn(*token, "/ \t\r");
+    if ((*token)[0] != '/') return;
+    (*token)++;
+
+    // i//k
+    if ((*token)[0] == '/') {
+        (*token)++;
+        raw[2] = atoi(*token);
+        (*token) += strcspn(*token, "/ \t\r");
+        return;
+    }
+
+    // i/j/k or i/j
+    raw[1] = atoi(*token);
+    (*token) += strcspn(*token, "/ \t\r");
+    if ((*token)[0] != '/') return;
+
+    (*token)++;
+    raw[2] = atoi(*token);
+    (*token) += strcspn(*token, "/ \t\r");
+}
+
+// Same as tinyobj fixIndex for the absolute indices. Relative ones are
+// resolved against the local count and recorded to be offset later.
+static int resolveIndex(int raw, size_t localCount, size_t corner, std::vector<size_t>& relative)
+{
+    if (raw == INT_MIN) return -1;
+    if (raw > 0) return raw - 1;
+    if (raw == 0) return 0;
+    relative.push_back(corner);
+    return (int) localCount + raw;
+}
+
+// The per-line logic of tinyobj::LoadObj, on the lines in [begin, end)
+static void parseObjChunk(const char* begin, const char* end, ObjChunk& chunk)
+{
+    std::string linebuf;
+    const char* line = begin;
+    while (line < end) {
+        const char* lineEnd = (const char*) memchr(line, '\n', end - line);
+        if (!lineEnd) lineEnd = end;
+        linebuf.assign(line, lineEnd);
+        line = lineEnd + 1;
+
+        if (!linebuf.empty() && linebuf[linebuf.size() - 1] == '\r') linebuf.erase(linebuf.size() - 1);
+        if (linebuf.empty()) continue;
+
+        const char* token = linebuf.c_str();
+        token += strspn(token, " \t");
+        if (token[0] == '\0' || token[0] == '#') continue;
+
+        if (token[0] == 'v' && IS_SPACE(token[1])) {
+            token += 2;
+            tinyobj::real_t x, y, z;
+            tinyobj::parseReal3(&x, &y, &z, &token);
+            chunk.v.push_back(x);
+            chunk.v.push_back(y);
+            chunk.v.push_back(z);
+            continue;
+        }
+
+        if (token[0] == 'v' && token[1] == 'n' && IS_SPACE(token[2])) {
+            token += 3;
+            tinyobj::real_t x, y, z;
+            tinyobj::parseReal3(&x, &y, &z, &token);
+            chunk.vn.push_back(x);
+            chunk.vn.push_back(y);
+            chunk.vn.push_back(z);
+            continue;
+        }
+
+        if (token[0] == 'v' && token[1] == 't' && IS_SPACE(token[2])) {
+            token += 3;
+            tinyobj::real_t x, y;
+            tinyobj::parseReal2(&x, &y, &token);
+            chunk.vt.push_back(x);
+            chunk.vt.push_back(y);
+            continue;
+        }
+
+        if (token[0] == 'f' && IS_SPACE(token[1])) {
+            token += 2;
+            token += strspn(token, " \t");
+
+            size_t faceSize = 0;
+            while (!IS_NEW_LINE(token[0])) {
+                int raw[3];
+                parseRawTriple(&token, raw);
+
+                size_t corner = chunk.corners.size();
+                tinyobj::index_t index;
+                index.vertex_index = resolveIndex(raw[0], chunk.v.size() / 3, corner, chunk.relativeV);
+                index.texcoord_index = resolveIndex(raw[1], chunk.vt.size() / 2, corner, chunk.relativeVt);
+                index.normal_index = resolveIndex(raw[2], chunk.vn.size() / 3, corner, chunk.relativeVn);
+                chunk.corners.push_back(index);
+                faceSize++;
+
+                token += strspn(token, " \t\r");
+            }
+            chunk.faceSizes.push_back((unsigned char) faceSize);
+            continue;
+        }
+
+        ObjEvent event;
+        event.face = chunk.faceSizes.size();
+
+        if (0 == strncmp(token, "usemtl", 6) && IS_SPACE(token[6])) {
+            char namebuf[TINYOBJ_SSCANF_BUFFER_SIZE];
+            namebuf[0] = '\0';
+            std::sscanf(token + 7, "%s", namebuf);
+            event.type = ObjEvent::USEMTL;
+            event.text = namebuf;
+            chunk.events.push_back(event);
+            continue;
+        }
+
+        if (0 == strncmp(token, "mtllib", 6) && IS_SPACE(token[6])) {
+            event.type = ObjEvent::MTLLIB;
+            event.text = token + 7;
+            chunk.events.push_back(event);
+            continue;
+        }
+
+        if (token[0] == 'g' && IS_SPACE(token[1])) {
+            std::vector<std::string> names;
+            while (!IS_NEW_LINE(token[0])) {
+                names.push_back(tinyobj::parseString(&token));
+                token += strspn(token, " \t\r");
+            }
+            // names[0] is the 'g' itself
+            event.type = ObjEvent::GROUP;
+            event.text = names.size() > 1 ? names[1] : "";
+            chunk.events.push_back(event);
+            continue;
+        }
+
+        if (token[0] == 'o' && IS_SPACE(token[1])) {
+            char namebuf[TINYOBJ_SSCANF_BUFFER_SIZE];
+            namebuf[0] = '\0';
+            std::sscanf(token + 2, "%s", namebuf);
+            event.type = ObjEvent::OBJECT;
+            event.text = namebuf;
+            chunk.events.push_back(event);
+            continue;
+        }
+
+        if (token[0] == 't' && IS_SPACE(token[1])) {
+            chunk.hasTags = true;
+        }
+
+        // Ignore unknown command.
+    }
+}
+
+// Splits [data, data + size) into about 'count' pieces that end after a '\n'
+static std::vector<const char*> splitAtLines(const char* data, size_t size, size_t count)
+{
+    std::vector<const char*> bounds(1, data);
+    const char* end = data + size;
+    for (size_t k = 1; k < count; k++) {
+        const char* target = data + size * k / count;
+        if (target <= bounds.back()) continue;
+        const char* newline = (const char*) memchr(target, '\n', end - target);
+        if (!newline || newline + 1 >= end) break;
+        bounds.push_back(newline + 1);
+    }
+    bounds.push_back(end);
+    return bounds;
+}
+
+bool loadObjParallel(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+                     std::vector<tinyobj::material_t>* materials, std::string* err,
+                     const char* filename, const char* mtlBaseDir, bool triangulate, ThreadPool& pool)
+{
+    MappedFile file;
+    if (!file.open(filename)) {
+        // Missing or empty file, LoadObj reports it the usual way
+        return tinyobj::LoadObj(attrib, shapes, materials, err, filename, mtlBaseDir, triangulate);
+    }
+
+    const char* data = (const char*) file.data();
+    size_t numChunks = std::max<size_t>(1, std::min<size_t>(pool.size() * 4, file.size() / OBJ_MIN_CHUNK_BYTES));
+    std::vector<const char*> bounds = splitAtLines(data, file.size(), numChunks);
+    numChunks = bounds.size() - 1;
+
+    std::vector<ObjChunk> chunks(numChunks);
+    pool.parallelFor((int) numChunks, [&](int c) {
+        parseObjChunk(bounds[c], bounds[c + 1], chunks[c]);
+    });
+
+    for (const ObjChunk& chunk : chunks) {
+        if (chunk.hasTags) {
+            file.close();
+            return tinyobj::LoadObj(attrib, shapes, materials, err, filename, mtlBaseDir, triangulate);
+        }
+    }
+
+    // Attribute arrays: concatenated, the relative indices get the counts of the chunks before
+    std::vector<size_t> vOffset(numChunks + 1, 0), vnOffset(numChunks + 1, 0), vtOffset(numChunks + 1, 0);
+    for (size_t c = 0; c < numChunks; c++) {
+        vOffset[c + 1] = vOffset[c] + chunks[c].v.size();
+        vnOffset[c + 1] = vnOffset[c] + chunks[c].vn.size();
+        vtOffset[c + 1] = vtOffset[c] + chunks[c].vt.size();
+    }
+    attrib->vertices.resize(vOffset[numChunks]);
+    attrib->normals.resize(vnOffset[numChunks]);
+    attrib->texcoords.resize(vtOffset[numChunks]);
+
+    pool.parallelFor((int) numChunks, [&](int c) {
+        ObjChunk& chunk = chunks[c];
+        std::copy(chunk.v.begin(), chunk.v.end(), attrib->vertices.begin() + vOffset[c]);
+        std::copy(chunk.vn.begin(), chunk.vn.end(), attrib->normals.begin() + vnOffset[c]);
+        std::copy(chunk.vt.begin(), chunk.vt.end(), attrib->texcoords.begin() + vtOffset[c]);
+        for (size_t corner : chunk.relativeV) chunk.corners[corner].vertex_index += (int) (vOffset[c] / 3);
+        for (size_t corner : chunk.relativeVn) chunk.corners[corner].normal_index += (int) (vnOffset[c] / 3);
+        for (size_t corner : chunk.relativeVt) chunk.corners[corner].texcoord_index += (int) (vtOffset[c] / 2);
+    });
+
+    // Shapes: the state machine of LoadObj, with the faces between two
+    // records as the face group
+    shapes->clear();
+    std::string baseDir = mtlBaseDir ? mtlBaseDir : "";
+    tinyobj::MaterialFileReader materialReader(baseDir);
+    std::map<std::string, int> materialMap;
+    int material = -1;
+    std::string name;
+    tinyobj::shape_t shape;
+
+    struct FaceRange { size_t chunk, firstFace, lastFace, firstCorner; };
+    std::vector<FaceRange> faceGroup;
+
+    auto exportFaceGroup = [&]() {
+        if (faceGroup.empty()) return false;
+        for (const FaceRange& range : faceGroup) {
+            const ObjChunk& chunk = chunks[range.chunk];
+            size_t corner = range.firstCorner;
+            for (size_t f = range.firstFace; f < range.lastFace; f++) {
+                size_t faceSize = chunk.faceSizes[f];
+                const tinyobj::index_t* face = &chunk.corners[corner];
+                if (triangulate) {
+                    // Polygon -> triangle fan conversion
+                    for (size_t k = 2; k < faceSize; k++) {
+                        shape.mesh.indices.push_back(face[0]);
+                        shape.mesh.indices.push_back(face[k - 1]);
+                        shape.mesh.indices.push_back(face[k]);
+                        shape.mesh.num_face_vertices.push_back(3);
+                        shape.mesh.material_ids.push_back(material);
+                    }
+                } else {
+                    shape.mesh.indices.insert(shape.mesh.indices.end(), face, face + faceSize);
+                    shape.mesh.num_face_vertices.push_back((unsigned char) faceSize);
+                    shape.mesh.material_ids.push_back(material);
+                }
+                corner += faceSize;
+            }
+        }
+        shape.name = name;
+        faceGroup.clear();
+        return true;
+    };
+
+    for (size_t c = 0; c < numChunks; c++) {
+        const ObjChunk& chunk = chunks[c];
+        size_t face = 0, corner = 0;
+        auto addFaces = [&](size_t lastFace) {
+            if (lastFace == face) return;
+            FaceRange range = { c, face, lastFace, corner };
+            faceGroup.push_back(range);
+            for (; face < lastFace; face++) corner += chunk.faceSizes[face];
+        };
+
+        for (const ObjEvent& event : chunk.events) {
+            addFaces(event.face);
+
+            if (event.type == ObjEvent::USEMTL) {
+                auto found = materialMap.find(event.text);
+                int newMaterialId = found != materialMap.end() ? found->second : -1;
+                if (newMaterialId != material) {
+                    exportFaceGroup();
+                    material = newMaterialId;
+                }
+            } else if (event.type == ObjEvent::MTLLIB) {
+                std::vector<std::string> filenames;
+                tinyobj::SplitString(event.text, ' ', filenames);
+                if (filenames.empty()) {
+                    if (err) (*err) += "WARN: Looks like empty filename for mtllib. Use default material. \n";
+                    continue;
+                }
+                bool found = false;
+                for (const std::string& materialFile : filenames) {
+                    std::string materialErr;
+                    bool ok = materialReader(materialFile.c_str(), materials, &materialMap, &materialErr);
+                    if (err && !materialErr.empty()) (*err) += materialErr;
+                    if (ok) {
+                        found = true;
+                        break;
+                    }
+                }
+                if (!found && err) (*err) += "WARN: Failed to load material file(s). Use default material.\n";
+            } else {
+                if (exportFaceGroup()) shapes->push_back(shape);
+                shape = tinyobj::shape_t();
+                name = event.text;
+            }
+        }
+        addFaces(chunk.faceSizes.size());
+    }
+
+    bool exported = exportFaceGroup();
+    if (exported || shape.mesh.indices.size()) {
+        shapes->push_back(shape);
+    }
+    return true;
+}
+
+void initObjMaterial(tinyobj::material_t* material)
+{
+    tinyobj::InitMaterial(material);
+}
+
+static bool sameObj(const tinyobj::attrib_t& a, const std::vector<tinyobj::shape_t>& shapesA, const std::vector<tinyobj::material_t>& materialsA,
+                    const tinyobj::attrib_t& b, const std::vector<tinyobj::shape_t>& shapesB, const std::vector<tinyobj::material_t>& materialsB)
+{
+    if (a.vertices != b.vertices || a.normals != b.normals || a.texcoords != b.texcoords) return false;
+    if (shapesA.size() != shapesB.size() || materialsA.size() != materialsB.size()) return false;
+    for (size_t s = 0; s < shapesA.size(); s++) {
+        const tinyobj::mesh_t& meshA = shapesA[s].mesh;
+        const tinyobj::mesh_t& meshB = shapesB[s].mesh;
+        if (shapesA[s].name != shapesB[s].name || meshA.indices.size() != meshB.indices.size()
+            || meshA.num_face_vertices != meshB.num_face_vertices || meshA.material_ids != meshB.material_ids) return false;
+        for (size_t k = 0; k < meshA.indices.size(); k++) {
+            if (meshA.indices[k].vertex_index != meshB.indices[k].vertex_index
+                || meshA.indices[k].normal_index != meshB.indices[k].normal_index
+                || meshA.indices[k].texcoord_index != meshB.indices[k].texcoord_index) return false;
+        }
+    }
+    for (size_t m = 0; m < materialsA.size(); m++) {
+        if (materialsA[m].name != materialsB[m].name) return false;
+    }
+    return true;
+}
+
+static std::string directoryOf(const std::string& path)
+{
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string("./") : path.substr(0, slash + 1);
+}
+
+void benchmarkObjParser(const std::vector<std::string>& files)
+{
+    auto parseAll = [&](const std::function<void(const std::string&, tinyobj::attrib_t&, std::vector<tinyobj::shape_t>&,
+                                                  std::vector<tinyobj::material_t>&)>& parse) {
+        auto start = std::chrono::steady_clock::now();
+        for (const std::string& path : files) {
+            tinyobj::attrib_t attrib;
+            std::vector<tinyobj::shape_t> shapes;
+            std::vector<tinyobj::material_t> materials;
+            parse(path, attrib, shapes, materials);
+        }
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    bool identical = true;
+    for (const std::string& path : files) {
+        tinyobj::attrib_t attribA, attribB;
+        std::vector<tinyobj::shape_t> shapesA, shapesB;
+        std::vector<tinyobj::material_t> materialsA, materialsB;
+        std::string err;
+        tinyobj::LoadObj(&attribA, &shapesA, &materialsA, &err, path.c_str(), directoryOf(path).c_str());
+        loadObjParallel(&attribB, &shapesB, &materialsB, &err, path.c_str(), directoryOf(path).c_str());
+        if (!sameObj(attribA, shapesA, materialsA, attribB, shapesB, materialsB)) {
+            std::cout << "Results differ from tinyobj::LoadObj for " << path << std::endl;
+            identical = false;
+        }
+    }
+
+    double tinyobjMs = parseAll([](const std::string& path, tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes,
+                                   std::vector<tinyobj::material_t>& materials) {
+        std::string err;
+        tinyobj::LoadObj(&attrib, &shapes, &materials, &err, path.c_str(), directoryOf(path).c_str());
+    });
+    std::cout << "Parsing " << files.size() << " OBJ files: tinyobj::LoadObj " << tinyobjMs << " ms" << std::endl;
+
+    unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    double oneThreadMs = 0;
+    for (unsigned int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        ThreadPool pool(threads);
+        double ms = parseAll([&](const std::string& path, tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes,
+                                 std::vector<tinyobj::material_t>& materials) {
+            std::string err;
+            loadObjParallel(&attrib, &shapes, &materials, &err, path.c_str(), directoryOf(path).c_str(), true, pool);
+        });
+        if (threads == 1) oneThreadMs = ms;
+        std::cout << "  loadObjParallel, " << threads << " threads: " << ms << " ms ("
+                  << tinyobjMs / ms << "x tinyobj, " << oneThreadMs / ms << "x 1 thread)" << std::endl;
+        if (threads == maxThreads) break;
+    }
+    std::cout << (identical ? "Results identical to tinyobj::LoadObj" : "Results DIFFER from tinyobj::LoadObj") << std::endl;
+}
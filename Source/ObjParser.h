@@ -0,0 +1,26 @@
+#pragma once
+#include "ThreadPool.h"
+#include "tiny_obj_loader.h"
+
+#include <string>
+#include <vector>
+
+// Multithreaded version of tinyobj::LoadObj with the same arguments and
+// results. The file is mapped, split into chunks at line boundaries and the
+// v/vn/vt/f records of the chunks are parsed in parallel (with the number
+// parsing of tinyobjloader, so the values are bit-identical). The chunks are
+// then merged in file order, where usemtl, mtllib, g and o are applied like
+// LoadObj does.
+//
+// Files with subdivision tags ('t') are passed on to tinyobj::LoadObj.
+bool loadObjParallel(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+                     std::vector<tinyobj::material_t>* materials, std::string* err,
+                     const char* filename, const char* mtlBaseDir = nullptr, bool triangulate = true,
+                     ThreadPool& pool = ThreadPool::shared());
+
+// The material tinyobjloader uses for faces without one
+void initObjMaterial(tinyobj::material_t* material);
+
+// Prints the time of tinyobj::LoadObj and of loadObjParallel on 1, 2, 4, ...
+// threads for the given files, and whether both give the same results
+void benchmarkObjParser(const std::vector<std::string>& files);
@@ -0,0 +1,303 @@
+#include "ResourceArchive.h"
+#include "Hash.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <dirent.h>
+#endif
+
+const char ARCHIVE_MAGIC[4] = { 'P', 'A', 'C', 'K' };
+
+struct ArchiveHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t entryCount;
+    uint64_t tocOffset;      // from the start of the file
+    uint64_t fileSize;
+    uint64_t tocChecksum;
+};
+
+struct ArchiveEntry
+{
+    char name[ARCHIVE_MAX_NAME + 1];
+    uint64_t offset;         // from the start of the file
+    uint64_t size;
+    uint64_t checksum;
+};
+
+struct MountedArchive
+{
+    MappedFile file;
+    const ArchiveEntry* entries = nullptr;
+    size_t entryCount = 0;
+
+    // Per entry: 0 until its first lookup checksums it, then 1 or -1 when corrupt
+    std::unique_ptr<std::atomic<int>[]> verified;
+};
+
+// Never destroyed, like the blobs handed out, which may be used until exit
+static MountedArchive& mountedArchive()
+{
+    static MountedArchive* archive = new MountedArchive();
+    return *archive;
+}
+
+// "./Resources\\mars.mesh" -> "Resources/mars.mesh"
+static std::string archiveName(std::string name)
+{
+    std::replace(name.begin(), name.end(), '\\', '/');
+    while (name.compare(0, 2, "./") == 0) name.erase(0, 2);
+    return name;
+}
+
+bool mountArchive(const std::string& path)
+{
+    MountedArchive& archive = mountedArchive();
+    unmountArchive();
+    if (!archive.file.open(path)) return false;
+
+    ArchiveHeader header;
+    if (archive.file.size() < sizeof(header)) {
+        std::cerr << path << " is truncated, using the loose files" << std::endl;
+        archive.file.close();
+        return false;
+    }
+    std::memcpy(&header, archive.file.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0 || header.version != ARCHIVE_VERSION) {
+        std::cerr << path << " is from another version, using the loose files" << std::endl;
+        archive.file.close();
+        return false;
+    }
+
+    uint64_t tocBytes = header.entryCount * sizeof(ArchiveEntry);
+    if (header.fileSize != archive.file.size() || header.tocOffset % ARCHIVE_ALIGNMENT != 0
+        || header.tocOffset > header.fileSize || tocBytes > header.fileSize - header.tocOffset) {
+        std::cerr << path << " is corrupt (bad sizes), using the loose files" << std::endl;
+        archive.file.close();
+        return false;
+    }
+
+    const unsigned char* toc = archive.file.data() + header.tocOffset;
+    if (hashBytes(toc, (size_t) tocBytes) != header.tocChecksum) {
+        std::cerr << path << " is corrupt (checksum mismatch), using the loose files" << std::endl;
+        archive.file.close();
+        return false;
+    }
+
+    const ArchiveEntry* entries = (const ArchiveEntry*) toc;
+    for (uint64_t e = 0; e < header.entryCount; e++) {
+        if (entries[e].offset > header.tocOffset || entries[e].size > header.tocOffset - entries[e].offset
+            || entries[e].name[ARCHIVE_MAX_NAME] != '\0') {
+            std::cerr << path << " is corrupt (bad entry), using the loose files" << std::endl;
+            archive.file.close();
+            return false;
+        }
+    }
+
+    archive.entries = entries;
+    archive.entryCount = (size_t) header.entryCount;
+    archive.verified.reset(new std::atomic<int>[archive.entryCount]);
+    for (size_t e = 0; e < archive.entryCount; e++) archive.verified[e] = 0;
+    std::cout << "Mounted " << path << ": " << archive.entryCount << " files, "
+              << archive.file.size() / (1024 * 1024) << " MB" << std::endl;
+    return true;
+}
+
+void unmountArchive()
+{
+    MountedArchive& archive = mountedArchive();
+    archive.entries = nullptr;
+    archive.entryCount = 0;
+    archive.verified.reset();
+    archive.file.close();
+}
+
+bool findInArchive(const std::string& name, ArchiveBlob& blob)
+{
+    const MountedArchive& archive = mountedArchive();
+    if (archive.entryCount == 0) return false;
+
+    std::string key = archiveName(name);
+    const ArchiveEntry* end = archive.entries + archive.entryCount;
+    const ArchiveEntry* entry = std::lower_bound(archive.entries, end, key, [](const ArchiveEntry& e, const std::string& k) {
+        return std::strcmp(e.name, k.c_str()) < 0;
+    });
+    if (entry == end || key != entry->name) return false;
+
+    // Workers looking the same file up at once may both checksum it, with
+    // the same result
+    const unsigned char* data = archive.file.data() + entry->offset;
+    std::atomic<int>& verified = archive.verified[entry - archive.entries];
+    if (verified == 0) verified = hashBytes(data, (size_t) entry->size) == entry->checksum ? 1 : -1;
+    if (verified < 0) {
+        std::cerr << key << " is corrupt in the archive, using the loose file" << std::endl;
+        return false;
+    }
+    blob.data = data;
+    blob.size = (size_t) entry->size;
+    blob.verified = true;
+    return true;
+}
+
+bool writeArchive(const std::string& path, const std::vector<std::pair<std::string, std::string>>& files)
+{
+    ArchiveHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    header.version = ARCHIVE_VERSION;
+
+    // Everything after the header, offsets are from the start of the file
+    std::vector<unsigned char> payload;
+    auto align = [&]() {
+        size_t position = sizeof(header) + payload.size();
+        payload.resize(payload.size() + (ARCHIVE_ALIGNMENT - position % ARCHIVE_ALIGNMENT) % ARCHIVE_ALIGNMENT, 0);
+    };
+
+    std::vector<ArchiveEntry> entries;
+    for (const auto& file : files) {
+        ArchiveEntry entry;
+        std::memset(&entry, 0, sizeof(entry));
+        std::string name = archiveName(file.first);
+        if (name.size() > ARCHIVE_MAX_NAME) {
+            std::cerr << "Name too long for the archive: " << name << std::endl;
+            return false;
+        }
+        std::memcpy(entry.name, name.c_str(), name.size());
+
+        std::ifstream in(file.second.c_str(), std::ios::binary);
+        if (!in) {
+            std::cerr << "Could not read " << file.second << std::endl;
+            return false;
+        }
+        in.seekg(0, std::ios::end);
+        std::vector<unsigned char> contents((size_t) in.tellg());
+        in.seekg(0, std::ios::beg);
+        in.read((char*) contents.data(), contents.size());
+        if (!in) {
+            std::cerr << "Could not read " << file.second << std::endl;
+            return false;
+        }
+
+        align();
+        entry.offset = sizeof(header) + payload.size();
+        entry.size = contents.size();
+        entry.checksum = hashBytes(contents.data(), contents.size());
+        payload.insert(payload.end(), contents.begin(), contents.end());
+        entries.push_back(entry);
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const ArchiveEntry& a, const ArchiveEntry& b) { return std::strcmp(a.name, b.name) < 0; });
+    for (size_t e = 1; e < entries.size(); e++) {
+        if (std::strcmp(entries[e - 1].name, entries[e].name) == 0) {
+            std::cerr << entries[e].name << " is in the archive twice" << std::endl;
+            return false;
+        }
+    }
+
+    align();
+    header.entryCount = entries.size();
+    header.tocOffset = sizeof(header) + payload.size();
+    const unsigned char* toc = (const unsigned char*) entries.data();
+    payload.insert(payload.end(), toc, toc + entries.size() * sizeof(ArchiveEntry));
+    header.tocChecksum = hashBytes(toc, entries.size() * sizeof(ArchiveEntry));
+    header.fileSize = sizeof(header) + payload.size();
+    return writeAssetFile(path, &header, sizeof(header), payload);
+}
+
+bool writeAssetFile(const std::string& path, const void* header, size_t headerBytes, const std::vector<unsigned char>& payload)
+{
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        out.write((const char*) header, headerBytes);
+        out.write((const char*) payload.data(), payload.size());
+        if (!out) {
+            std::cerr << "Could not write " << tempPath << std::endl;
+            out.close();
+            std::remove(tempPath.c_str());
+            return false;
+        }
+    }
+    std::remove(path.c_str());
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        std::cerr << "Could not write " << path << std::endl;
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool getSourceStamp(const std::string& sourcePath, uint64_t& size, int64_t& time)
+{
+    struct stat info;
+    if (stat(sourcePath.c_str(), &info) != 0) return false;
+    size = (uint64_t) info.st_size;
+    time = (int64_t) info.st_mtime;
+    return true;
+}
+
+static bool hasExtension(const std::string& path, const std::vector<std::string>& extensions)
+{
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos) return false;
+    std::string extension = path.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return std::find(extensions.begin(), extensions.end(), extension) != extensions.end();
+}
+
+static void findFilesUnsorted(const std::string& path, const std::vector<std::string>& extensions, std::vector<std::string>& files)
+{
+#if defined(_WIN32)
+    DWORD attributes = GetFileAttributesA(path.c_str());
+    if (attributes == INVALID_FILE_ATTRIBUTES) return;
+    if (!(attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        if (hasExtension(path, extensions)) files.push_back(path);
+        return;
+    }
+
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA((path + "/*").c_str(), &entry);
+    if (find == INVALID_HANDLE_VALUE) return;
+    do {
+        std::string name = entry.cFileName;
+        if (name != "." && name != "..") findFilesUnsorted(path + "/" + name, extensions, files);
+    } while (FindNextFileA(find, &entry));
+    FindClose(find);
+#else
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) return;
+    if (!S_ISDIR(info.st_mode)) {
+        if (hasExtension(path, extensions)) files.push_back(path);
+        return;
+    }
+
+    DIR* directory = opendir(path.c_str());
+    if (!directory) return;
+    while (dirent* entry = readdir(directory)) {
+        std::string name = entry->d_name;
+        if (name != "." && name != "..") findFilesUnsorted(path + "/" + name, extensions, files);
+    }
+    closedir(directory);
+#endif
+}
+
+void findFiles(const std::string& path, const std::vector<std::string>& extensions, std::vector<std::string>& files)
+{
+    findFilesUnsorted(path, extensions, files);
+    std::sort(files.begin(), files.end());
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Packed resource archive (.pak): the converted meshes, morph animations and
+// textures of the Resources folder in one file, baked by AssetBaker after
+// MeshConverter. The game maps it once at start; the loaders look their
+// files up in it by path ("Resources/mars.mesh") and read them in place,
+// falling back to the loose files for anything it does not contain.
+//
+// Layout: a header, the files (blobs) each starting at a multiple of
+// ARCHIVE_ALIGNMENT, and the table of contents, sorted by name.
+const uint32_t ARCHIVE_VERSION = 2;
+
+// Cache line aligned, more than enough for the headers and vertices read in place
+const size_t ARCHIVE_ALIGNMENT = 64;
+
+// Longest path that fits in the table of contents
+const size_t ARCHIVE_MAX_NAME = 127;
+
+struct ArchiveBlob
+{
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    bool verified = false;  // checksummed by the archive, its readers can skip their own checksum
+};
+
+// Maps the archive and validates its table of contents. The blobs stay valid
+// until unmountArchive. False (with the reason printed, unless the file is
+// just missing) when it can not be used.
+bool mountArchive(const std::string& path);
+void unmountArchive();
+
+// The blob of 'name', with its checksum verified on the first lookup only.
+// False when no archive is mounted, it does not contain the file or the file
+// is corrupt in it.
+bool findInArchive(const std::string& name, ArchiveBlob& blob);
+
+// Writes the files (pairs of name in the archive and path on disk) to an
+// archive at 'path'
+bool writeArchive(const std::string& path, const std::vector<std::pair<std::string, std::string>>& files);
+
+// Writes a header and its payload to a temporary file and renames it over
+// 'path', so a failed write never leaves a truncated file behind. Used for
+// all baked files (binary meshes, morph animations, archives).
+bool writeAssetFile(const std::string& path, const void* header, size_t headerBytes, const std::vector<unsigned char>& payload);
+
+// Size and modification time of a source file, false when it is missing. The
+// baked files store it to detect that they are out of date.
+bool getSourceStamp(const std::string& sourcePath, uint64_t& size, int64_t& time);
+
+// Files below 'path' (or 'path' itself) whose extension is one of 'extensions'
+// (lower case, with the dot), sorted
+void findFiles(const std::string& path, const std::vector<std::string>& extensions, std::vector<std::string>& files);
@@ -0,0 +1,549 @@
+#include "Terrain.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+
+#include <noise/noise.h> // used for the Perlin noise generation
+
+
+// The elevation as a graph of libnoise modules: for land three octaves of the
+// generator summed and cubed, for water a single higher frequency one.
+// Describe new kinds of terrain here, the graph is compiled into one program.
+struct ElevationGraph
+{
+    noise::module::ScalePoint octaves[3];
+    noise::module::ScaleBias weightedOctaves[3];
+    noise::module::Add partialSum, sum;
+    noise::module::Multiply square, cube;
+    noise::module::ScalePoint water;
+
+    ElevationGraph(const noise::module::Perlin& perlinGenerator)
+    {
+        static const double landFrequencies[] = { 1.0, 2.0, 4.0 };
+        static const double landWeights[] = { 1.0, 0.5, 0.25 };
+
+        for (int octave = 0; octave < 3; octave++) {
+            octaves[octave].SetSourceModule(0, perlinGenerator);
+            octaves[octave].SetScale(landFrequencies[octave]);
+            weightedOctaves[octave].SetSourceModule(0, octaves[octave]);
+            weightedOctaves[octave].SetScale(landWeights[octave]);
+        }
+        partialSum.SetSourceModule(0, weightedOctaves[0]);
+        partialSum.SetSourceModule(1, weightedOctaves[1]);
+        sum.SetSourceModule(0, partialSum);
+        sum.SetSourceModule(1, weightedOctaves[2]);
+        square.SetSourceModule(0, sum);
+        square.SetSourceModule(1, sum);
+        cube.SetSourceModule(0, square);
+        cube.SetSourceModule(1, sum);
+
+        water.SetSourceModule(0, perlinGenerator);
+        water.SetScale(6.0);
+    }
+
+    const noise::module::Module& root(bool isWater) const { return isWater ? (const noise::module::Module&) water : cube; }
+};
+
+TerrainNoise::TerrainNoise()
+{
+}
+
+TerrainNoise::~TerrainNoise()
+{
+}
+
+void TerrainNoise::init(const noise::module::Perlin& perlinGenerator, bool isWater)
+{
+    // The program points into the graph, which keeps its address on the heap
+    graph.reset(new ElevationGraph(perlinGenerator));
+    program = compileNoiseGraph(graph->root(isWater), true);
+}
+
+void TerrainNoise::getValues(const float* posX, const float* posZ, float* elevations, size_t n) const
+{
+    evaluateNoiseProgram(program, posX, nullptr, posZ, elevations, n);
+}
+
+float TerrainNoise::getValue(float posX, float posZ) const
+{
+    float elevation;
+    getValues(&posX, &posZ, &elevation, 1);
+    return elevation;
+}
+
+void getNoiseValues(const noise::module::Perlin& perlinGenerator, const float* posX, const float* posZ, bool isWater, float* elevations, size_t n){
+    TerrainNoise noise;
+    noise.init(perlinGenerator, isWater);
+    noise.getValues(posX, posZ, elevations, n);
+}
+
+float getNoiseValue(const noise::module::Perlin& perlinGenerator, float posX, float posZ, bool isWater){
+    float elevation;
+    getNoiseValues(perlinGenerator, &posX, &posZ, isWater, &elevation, 1);
+    return elevation;
+}
+
+float getHeightMapPoint(Vector3f point, const TerrainNoise& noise, float perlinSize, float scale, float heightMult){
+    float adjX = ((point.x + (scale/2))/scale)*perlinSize;
+    float adjZ = ((point.z + (scale/2))/scale)*perlinSize;
+    return heightMult * noise.getValue(adjX, adjZ);
+}
+
+
+// Exact normal of the noise surface, from central differences of its height
+float getHeightMapPoint(Vector3f point, const TerrainNoise& noise, float perlinSize, float scale, float heightMult, Vector3f& normal){
+    const float delta = 0.05f;
+    const float offsetX[5] = { 0.f, delta, -delta, 0.f, 0.f };
+    const float offsetZ[5] = { 0.f, 0.f, 0.f, delta, -delta };
+    float adjX[5], adjZ[5], values[5];
+    for (int k = 0; k < 5; k++) {
+        adjX[k] = ((point.x + offsetX[k] + (scale/2))/scale)*perlinSize;
+        adjZ[k] = ((point.z + offsetZ[k] + (scale/2))/scale)*perlinSize;
+    }
+    noise.getValues(adjX, adjZ, values, 5);
+
+    float slopeX = heightMult * (values[1] - values[2]) / (2 * delta);
+    float slopeZ = heightMult * (values[3] - values[4]) / (2 * delta);
+    normal = normalize(Vector3f(-slopeX, 1.f, -slopeZ));
+    return heightMult * values[0];
+}
+
+Vector3f WATER = Vector3f(0.2f, 0.6f, 1.f) * 0.5;
+Vector3f BEACH = Vector3f(1.f, 0.8f, 0.4f) * 0.5;
+Vector3f FOREST = Vector3f(0.f, 0.2f, 0.f) * 0.5;
+Vector3f JUNGLE = Vector3f(0.2f, 0.8f, 0.2f) * 0.5;
+Vector3f SAVANNAH = Vector3f(1.f, 0.8f, 0.f) * 0.5;
+Vector3f DESERT = Vector3f(1.f, 0.4f, 0.f) * 0.5;
+Vector3f SNOW = Vector3f(1.f, 1.f, 1.f) * 0.5;
+
+Vector3f getColor(float e, bool isWater){
+    if (!isWater){
+        if (e < 0.1) return WATER;
+        else if (e < 0.2) return BEACH;
+        else if (e < 0.3) return FOREST;
+        else if (e < 0.5) return JUNGLE;
+        else if (e < 0.7) return SAVANNAH;
+        else if (e < 0.9) return DESERT;
+        else return SNOW;
+    } else {
+        return WATER;
+    }
+}
+
+void updateMapValues(Model& model){
+    std::vector<Vector3f> updatedVertices;
+    for (std::vector<Vector3f>::iterator it = model.vertices.begin() ; it != model.vertices.end(); ++it){
+        Vector3f vertex = *it;
+        vertex.y = vertex.y ;//+ 0.005;
+        updatedVertices.push_back(vertex);
+    }
+    model.vertices = updatedVertices;
+
+    glBindVertexArray(model.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, model.vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, model.vertices.size() * sizeof(Vector3f), model.vertices.data());
+
+}
+
+
+// Evaluates the noise of all (resolution + 1)^2 grid points, TERRAIN_TILE_ROWS
+// rows per task. Sample positions are computed exactly like the cell corners
+// in buildTerrainMesh so the mesh is identical to evaluating per cell.
+Heightfield buildHeightfield(const noise::module::Perlin& perlinGenerator, float perlinSize, int resolution, bool isWater, ThreadPool& pool)
+{
+    Heightfield heightfield;
+    heightfield.resolution = resolution;
+    heightfield.samplesPerSide = resolution + 1;
+    heightfield.samplingOffset = (float) perlinSize/resolution;
+    heightfield.heights.resize(heightfield.samplesPerSide * heightfield.samplesPerSide);
+
+    int numTiles = (heightfield.samplesPerSide + TERRAIN_TILE_ROWS - 1) / TERRAIN_TILE_ROWS;
+
+    TerrainNoise noise;
+    noise.init(perlinGenerator, isWater);
+
+    pool.parallelFor(numTiles, [&](int tile) {
+        int firstRow = tile * TERRAIN_TILE_ROWS;
+        int lastRow = std::min(firstRow + TERRAIN_TILE_ROWS, heightfield.samplesPerSide);
+
+        std::vector<float> sx(heightfield.samplesPerSide), sz(heightfield.samplesPerSide);
+        for (int j = 0; j < heightfield.samplesPerSide; j++) {
+            sz[j] = j * heightfield.samplingOffset;
+        }
+
+        for (int i = firstRow; i < lastRow; i++) {
+            std::fill(sx.begin(), sx.end(), i * heightfield.samplingOffset);
+            float* row = &heightfield.heights[i * heightfield.samplesPerSide];
+            noise.getValues(sx.data(), sz.data(), row, heightfield.samplesPerSide);
+        }
+    });
+
+    return heightfield;
+}
+
+
+// Makes map out of an already sampled heightfield (CPU side only)
+// Every cell writes its 6 vertices at a fixed offset, so the tiles can be
+// emitted in parallel and still come out in the same order as a serial loop
+Model buildTerrainMesh(const Heightfield& heightfield, float heightMult, float scale, bool isWater, ThreadPool& pool)
+{
+    Model model;
+
+    int resolution = heightfield.resolution;
+    float terrain_offset = (float) scale/resolution;
+
+    size_t numVertices = (size_t) resolution * resolution * 6;
+    model.vertices.resize(numVertices);
+    model.normals.resize(numVertices);
+    model.diffuseColors.resize(numVertices);
+    model.ambientColors.assign(numVertices, Vector3f(1.f, 1.f, 1.f));
+    model.specularColors.assign(numVertices, Vector3f(0.5f, 0.5f, 0.5f));
+    model.shininessValues.assign(numVertices, 20.f);
+
+    int numTiles = (resolution + TERRAIN_TILE_ROWS - 1) / TERRAIN_TILE_ROWS;
+
+    pool.parallelFor(numTiles, [&](int tile) {
+        int firstRow = tile * TERRAIN_TILE_ROWS;
+        int lastRow = std::min(firstRow + TERRAIN_TILE_ROWS, resolution);
+
+        for (int i = firstRow; i < lastRow; i++) {
+            for (int j = 0; j < resolution; j++) {
+
+                float pos1x = i * terrain_offset - (scale/2);
+                float pos2x = ((i + 1) * terrain_offset) - (scale/2);
+                float pos1z = j * terrain_offset - (scale/2);
+                float pos2z = ((j + 1) * terrain_offset) - (scale/2);
+
+                float perlin11 = heightfield.at(i, j);
+                Vector3f color11 = getColor(perlin11, isWater);
+                Vector3f point11 = Vector3f(pos1x, heightMult * perlin11, pos1z);
+
+                float perlin12 = heightfield.at(i, j + 1);
+                Vector3f color12 = getColor(perlin12, isWater);
+                Vector3f point12 = Vector3f(pos1x, heightMult * perlin12, pos2z);
+
+                float perlin21 = heightfield.at(i + 1, j);
+                Vector3f color21 = getColor(perlin21, isWater);
+                Vector3f point21 = Vector3f(pos2x, heightMult * perlin21, pos1z);
+
+                float perlin22 = heightfield.at(i + 1, j + 1);
+                Vector3f color22 = getColor(perlin22, isWater);
+                Vector3f point22 = Vector3f(pos2x, heightMult * perlin22, pos2z);
+
+                size_t v = ((size_t) i * resolution + j) * 6;
+                Vector3f P, Q;
+                Vector3f normalVec;
+
+                /*** First triangle ***/
+                model.vertices[v + 0] = point11;
+                model.vertices[v + 1] = point21;
+                model.vertices[v + 2] = point22;
+
+                P = point21 - point11;
+                Q = point22 - point21;
+
+                normalVec = -cross(P, Q);
+
+                model.normals[v + 0] = normalVec;
+                model.normals[v + 1] = normalVec;
+                model.normals[v + 2] = normalVec;
+
+                model.diffuseColors[v + 0] = color11;
+                model.diffuseColors[v + 1] = color21;
+                model.diffuseColors[v + 2] = color22;
+
+                /*** Second triangle ***/
+                model.vertices[v + 3] = point11;
+                model.vertices[v + 4] = point22;
+                model.vertices[v + 5] = point12;
+
+                P = point12 - point22;
+                Q = point11 - point12;
+
+                normalVec = -cross(P, Q);
+
+                model.normals[v + 3] = normalVec;
+                model.normals[v + 4] = normalVec;
+                model.normals[v + 5] = normalVec;
+
+                model.diffuseColors[v + 3] = color11;
+                model.diffuseColors[v + 4] = color22;
+                model.diffuseColors[v + 5] = color12;
+            }
+        }
+    });
+
+    return model;
+}
+
+
+// World position of heightfield sample (i, j)
+Vector3f getHeightfieldPoint(const Heightfield& heightfield, int i, int j, float heightMult, float scale)
+{
+    float terrain_offset = (float) scale/heightfield.resolution;
+    return Vector3f(i * terrain_offset - (scale/2), heightMult * heightfield.at(i, j), j * terrain_offset - (scale/2));
+}
+
+// Every cell of the terrain meshes is split along its (i, j) - (i + 1, j + 1)
+// diagonal into the triangles (i, j), (i + 1, j), (i + 1, j + 1) and
+// (i, j), (i + 1, j + 1), (i, j + 1), so the surface is linear on each half
+float interpolateTerrainCell(float h00, float h10, float h01, float h11, float fx, float fz, float cellSize, Vector3f& normal)
+{
+    float slopeX, slopeZ;
+    if (fx >= fz) {
+        slopeX = h10 - h00;
+        slopeZ = h11 - h10;
+    } else {
+        slopeX = h11 - h01;
+        slopeZ = h01 - h00;
+    }
+    normal = normalize(Vector3f(-slopeX / cellSize, 1.f, -slopeZ / cellSize));
+    return h00 + fx * slopeX + fz * slopeZ;
+}
+
+bool sampleHeightfield(const Heightfield& heightfield, float heightMult, float scale, float x, float z, float& height, Vector3f& normal)
+{
+    if (heightfield.resolution == 0) return false;
+
+    float cellSize = scale / heightfield.resolution;
+    float u = (x + scale/2) / cellSize;
+    float v = (z + scale/2) / cellSize;
+    if (u < 0.f || v < 0.f || u > heightfield.resolution || v > heightfield.resolution) return false;
+
+    int i = std::min((int) u, heightfield.resolution - 1);
+    int j = std::min((int) v, heightfield.resolution - 1);
+    height = interpolateTerrainCell(heightMult * heightfield.at(i, j), heightMult * heightfield.at(i + 1, j),
+                                    heightMult * heightfield.at(i, j + 1), heightMult * heightfield.at(i + 1, j + 1),
+                                    u - i, v - j, cellSize, normal);
+    return true;
+}
+
+// Smooth normal of heightfield sample (i, j): the sum of the (area weighted)
+// normals of the faces touching it, using the same triangulation as
+// buildTerrainMesh
+Vector3f getHeightfieldNormal(const Heightfield& heightfield, int i, int j, float heightMult, float scale)
+{
+    int resolution = heightfield.resolution;
+
+    // Faces of the (up to) four cells around the vertex
+    Vector3f normalVec(0.f);
+    for (int ci = i - 1; ci <= i; ci++) {
+        for (int cj = j - 1; cj <= j; cj++) {
+            if (ci < 0 || cj < 0 || ci >= resolution || cj >= resolution) continue;
+
+            Vector3f point11 = getHeightfieldPoint(heightfield, ci, cj, heightMult, scale);
+            Vector3f point12 = getHeightfieldPoint(heightfield, ci, cj + 1, heightMult, scale);
+            Vector3f point21 = getHeightfieldPoint(heightfield, ci + 1, cj, heightMult, scale);
+            Vector3f point22 = getHeightfieldPoint(heightfield, ci + 1, cj + 1, heightMult, scale);
+
+            bool in11 = (ci == i && cj == j);
+            bool in12 = (ci == i && cj + 1 == j);
+            bool in21 = (ci + 1 == i && cj == j);
+            bool in22 = (ci + 1 == i && cj + 1 == j);
+
+            // First triangle: 11, 21, 22
+            if (in11 || in21 || in22) normalVec += -cross(point21 - point11, point22 - point21);
+            // Second triangle: 11, 22, 12
+            if (in11 || in22 || in12) normalVec += -cross(point12 - point22, point11 - point12);
+        }
+    }
+    return normalize(normalVec);
+}
+
+// Makes map with one vertex per grid point, shared by all the triangles
+// around it, and two triangles per cell in an index buffer
+Model buildIndexedTerrainMesh(const Heightfield& heightfield, float heightMult, float scale, bool isWater, ThreadPool& pool)
+{
+    Model model;
+
+    int resolution = heightfield.resolution;
+    int samplesPerSide = heightfield.samplesPerSide;
+
+    size_t numVertices = (size_t) samplesPerSide * samplesPerSide;
+    model.vertices.resize(numVertices);
+    model.normals.resize(numVertices);
+    model.diffuseColors.resize(numVertices);
+    model.ambientColors.assign(numVertices, Vector3f(1.f, 1.f, 1.f));
+    model.specularColors.assign(numVertices, Vector3f(0.5f, 0.5f, 0.5f));
+    model.shininessValues.assign(numVertices, 20.f);
+    model.indices.resize((size_t) resolution * resolution * 6);
+
+    int numTiles = (samplesPerSide + TERRAIN_TILE_ROWS - 1) / TERRAIN_TILE_ROWS;
+
+    pool.parallelFor(numTiles, [&](int tile) {
+        int firstRow = tile * TERRAIN_TILE_ROWS;
+        int lastRow = std::min(firstRow + TERRAIN_TILE_ROWS, samplesPerSide);
+
+        for (int i = firstRow; i < lastRow; i++) {
+            for (int j = 0; j < samplesPerSide; j++) {
+                size_t v = (size_t) i * samplesPerSide + j;
+                model.vertices[v] = getHeightfieldPoint(heightfield, i, j, heightMult, scale);
+                model.normals[v] = getHeightfieldNormal(heightfield, i, j, heightMult, scale);
+                model.diffuseColors[v] = getColor(heightfield.at(i, j), isWater);
+            }
+        }
+    });
+
+    for (int i = 0; i < resolution; i++) {
+        for (int j = 0; j < resolution; j++) {
+            GLuint i11 = i * samplesPerSide + j;
+            GLuint i12 = i11 + 1;
+            GLuint i21 = i11 + samplesPerSide;
+            GLuint i22 = i21 + 1;
+
+            size_t f = ((size_t) i * resolution + j) * 6;
+            model.indices[f + 0] = i11;
+            model.indices[f + 1] = i21;
+            model.indices[f + 2] = i22;
+            model.indices[f + 3] = i11;
+            model.indices[f + 4] = i22;
+            model.indices[f + 5] = i12;
+        }
+    }
+
+    return model;
+}
+
+
+// Creates one attribute buffer of the bound VAO
+static GLuint uploadTerrainAttribute(Model& model, GLuint location, GLint components, const void* data, size_t bytes)
+{
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    model.buffers.push_back(buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, bytes, data, GL_STATIC_DRAW);
+    glVertexAttribPointer(location, components, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(location);
+    return buffer;
+}
+
+// Creates the VAO of a terrain model with one buffer per attribute stream
+void uploadTerrain(Model& model, const TerrainMeshData& mesh)
+{
+    glGenVertexArrays(1, &model.vao);
+    glBindVertexArray(model.vao);
+
+    size_t vec3Bytes = mesh.vertexCount * sizeof(Vector3f);
+    model.vbo = uploadTerrainAttribute(model, 0, 3, mesh.positions, vec3Bytes);
+    model.nbo = uploadTerrainAttribute(model, 1, 3, mesh.normals, vec3Bytes);
+    uploadTerrainAttribute(model, 2, 3, mesh.diffuseColors, vec3Bytes);
+    uploadTerrainAttribute(model, 3, 3, mesh.ambientColors, vec3Bytes);
+    uploadTerrainAttribute(model, 4, 3, mesh.specularColors, vec3Bytes);
+    uploadTerrainAttribute(model, 5, 1, mesh.shininessValues, mesh.vertexCount * sizeof(float));
+
+    if (mesh.indexCount > 0)
+    {
+        uploadIndices(model, mesh.indices, mesh.indexType, mesh.indexCount);
+    }
+}
+
+void uploadTerrain(Model& model)
+{
+    TerrainMeshData mesh;
+    mesh.vertexCount = model.vertices.size();
+    mesh.positions = model.vertices.data();
+    mesh.normals = model.normals.data();
+    mesh.diffuseColors = model.diffuseColors.data();
+    mesh.ambientColors = model.ambientColors.data();
+    mesh.specularColors = model.specularColors.data();
+    mesh.shininessValues = model.shininessValues.data();
+    uploadTerrain(model, mesh);
+
+    if (model.texCoords.size() > 0)
+    {
+        uploadTerrainAttribute(model, 6, 2, model.texCoords.data(), model.texCoords.size() * sizeof(Vector2f));
+    }
+
+    if (model.indices.size() > 0)
+    {
+        uploadIndices(model);
+    }
+}
+
+
+// Makes map
+// Resolution refers to the number of squares (x2 number of triangles) per side
+// Maps is always generated as a square of size 1
+Model makeTerrain(noise::module::Perlin perlinGenerator, float perlinSize, int resolution, float heightMult, float scale, bool isWater, bool indexed)
+{
+    Heightfield heightfield = buildHeightfield(perlinGenerator, perlinSize, resolution, isWater);
+    Model model = indexed ? buildIndexedTerrainMesh(heightfield, heightMult, scale, isWater)
+                          : buildTerrainMesh(heightfield, heightMult, scale, isWater);
+    uploadTerrain(model);
+    return model;
+}
+
+
+// GPU bytes of a terrain of the given resolution: position, normal, diffuse,
+// ambient and specular (vec3) plus shininess (float) per vertex, and indices
+TerrainFootprint getTerrainFootprint(int resolution, bool indexed)
+{
+    const size_t bytesPerVertex = 5 * sizeof(Vector3f) + sizeof(float);
+
+    TerrainFootprint footprint;
+    size_t numCorners = (size_t) resolution * resolution * 6;
+    if (indexed) {
+        footprint.vertexCount = (size_t) (resolution + 1) * (resolution + 1);
+        footprint.indexCount = numCorners;
+        footprint.indexBytes = numCorners * indexSize(footprint.vertexCount);
+    } else {
+        footprint.vertexCount = numCorners;
+        footprint.indexCount = 0;
+        footprint.indexBytes = 0;
+    }
+    footprint.vertexBytes = footprint.vertexCount * bytesPerVertex;
+    return footprint;
+}
+
+void reportTerrainFootprint(int resolution)
+{
+    TerrainFootprint expanded = getTerrainFootprint(resolution, false);
+    TerrainFootprint indexed = getTerrainFootprint(resolution, true);
+    size_t expandedTotal = expanded.vertexBytes + expanded.indexBytes;
+    size_t indexedTotal = indexed.vertexBytes + indexed.indexBytes;
+
+    std::cout << "Terrain memory, resolution " << resolution << std::endl;
+    std::cout << "  expanded: " << expanded.vertexCount << " vertices, "
+              << expandedTotal / 1024 << " KB" << std::endl;
+    std::cout << "  indexed:  " << indexed.vertexCount << " vertices, "
+              << indexed.indexCount << " x " << indexSize(indexed.vertexCount) * 8 << "-bit indices, "
+              << indexedTotal / 1024 << " KB (vertices " << indexed.vertexBytes / 1024
+              << " KB, indices " << indexed.indexBytes / 1024 << " KB)" << std::endl;
+    std::cout << "  reduction x" << (double) expandedTotal / indexedTotal << std::endl;
+}
+
+
+void benchmarkTerrainGeneration(const noise::module::Perlin& perlinGenerator, float perlinSize, int resolution)
+{
+    double numSamples = (double) (resolution + 1) * (resolution + 1);
+    unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::cout << "Terrain generation, resolution " << resolution << " (" << (size_t) numSamples << " height samples)" << std::endl;
+
+    double singleThreadRate = 0;
+    for (unsigned int numThreads = 1; ; numThreads = std::min(numThreads * 2, maxThreads)) {
+        ThreadPool pool(numThreads);
+
+        auto start = std::chrono::steady_clock::now();
+        Heightfield heightfield = buildHeightfield(perlinGenerator, perlinSize, resolution, false, pool);
+        auto sampled = std::chrono::steady_clock::now();
+        Model model = buildTerrainMesh(heightfield, 5.f, 200.f, false, pool);
+        auto end = std::chrono::steady_clock::now();
+
+        double sampleSecs = std::chrono::duration<double>(sampled - start).count();
+        double meshSecs = std::chrono::duration<double>(end - sampled).count();
+        double rate = numSamples / sampleSecs;
+        if (numThreads == 1) singleThreadRate = rate;
+
+        std::cout << "  threads " << numThreads
+                  << ": " << (size_t) rate << " samples/s"
+                  << ", heightfield " << sampleSecs * 1000 << " ms"
+                  << ", mesh " << meshSecs * 1000 << " ms"
+                  << ", speedup x" << rate / singleThreadRate << std::endl;
+
+        if (numThreads == maxThreads) break;
+    }
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include "Model.h"
+#include "NoiseGraph.h"
+#include "ThreadPool.h"
+
+#include <GDT/Vector3f.h>
+
+#include <memory>
+#include <vector>
+#include <noise/noise.h> // used for the Perlin noise generation
+
+// Rows of grid samples handed to a worker at once when generating terrain
+const int TERRAIN_TILE_ROWS = 16;
+
+// Noise value of every grid point of a terrain, evaluated once and shared by
+// the (up to) four cells that touch it
+// Sample (i, j) lives at heights[i * samplesPerSide + j] and is the noise at
+// (i * samplingOffset, j * samplingOffset)
+struct Heightfield
+{
+    int resolution = 0;
+    int samplesPerSide = 0;
+    float samplingOffset = 0.f;
+    std::vector<float> heights;
+
+    float at(int i, int j) const { return heights[i * samplesPerSide + j]; }
+};
+
+struct ElevationGraph;
+
+// The elevation of a generator with its module graph compiled once, for the
+// code sampling the same terrain over and over (the streamed chunks, the
+// exact ground height). The generator has to outlive it and keep its
+// settings. The values are const and can be read from several threads.
+class TerrainNoise
+{
+public:
+    TerrainNoise();
+    ~TerrainNoise();
+
+    void init(const noise::module::Perlin& perlinGenerator, bool isWater);
+
+    // Elevation of n points of the y = 0 plane
+    void getValues(const float* posX, const float* posZ, float* elevations, size_t n) const;
+    float getValue(float posX, float posZ) const;
+
+private:
+    std::unique_ptr<ElevationGraph> graph;
+    NoiseProgram program;
+};
+
+// One-off queries, compiling the graph on every call
+void getNoiseValues(const noise::module::Perlin& perlinGenerator, const float* posX, const float* posZ, bool isWater, float* elevations, size_t n);
+float getNoiseValue(const noise::module::Perlin& perlinGenerator, float posX, float posZ, bool isWater);
+Heightfield buildHeightfield(const noise::module::Perlin& perlinGenerator, float perlinSize, int resolution, bool isWater, ThreadPool& pool = ThreadPool::shared());
+Model buildTerrainMesh(const Heightfield& heightfield, float heightMult, float scale, bool isWater, ThreadPool& pool = ThreadPool::shared());
+Model buildIndexedTerrainMesh(const Heightfield& heightfield, float heightMult, float scale, bool isWater, ThreadPool& pool = ThreadPool::shared());
+
+Vector3f getHeightfieldPoint(const Heightfield& heightfield, int i, int j, float heightMult, float scale);
+Vector3f getHeightfieldNormal(const Heightfield& heightfield, int i, int j, float heightMult, float scale);
+
+// Vertex streams and indices of a terrain mesh, wherever they are stored
+// (the vectors of a Model, a memory-mapped cache file)
+struct TerrainMeshData
+{
+    size_t vertexCount = 0;
+    const Vector3f* positions = nullptr;
+    const Vector3f* normals = nullptr;
+    const Vector3f* diffuseColors = nullptr;
+    const Vector3f* ambientColors = nullptr;
+    const Vector3f* specularColors = nullptr;
+    const float* shininessValues = nullptr;
+
+    size_t indexCount = 0;             // 0 when not indexed
+    const void* indices = nullptr;
+    GLenum indexType = GL_UNSIGNED_INT;
+};
+
+void uploadTerrain(Model& model, const TerrainMeshData& mesh);
+void uploadTerrain(Model& model);
+
+// Height and face normal at (fx, fz) in [0, 1]^2 of a grid cell with corner
+// heights h00 at (i, j), h10 at (i + 1, j), h01 at (i, j + 1) and h11 at
+// (i + 1, j + 1), on the two triangles the terrain meshes draw for the cell
+float interpolateTerrainCell(float h00, float h10, float h01, float h11, float fx, float fz, float cellSize, Vector3f& normal);
+
+// Ground height and normal at world position (x, z) of the terrain built from
+// 'heightfield', in O(1) and matching the drawn triangles. False outside of it.
+bool sampleHeightfield(const Heightfield& heightfield, float heightMult, float scale, float x, float z, float& height, Vector3f& normal);
+
+// Waves of the animated ocean, computed in the vertex shaders from these
+// settings and the time, so the ocean mesh is uploaded once and never touched
+// again. Each of the 'octaves' directional sine waves is 'lacunarity' times
+// shorter and 'persistence' times lower than the previous one.
+struct WaveSettings
+{
+    float amplitude = 0.15f;
+    float frequency = 0.4f;   // radians per world unit
+    float speed = 1.5f;       // world units per second
+    float direction = 0.3f;   // of the first octave, radians from the x axis
+    int octaves = 4;
+    float lacunarity = 1.8f;
+    float persistence = 0.5f;
+};
+
+Model makeTerrain(noise::module::Perlin perlinGenerator, float perlinSize, int resolution, float heightMult, float scale, bool isWater, bool indexed = false);
+// Re-uploads the positions of a model, the old per-frame ocean update
+void updateMapValues(Model& model);
+float getHeightMapPoint(Vector3f point, const TerrainNoise& noise, float perlinSize, float scale, float heightMult);
+
+// The height and the exact normal of the noise surface, the five samples of
+// both evaluated at once
+float getHeightMapPoint(Vector3f point, const TerrainNoise& noise, float perlinSize, float scale, float heightMult, Vector3f& normal);
+Vector3f getColor(float e, bool isWater);
+
+// GPU memory taken by a terrain mesh, expanded (6 vertices per cell) or indexed
+struct TerrainFootprint
+{
+    size_t vertexCount;
+    size_t vertexBytes;
+    size_t indexCount;
+    size_t indexBytes;
+};
+
+TerrainFootprint getTerrainFootprint(int resolution, bool indexed);
+void reportTerrainFootprint(int resolution);
+
+// Prints heightfield samples/sec for 1, 2, 4, ... worker threads, no window needed
+void benchmarkTerrainGeneration(const noise::module::Perlin& perlinGenerator, float perlinSize, int resolution);
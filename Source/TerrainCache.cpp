@@ -0,0 +1,305 @@
+#include "TerrainCache.h"
+#include "Hash.h"
+#include "MappedFile.h"
+#include "NoiseBatch.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#if defined(_WIN32)
+    #include <direct.h>
+#else
+    #include <sys/stat.h>
+#endif
+
+// libnoise has no version query, this is the release the 3rdParty build is from
+const char* const LIBNOISE_VERSION = "1.0.0";
+
+const char TERRAIN_CACHE_MAGIC[4] = { 'T', 'R', 'N', 'C' };
+
+static_assert(sizeof(Vector3f) == 3 * sizeof(float), "terrain cache files store Vector3f as 3 packed floats");
+
+// Followed by the payload: heights (samplesPerSide^2 floats), then when the
+// file has a mesh the positions, normals, diffuse, ambient and specular colors
+// (vertexCount Vector3f each), shininess (vertexCount floats) and the indices
+// in their GPU type
+struct TerrainCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    int32_t resolution;
+    int32_t samplesPerSide;
+    float samplingOffset;
+    uint32_t indexType;
+    uint64_t vertexCount;
+    uint64_t indexCount;
+    uint64_t payloadBytes;
+    uint64_t checksum;
+    double generateMs;     // generating and uploading the terrain, to report what the cache saves
+};
+
+struct TerrainCacheEntry
+{
+    const noise::module::Perlin& perlinGenerator;
+    float perlinSize;
+    int resolution;
+    float heightMult;
+    float scale;
+    bool isWater;
+    bool indexed;
+    bool withMesh;
+};
+
+template <typename T>
+static uint64_t hashValue(uint64_t hash, T value)
+{
+    return hashBytes(&value, sizeof(T), hash);
+}
+
+static uint64_t hashString(uint64_t hash, const char* text)
+{
+    return hashBytes(text, std::strlen(text) + 1, hash);
+}
+
+static uint64_t terrainCacheKey(const TerrainCacheEntry& entry)
+{
+    const noise::module::Perlin& perlin = entry.perlinGenerator;
+
+    uint64_t key = hashValue(hashBytes(TERRAIN_CACHE_MAGIC, sizeof(TERRAIN_CACHE_MAGIC)), TERRAIN_CACHE_VERSION);
+    key = hashString(key, LIBNOISE_VERSION);
+    key = hashString(key, noiseBatchKernel());
+    key = hashValue(key, perlin.GetSeed());
+    key = hashValue(key, perlin.GetFrequency());
+    key = hashValue(key, perlin.GetLacunarity());
+    key = hashValue(key, perlin.GetPersistence());
+    key = hashValue(key, perlin.GetOctaveCount());
+    key = hashValue(key, (int) perlin.GetNoiseQuality());
+    key = hashValue(key, entry.perlinSize);
+    key = hashValue(key, entry.resolution);
+    key = hashValue(key, entry.isWater);
+    key = hashValue(key, entry.withMesh);
+    if (entry.withMesh) {
+        key = hashValue(key, entry.heightMult);
+        key = hashValue(key, entry.scale);
+        key = hashValue(key, entry.indexed);
+    }
+
+    return mixHash(key);
+}
+
+static std::string terrainCachePath(uint64_t key)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "terrain-%016llx.bin", (unsigned long long) key);
+    return std::string(TERRAIN_CACHE_DIR) + "/" + name;
+}
+
+static size_t indexTypeSize(GLenum indexType)
+{
+    return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+static uint64_t payloadSize(int samplesPerSide, uint64_t vertexCount, uint64_t indexCount, GLenum indexType)
+{
+    return (uint64_t) samplesPerSide * samplesPerSide * sizeof(float)
+         + vertexCount * (5 * sizeof(Vector3f) + sizeof(float))
+         + indexCount * indexTypeSize(indexType);
+}
+
+// Maps and validates the cache file of 'entry' and uploads its mesh. False
+// (with the reason printed) when the file is missing, stale or corrupt.
+static bool loadTerrainCache(const TerrainCacheEntry& entry, uint64_t key, const std::string& path,
+                             Model* model, Heightfield* heightfield, double& generateMs)
+{
+    MappedFile file;
+    if (!file.open(path)) return false;
+
+    TerrainCacheHeader header;
+    if (file.size() < sizeof(header)) {
+        std::cout << "Terrain cache: " << path << " is truncated, regenerating" << std::endl;
+        return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, TERRAIN_CACHE_MAGIC, sizeof(TERRAIN_CACHE_MAGIC)) != 0) {
+        std::cout << "Terrain cache: " << path << " is not a terrain cache file, regenerating" << std::endl;
+        return false;
+    }
+    if (header.version != TERRAIN_CACHE_VERSION || header.key != key) {
+        std::cout << "Terrain cache: " << path << " is stale (version " << header.version << "), regenerating" << std::endl;
+        return false;
+    }
+
+    bool indexTypeValid = header.indexType == GL_UNSIGNED_SHORT || header.indexType == GL_UNSIGNED_INT;
+    bool meshValid = entry.withMesh ? header.vertexCount > 0 : header.vertexCount == 0 && header.indexCount == 0;
+    if (!indexTypeValid || !meshValid || header.resolution != entry.resolution || header.samplesPerSide != entry.resolution + 1
+        || header.payloadBytes != payloadSize(header.samplesPerSide, header.vertexCount, header.indexCount, header.indexType)
+        || file.size() != sizeof(header) + header.payloadBytes) {
+        std::cout << "Terrain cache: " << path << " is corrupt (bad sizes), regenerating" << std::endl;
+        return false;
+    }
+
+    const unsigned char* payload = file.data() + sizeof(header);
+    if (hashBytes(payload, (size_t) header.payloadBytes) != header.checksum) {
+        std::cout << "Terrain cache: " << path << " is corrupt (checksum mismatch), regenerating" << std::endl;
+        return false;
+    }
+
+    size_t numSamples = (size_t) header.samplesPerSide * header.samplesPerSide;
+    const float* heights = (const float*) payload;
+    if (heightfield) {
+        heightfield->resolution = header.resolution;
+        heightfield->samplesPerSide = header.samplesPerSide;
+        heightfield->samplingOffset = header.samplingOffset;
+        heightfield->heights.assign(heights, heights + numSamples);
+    }
+
+    if (model) {
+        size_t numVertices = (size_t) header.vertexCount;
+        const Vector3f* streams = (const Vector3f*) (heights + numSamples);
+
+        TerrainMeshData mesh;
+        mesh.vertexCount = numVertices;
+        mesh.positions = streams;
+        mesh.normals = streams + numVertices;
+        mesh.diffuseColors = streams + 2 * numVertices;
+        mesh.ambientColors = streams + 3 * numVertices;
+        mesh.specularColors = streams + 4 * numVertices;
+        mesh.shininessValues = (const float*) (streams + 5 * numVertices);
+        mesh.indexCount = (size_t) header.indexCount;
+        mesh.indices = mesh.shininessValues + numVertices;
+        mesh.indexType = header.indexType;
+        uploadTerrain(*model, mesh);
+
+        // The positions are still needed on the CPU (vertex count of the
+        // draw call, updateMapValues), the rest only lives on the GPU
+        model->vertices.assign(mesh.positions, mesh.positions + numVertices);
+    }
+
+    generateMs = header.generateMs;
+    return true;
+}
+
+static void createDirectory(const char* path)
+{
+#if defined(_WIN32)
+    _mkdir(path);
+#else
+    mkdir(path, 0755);
+#endif
+}
+
+// Writes to a temporary file first so an interrupted write never leaves a
+// half-written cache file behind under the real name
+static void storeTerrainCache(uint64_t key, const std::string& path, const Heightfield& heightfield, const Model* model, double generateMs)
+{
+    std::vector<unsigned char> payload;
+    auto append = [&](const void* data, size_t bytes) {
+        const unsigned char* begin = (const unsigned char*) data;
+        payload.insert(payload.end(), begin, begin + bytes);
+    };
+
+    TerrainCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, TERRAIN_CACHE_MAGIC, sizeof(TERRAIN_CACHE_MAGIC));
+    header.version = TERRAIN_CACHE_VERSION;
+    header.key = key;
+    header.resolution = heightfield.resolution;
+    header.samplesPerSide = heightfield.samplesPerSide;
+    header.samplingOffset = heightfield.samplingOffset;
+    header.indexType = GL_UNSIGNED_INT;
+    header.generateMs = generateMs;
+
+    append(heightfield.heights.data(), heightfield.heights.size() * sizeof(float));
+    if (model) {
+        size_t numVertices = model->vertices.size();
+        header.vertexCount = numVertices;
+        append(model->vertices.data(), numVertices * sizeof(Vector3f));
+        append(model->normals.data(), numVertices * sizeof(Vector3f));
+        append(model->diffuseColors.data(), numVertices * sizeof(Vector3f));
+        append(model->ambientColors.data(), numVertices * sizeof(Vector3f));
+        append(model->specularColors.data(), numVertices * sizeof(Vector3f));
+        append(model->shininessValues.data(), numVertices * sizeof(float));
+
+        header.indexCount = model->indices.size();
+        if (indexSize(numVertices) == sizeof(GLushort)) {
+            std::vector<GLushort> shortIndices(model->indices.begin(), model->indices.end());
+            header.indexType = GL_UNSIGNED_SHORT;
+            append(shortIndices.data(), shortIndices.size() * sizeof(GLushort));
+        } else {
+            append(model->indices.data(), model->indices.size() * sizeof(GLuint));
+        }
+    }
+    header.payloadBytes = payload.size();
+    header.checksum = hashBytes(payload.data(), payload.size());
+
+    createDirectory(TERRAIN_CACHE_DIR);
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        out.write((const char*) &header, sizeof(header));
+        out.write((const char*) payload.data(), payload.size());
+        if (!out) {
+            std::cout << "Terrain cache: could not write " << tempPath << std::endl;
+            out.close();
+            std::remove(tempPath.c_str());
+            return;
+        }
+    }
+    std::remove(path.c_str());
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        std::cout << "Terrain cache: could not write " << path << std::endl;
+        std::remove(tempPath.c_str());
+    }
+}
+
+static void loadOrGenerate(const TerrainCacheEntry& entry, Model* model, Heightfield* heightfield)
+{
+    uint64_t key = terrainCacheKey(entry);
+    std::string path = terrainCachePath(key);
+
+    auto start = std::chrono::steady_clock::now();
+    double generateMs = 0;
+    if (loadTerrainCache(entry, key, path, model, heightfield, generateMs)) {
+        double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Terrain cache: loaded " << path << " in " << loadMs << " ms (generating took " << generateMs
+                  << " ms, saved " << generateMs - loadMs << " ms)" << std::endl;
+        return;
+    }
+
+    start = std::chrono::steady_clock::now();
+    Heightfield generated = buildHeightfield(entry.perlinGenerator, entry.perlinSize, entry.resolution, entry.isWater);
+    if (model) {
+        *model = entry.indexed ? buildIndexedTerrainMesh(generated, entry.heightMult, entry.scale, entry.isWater)
+                               : buildTerrainMesh(generated, entry.heightMult, entry.scale, entry.isWater);
+        uploadTerrain(*model);
+    }
+    generateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    storeTerrainCache(key, path, generated, model, generateMs);
+    std::cout << "Terrain cache: generated " << path << " in " << generateMs << " ms" << std::endl;
+
+    if (heightfield) *heightfield = std::move(generated);
+}
+
+Model loadOrMakeTerrain(const noise::module::Perlin& perlinGenerator, float perlinSize, int resolution, float heightMult, float scale,
+                        bool isWater, bool indexed, Heightfield* heightfield)
+{
+    TerrainCacheEntry entry = { perlinGenerator, perlinSize, resolution, heightMult, scale, isWater, indexed, true };
+    Model model;
+    loadOrGenerate(entry, &model, heightfield);
+    return model;
+}
+
+Heightfield loadOrBuildHeightfield(const noise::module::Perlin& perlinGenerator, float perlinSize, int resolution, bool isWater)
+{
+    TerrainCacheEntry entry = { perlinGenerator, perlinSize, resolution, 0.f, 0.f, isWater, false, false };
+    Heightfield heightfield;
+    loadOrGenerate(entry, nullptr, &heightfield);
+    return heightfield;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "Model.h"
+#include "Terrain.h"
+
+#include <cstdint>
+#include <string>
+#include <noise/noise.h> // used for the Perlin noise generation
+
+// Generated terrains are stored in TERRAIN_CACHE_DIR, one file per set of
+// generator parameters, and memory-mapped on the next start so the vertex
+// streams go from the file straight into glBufferData.
+//
+// The file name is a hash of the parameters, the libnoise version, the noise
+// kernel and TERRAIN_CACHE_VERSION. The header repeats the full hash and a
+// checksum of the data, so stale files (older layout or generator) and corrupt
+// ones (truncated, damaged) are detected and regenerated.
+const char* const TERRAIN_CACHE_DIR = "Cache";
+
+// Bump whenever the file layout or anything in the terrain generation changes
+// (elevation graph, colors, mesh layout), the old files are then regenerated
+const uint32_t TERRAIN_CACHE_VERSION = 2;
+
+// makeTerrain through the cache. 'heightfield' receives the noise samples of
+// the terrain when it is not null.
+Model loadOrMakeTerrain(const noise::module::Perlin& perlinGenerator, float perlinSize, int resolution, float heightMult, float scale,
+                        bool isWater, bool indexed = false, Heightfield* heightfield = nullptr);
+
+// buildHeightfield through the cache, for the terrains that build their own meshes
+Heightfield loadOrBuildHeightfield(const noise::module::Perlin& perlinGenerator, float perlinSize, int resolution, bool isWater);
+
@@ -0,0 +1,275 @@
+#include "TerrainStreamer.h"
+#include "Terrain.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+
+TerrainStreamer::~TerrainStreamer()
+{
+    clear();
+}
+
+void TerrainStreamer::init(const noise::module::Perlin& sourceGenerator, float sourcePerlinSize, float sourceHeightMult, float sourceScale)
+{
+    clear();
+    // Modules can not be assigned, copy the settings instead
+    perlinGenerator.SetFrequency(sourceGenerator.GetFrequency());
+    perlinGenerator.SetLacunarity(sourceGenerator.GetLacunarity());
+    perlinGenerator.SetNoiseQuality(sourceGenerator.GetNoiseQuality());
+    perlinGenerator.SetOctaveCount(sourceGenerator.GetOctaveCount());
+    perlinGenerator.SetPersistence(sourceGenerator.GetPersistence());
+    perlinGenerator.SetSeed(sourceGenerator.GetSeed());
+    noise.init(perlinGenerator, false);
+    perlinSize = sourcePerlinSize;
+    heightMult = sourceHeightMult;
+    scale = sourceScale;
+    stats = StreamingStats();
+}
+
+void TerrainStreamer::clear()
+{
+    for (auto& entry : pending) {
+        entry.second.wait();
+    }
+    pending.clear();
+    finished.clear();
+    ready.clear();
+
+    for (auto& entry : chunks) {
+        destroyModel(entry.second.model);
+    }
+    chunks.clear();
+}
+
+// Runs on a worker: samples one extra ring of heights around the chunk so the
+// normals on its border match the neighbouring chunks. Positions come from the
+// global sample index, so shared edges are bit-identical on both sides.
+TerrainStreamer::GeneratedChunk TerrainStreamer::generateChunk(ChunkKey key) const
+{
+    GeneratedChunk generated;
+    generated.key = key;
+    Model& model = generated.model;
+
+    int n = chunkResolution;
+    int apronSide = n + 3;
+    float cellSize = chunkSize / n;
+
+    std::vector<float> heights(apronSide * apronSide);
+    std::vector<float> adjX(apronSide * apronSide), adjZ(apronSide * apronSide);
+    for (int i = 0; i < apronSide; i++) {
+        float x = (key.x * n + i - 1) * cellSize;
+        for (int j = 0; j < apronSide; j++) {
+            float z = (key.z * n + j - 1) * cellSize;
+            adjX[i * apronSide + j] = ((x + (scale/2))/scale)*perlinSize;
+            adjZ[i * apronSide + j] = ((z + (scale/2))/scale)*perlinSize;
+        }
+    }
+    noise.getValues(adjX.data(), adjZ.data(), heights.data(), heights.size());
+    auto height = [&](int i, int j) { return heights[(i + 1) * apronSide + (j + 1)]; };
+
+    int side = n + 1;
+    for (int i = 0; i < side; i++) {
+        for (int j = 0; j < side; j++) {
+            float h = height(i, j);
+            model.vertices.push_back(Vector3f((key.x * n + i) * cellSize, heightMult * h, (key.z * n + j) * cellSize));
+            generated.heights.push_back(heightMult * h);
+
+            float slopeX = (height(i + 1, j) - height(i - 1, j)) * heightMult / (2 * cellSize);
+            float slopeZ = (height(i, j + 1) - height(i, j - 1)) * heightMult / (2 * cellSize);
+            model.normals.push_back(normalize(Vector3f(-slopeX, 1.f, -slopeZ)));
+            model.diffuseColors.push_back(getColor(h, false));
+        }
+    }
+
+    size_t numVertices = model.vertices.size();
+    model.ambientColors.assign(numVertices, Vector3f(1.f, 1.f, 1.f));
+    model.specularColors.assign(numVertices, Vector3f(0.5f, 0.5f, 0.5f));
+    model.shininessValues.assign(numVertices, 20.f);
+
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            GLuint i11 = i * side + j;
+            GLuint i12 = i11 + 1;
+            GLuint i21 = i11 + side;
+            GLuint i22 = i21 + 1;
+            GLuint cell[6] = { i11, i21, i22, i11, i22, i12 };
+            model.indices.insert(model.indices.end(), cell, cell + 6);
+        }
+    }
+
+    return generated;
+}
+
+void TerrainStreamer::update(const Vector3f& position, std::vector<const Model*>& visible)
+{
+    frame++;
+
+    int centerX = (int) std::floor(position.x / chunkSize);
+    int centerZ = (int) std::floor(position.z / chunkSize);
+    auto distanceSq = [&](const ChunkKey& key) {
+        return (key.x - centerX) * (key.x - centerX) + (key.z - centerZ) * (key.z - centerZ);
+    };
+    auto isNeeded = [&](const ChunkKey& key) { return distanceSq(key) <= viewRadius * viewRadius; };
+
+    // Chunks in view, closest first
+    std::vector<ChunkKey> needed;
+    for (int x = centerX - viewRadius; x <= centerX + viewRadius; x++) {
+        for (int z = centerZ - viewRadius; z <= centerZ + viewRadius; z++) {
+            ChunkKey key = { x, z };
+            if (isNeeded(key)) needed.push_back(key);
+        }
+    }
+    std::sort(needed.begin(), needed.end(), [&](const ChunkKey& a, const ChunkKey& b) { return distanceSq(a) < distanceSq(b); });
+
+    // 1. Touch resident chunks and request the missing ones
+    for (const ChunkKey& key : needed) {
+        auto chunk = chunks.find(key);
+        if (chunk != chunks.end()) {
+            chunk->second.lastUsedFrame = frame;
+        } else if (pending.find(key) == pending.end()) {
+            pending[key] = ThreadPool::shared().submit([this, key]() {
+                auto start = std::chrono::steady_clock::now();
+                GeneratedChunk generated = generateChunk(key);
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                std::lock_guard<std::mutex> lock(finishedMutex);
+                finished.push_back(std::move(generated));
+                finishedGenerateMs += ms;
+            });
+        }
+    }
+
+    // 2. Collect what the workers finished since the last frame
+    {
+        std::lock_guard<std::mutex> lock(finishedMutex);
+        for (auto& generated : finished) {
+            pending.erase(generated.key);
+            stats.generated++;
+            ready.push_back(std::move(generated));
+        }
+        finished.clear();
+        stats.generateMs += finishedGenerateMs;
+        finishedGenerateMs = 0;
+    }
+
+    // 3. Upload a bounded amount per frame, nearest chunks first
+    std::sort(ready.begin(), ready.end(), [&](const GeneratedChunk& a, const GeneratedChunk& b) { return distanceSq(a.key) < distanceSq(b.key); });
+
+    auto uploadStart = std::chrono::steady_clock::now();
+    int uploads = 0;
+    std::vector<GeneratedChunk> notUploaded;
+    for (auto& generated : ready) {
+        if (!isNeeded(generated.key)) {
+            stats.discarded++;
+            continue;
+        }
+
+        double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - uploadStart).count();
+        if (uploads >= maxUploadsPerFrame || elapsedMs >= uploadBudgetMs) {
+            notUploaded.push_back(std::move(generated));
+            continue;
+        }
+
+        TerrainChunk chunk;
+        chunk.model = std::move(generated.model);
+        chunk.heights = std::move(generated.heights);
+        uploadTerrain(chunk.model);
+        chunk.gpuBytes = chunk.model.vertices.size() * (5 * sizeof(Vector3f) + sizeof(float))
+                       + chunk.model.indices.size() * indexSize(chunk.model.vertices.size());
+        chunk.lastUsedFrame = frame;
+
+        // Only the GPU copy is needed to draw an indexed model
+        chunk.model.vertices = std::vector<Vector3f>();
+        chunk.model.normals = std::vector<Vector3f>();
+        chunk.model.diffuseColors = std::vector<Vector3f>();
+        chunk.model.ambientColors = std::vector<Vector3f>();
+        chunk.model.specularColors = std::vector<Vector3f>();
+        chunk.model.shininessValues = std::vector<float>();
+        chunk.model.indices = std::vector<GLuint>();
+
+        stats.residentBytes += chunk.gpuBytes;
+        chunks[generated.key] = std::move(chunk);
+        stats.uploaded++;
+        uploads++;
+    }
+    ready = std::move(notUploaded);
+
+    double frameUploadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - uploadStart).count();
+    stats.uploadMs += frameUploadMs;
+    stats.maxFrameUploadMs = std::max(stats.maxFrameUploadMs, frameUploadMs);
+
+    // 4. Evict least recently used chunks that are out of view
+    if (stats.residentBytes > memoryBudget) {
+        std::vector<std::pair<unsigned long, ChunkKey>> candidates;
+        for (auto& entry : chunks) {
+            if (entry.second.lastUsedFrame != frame) {
+                candidates.push_back(std::make_pair(entry.second.lastUsedFrame, entry.first));
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const std::pair<unsigned long, ChunkKey>& a, const std::pair<unsigned long, ChunkKey>& b) { return a.first < b.first; });
+
+        for (auto& candidate : candidates) {
+            if (stats.residentBytes <= memoryBudget) break;
+            TerrainChunk& chunk = chunks[candidate.second];
+            stats.residentBytes -= chunk.gpuBytes;
+            destroyModel(chunk.model);
+            chunks.erase(candidate.second);
+            stats.evicted++;
+        }
+
+        if (stats.residentBytes > memoryBudget) {
+            stats.budgetViolations++;
+        }
+    }
+
+    stats.residentChunks = chunks.size();
+    stats.pendingChunks = pending.size() + ready.size();
+
+    visible.clear();
+    for (const ChunkKey& key : needed) {
+        auto chunk = chunks.find(key);
+        if (chunk != chunks.end()) visible.push_back(&chunk->second.model);
+    }
+}
+
+bool TerrainStreamer::getGroundHeight(float x, float z, float& height, Vector3f& normal) const
+{
+    ChunkKey key = { (int) std::floor(x / chunkSize), (int) std::floor(z / chunkSize) };
+    auto chunk = chunks.find(key);
+    if (chunk == chunks.end()) return false;
+
+    int n = chunkResolution;
+    int side = n + 1;
+    float cellSize = chunkSize / n;
+    float u = x / cellSize - key.x * n;
+    float v = z / cellSize - key.z * n;
+    int i = std::min(std::max((int) u, 0), n - 1);
+    int j = std::min(std::max((int) v, 0), n - 1);
+
+    const std::vector<float>& heights = chunk->second.heights;
+    height = interpolateTerrainCell(heights[i * side + j], heights[(i + 1) * side + j], heights[i * side + j + 1], heights[(i + 1) * side + j + 1],
+                                    u - i, v - j, cellSize, normal);
+    return true;
+}
+
+StreamingStats TerrainStreamer::getStats() const
+{
+    return stats;
+}
+
+void TerrainStreamer::printStats() const
+{
+    std::cout << "Terrain streaming: generated " << stats.generated
+              << " (" << (stats.generated > 0 ? stats.generateMs / stats.generated : 0) << " ms each on the workers)"
+              << ", uploaded " << stats.uploaded
+              << " (" << (stats.uploaded > 0 ? stats.uploadMs / stats.uploaded : 0) << " ms each, worst frame " << stats.maxFrameUploadMs << " ms)"
+              << ", evicted " << stats.evicted
+              << ", discarded " << stats.discarded
+              << ", budget violations " << stats.budgetViolations
+              << ", resident " << stats.residentChunks << " chunks / " << stats.residentBytes / 1024 << " KB"
+              << " of " << memoryBudget / 1024 << " KB"
+              << ", pending " << stats.pendingChunks << std::endl;
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include "Model.h"
+#include "Terrain.h"
+#include "ThreadPool.h"
+
+#include <GDT/Vector3f.h>
+
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <noise/noise.h> // used for the Perlin noise generation
+
+// Grid coordinates of a terrain chunk, chunk (x, z) covers the world square
+// [x * chunkSize, (x + 1) * chunkSize] x [z * chunkSize, (z + 1) * chunkSize]
+struct ChunkKey
+{
+    int x, z;
+
+    bool operator==(const ChunkKey& other) const { return x == other.x && z == other.z; }
+};
+
+struct ChunkKeyHash
+{
+    size_t operator()(const ChunkKey& key) const { return (size_t) key.x * 73856093u ^ (size_t) key.z * 19349663u; }
+};
+
+struct TerrainChunk
+{
+    Model model;
+    std::vector<float> heights; // world heights of the (chunkResolution + 1)^2 vertices, for ground queries
+    size_t gpuBytes = 0;
+    unsigned long lastUsedFrame = 0;
+};
+
+struct StreamingStats
+{
+    size_t generated = 0;        // chunks built by the workers
+    size_t uploaded = 0;         // chunks sent to the GPU
+    size_t evicted = 0;          // chunks freed by the LRU policy
+    size_t discarded = 0;        // chunks finished after the viewer left them
+    size_t budgetViolations = 0; // frames where the visible chunks alone exceeded the budget
+
+    double generateMs = 0;       // worker time spent generating
+    double uploadMs = 0;         // main thread time spent uploading
+    double maxFrameUploadMs = 0; // worst upload time of a single frame
+
+    size_t residentChunks = 0;
+    size_t residentBytes = 0;
+    size_t pendingChunks = 0;
+};
+
+// Endless terrain made of square chunks around the viewer. Chunks are generated
+// from the noise on the worker pool, uploaded a few per frame on the main
+// thread and the least recently used ones are freed when the chunks on the GPU
+// take more than memoryBudget bytes.
+class TerrainStreamer
+{
+public:
+    float chunkSize = 50.f;                 // world units per chunk side
+    int chunkResolution = 32;               // cells per chunk side
+    int viewRadius = 4;                     // chunks loaded around the viewer in every direction
+    size_t memoryBudget = 16 * 1024 * 1024; // GPU bytes of resident chunks
+    int maxUploadsPerFrame = 2;
+    double uploadBudgetMs = 2.0;            // stop uploading once a frame spent this long on it
+
+    ~TerrainStreamer();
+
+    // Uses the same noise-to-world mapping as getHeightMapPoint, so the chunks
+    // around the origin match the finite map and its collisions
+    void init(const noise::module::Perlin& perlinGenerator, float perlinSize, float heightMult, float scale);
+
+    // Requests, uploads and evicts chunks for a viewer at 'position' and
+    // collects the models to draw this frame
+    void update(const Vector3f& position, std::vector<const Model*>& visible);
+
+    // Frees every chunk and waits for the ones still being generated
+    void clear();
+
+    // Ground height and normal at world position (x, z) on the drawn
+    // triangles, false when the chunk there is not resident
+    bool getGroundHeight(float x, float z, float& height, Vector3f& normal) const;
+
+    StreamingStats getStats() const;
+    void printStats() const;
+
+private:
+    struct GeneratedChunk
+    {
+        ChunkKey key;
+        Model model;
+        std::vector<float> heights;
+    };
+
+    GeneratedChunk generateChunk(ChunkKey key) const;
+
+    noise::module::Perlin perlinGenerator;
+    TerrainNoise noise;  // of perlinGenerator, shared by the workers
+    float perlinSize = 1.f;
+    float heightMult = 1.f;
+    float scale = 1.f;
+
+    unsigned long frame = 0;
+    std::unordered_map<ChunkKey, TerrainChunk, ChunkKeyHash> chunks;
+    std::unordered_map<ChunkKey, std::future<void>, ChunkKeyHash> pending;
+
+    // Filled by the workers, drained by update()
+    std::mutex finishedMutex;
+    std::vector<GeneratedChunk> finished;
+    double finishedGenerateMs = 0;
+
+    // Generated chunks waiting for their upload, main thread only
+    std::vector<GeneratedChunk> ready;
+
+    StreamingStats stats;
+};
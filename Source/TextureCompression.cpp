@@ -0,0 +1,571 @@
+#include "TextureCompression.h"
+#include "Hash.h"
+#include "ResourceArchive.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+size_t blockBytes(BlockFormat format)
+{
+    return format == BLOCK_BC1 ? 8 : 16;
+}
+
+const char* blockFormatName(BlockFormat format)
+{
+    switch (format) {
+    case BLOCK_BC1: return "BC1";
+    case BLOCK_BC3: return "BC3";
+    case BLOCK_BC5: return "BC5";
+    }
+    return "?";
+}
+
+size_t compressedLevelBytes(BlockFormat format, int width, int height)
+{
+    return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+static int levelSize(int size, int level)
+{
+    return std::max(1, size >> level);
+}
+
+static size_t compressedTextureBytes(BlockFormat format, int width, int height, int levelCount)
+{
+    size_t bytes = 0;
+    for (int level = 0; level < levelCount; level++) {
+        bytes += compressedLevelBytes(format, levelSize(width, level), levelSize(height, level));
+    }
+    return bytes;
+}
+
+CompressedTextureView viewTexture(const CompressedTexture& texture)
+{
+    CompressedTextureView view;
+    view.format = texture.format;
+    view.width = texture.width;
+    view.height = texture.height;
+    view.levelCount = texture.levelCount;
+    view.blocks = texture.blocks.data();
+    view.size = texture.blocks.size();
+    return view;
+}
+
+// RGB565 endpoints, expanded to 8 bits the way the GPU does
+static uint16_t packRgb565(const float color[3])
+{
+    int r = std::min(31, std::max(0, (int) std::lround(color[0] * 31.0f / 255.0f)));
+    int g = std::min(63, std::max(0, (int) std::lround(color[1] * 63.0f / 255.0f)));
+    int b = std::min(31, std::max(0, (int) std::lround(color[2] * 31.0f / 255.0f)));
+    return (uint16_t) ((r << 11) | (g << 5) | b);
+}
+
+static void unpackRgb565(uint16_t packed, int color[3])
+{
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// The four colours of a block in the four colour mode: the endpoints and
+// the two between them
+static void colorPalette(uint16_t c0, uint16_t c1, int palette[4][3])
+{
+    unpackRgb565(c0, palette[0]);
+    unpackRgb565(c1, palette[1]);
+    for (int k = 0; k < 3; k++) {
+        palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+        palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+    }
+}
+
+// Nearest palette colour of every pixel, returns the summed squared error
+static int fitColorIndices(const unsigned char pixels[16][4], uint16_t c0, uint16_t c1, int indices[16])
+{
+    int palette[4][3];
+    colorPalette(c0, c1, palette);
+    int error = 0;
+    for (int p = 0; p < 16; p++) {
+        int best = 0, bestError = std::numeric_limits<int>::max();
+        for (int i = 0; i < 4; i++) {
+            int dr = pixels[p][0] - palette[i][0], dg = pixels[p][1] - palette[i][1], db = pixels[p][2] - palette[i][2];
+            int e = dr * dr + dg * dg + db * db;
+            if (e < bestError) {
+                best = i;
+                bestError = e;
+            }
+        }
+        indices[p] = best;
+        error += bestError;
+    }
+    return error;
+}
+
+// Least squares endpoints for the given indices, false when they do not
+// determine them (all pixels on one palette entry)
+static bool refineColorEndpoints(const unsigned char pixels[16][4], const int indices[16], uint16_t& c0, uint16_t& c1)
+{
+    const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+    float aa = 0, ab = 0, bb = 0, ap[3] = {}, bp[3] = {};
+    for (int p = 0; p < 16; p++) {
+        float a = weights[indices[p]], b = 1.0f - a;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int k = 0; k < 3; k++) {
+            ap[k] += a * pixels[p][k];
+            bp[k] += b * pixels[p][k];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (std::fabs(det) < 1e-6f) return false;
+
+    float e0[3], e1[3];
+    for (int k = 0; k < 3; k++) {
+        e0[k] = std::min(255.0f, std::max(0.0f, (bb * ap[k] - ab * bp[k]) / det));
+        e1[k] = std::min(255.0f, std::max(0.0f, (aa * bp[k] - ab * ap[k]) / det));
+    }
+    c0 = packRgb565(e0);
+    c1 = packRgb565(e1);
+    return true;
+}
+
+// BC1 colour block: endpoints on the principal axis of the colours, then a
+// few least squares refinements, the best fit is kept. Always in the four
+// colour mode (c0 > c1), the only one BC3 knows.
+static void encodeColorBlock(const unsigned char pixels[16][4], unsigned char* out)
+{
+    float mean[3] = {};
+    for (int p = 0; p < 16; p++) {
+        for (int k = 0; k < 3; k++) mean[k] += pixels[p][k] / 16.0f;
+    }
+    float cov[3][3] = {};
+    for (int p = 0; p < 16; p++) {
+        float d[3] = { pixels[p][0] - mean[0], pixels[p][1] - mean[1], pixels[p][2] - mean[2] };
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) cov[i][j] += d[i] * d[j];
+        }
+    }
+
+    // Power iteration for the principal axis
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[3];
+        for (int i = 0; i < 3; i++) next[i] = cov[i][0] * axis[0] + cov[i][1] * axis[1] + cov[i][2] * axis[2];
+        float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (length < 1e-6f) break;
+        for (int i = 0; i < 3; i++) axis[i] = next[i] / length;
+    }
+
+    float lowest = std::numeric_limits<float>::max(), highest = -lowest;
+    for (int p = 0; p < 16; p++) {
+        float t = (pixels[p][0] - mean[0]) * axis[0] + (pixels[p][1] - mean[1]) * axis[1] + (pixels[p][2] - mean[2]) * axis[2];
+        lowest = std::min(lowest, t);
+        highest = std::max(highest, t);
+    }
+    // Inset a little, the extremes are rarely worth a palette entry of their own
+    float inset = (highest - lowest) / 16.0f;
+    lowest += inset;
+    highest -= inset;
+    float e0[3], e1[3];
+    for (int k = 0; k < 3; k++) {
+        e0[k] = std::min(255.0f, std::max(0.0f, mean[k] + axis[k] * highest));
+        e1[k] = std::min(255.0f, std::max(0.0f, mean[k] + axis[k] * lowest));
+    }
+
+    uint16_t c0 = packRgb565(e0), c1 = packRgb565(e1);
+    int indices[16];
+    int error = fitColorIndices(pixels, c0, c1, indices);
+    for (int iteration = 0; iteration < 2 && error > 0; iteration++) {
+        uint16_t r0 = c0, r1 = c1;
+        if (!refineColorEndpoints(pixels, indices, r0, r1)) break;
+        int refinedIndices[16];
+        int refinedError = fitColorIndices(pixels, r0, r1, refinedIndices);
+        if (refinedError >= error) break;
+        c0 = r0;
+        c1 = r1;
+        error = refinedError;
+        std::copy(refinedIndices, refinedIndices + 16, indices);
+    }
+
+    // Swapping the endpoints swaps indices 0 and 1, 2 and 3
+    if (c0 < c1) {
+        std::swap(c0, c1);
+        for (int p = 0; p < 16; p++) indices[p] ^= 1;
+    }
+    if (c0 == c1) std::fill(indices, indices + 16, 0);
+
+    uint32_t bits = 0;
+    for (int p = 0; p < 16; p++) bits |= (uint32_t) indices[p] << (2 * p);
+    out[0] = (unsigned char) (c0 & 0xff);
+    out[1] = (unsigned char) (c0 >> 8);
+    out[2] = (unsigned char) (c1 & 0xff);
+    out[3] = (unsigned char) (c1 >> 8);
+    for (int k = 0; k < 4; k++) out[4 + k] = (unsigned char) (bits >> (8 * k));
+}
+
+// The eight values of a single channel block with a0 > a1, rounded like the GPU
+static void channelPalette(int a0, int a1, int palette[8])
+{
+    palette[0] = a0;
+    palette[1] = a1;
+    if (a0 > a1) {
+        for (int i = 1; i < 7; i++) palette[i + 1] = ((7 - i) * a0 + i * a1 + 3) / 7;
+    } else {
+        for (int i = 1; i < 5; i++) palette[i + 1] = ((5 - i) * a0 + i * a1 + 2) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+// BC4 block (BC3 alpha, each channel of BC5): the range of the values in
+// eight steps
+static void encodeChannelBlock(const unsigned char pixels[16][4], int channel, unsigned char* out)
+{
+    int a0 = 0, a1 = 255;
+    for (int p = 0; p < 16; p++) {
+        a0 = std::max(a0, (int) pixels[p][channel]);
+        a1 = std::min(a1, (int) pixels[p][channel]);
+    }
+    int palette[8];
+    channelPalette(a0, a1, palette);
+
+    uint64_t bits = 0;
+    if (a0 > a1) {
+        for (int p = 0; p < 16; p++) {
+            int best = 0, bestError = 256;
+            for (int i = 0; i < 8; i++) {
+                int e = std::abs(pixels[p][channel] - palette[i]);
+                if (e < bestError) {
+                    best = i;
+                    bestError = e;
+                }
+            }
+            bits |= (uint64_t) best << (3 * p);
+        }
+    }
+    out[0] = (unsigned char) a0;
+    out[1] = (unsigned char) a1;
+    for (int k = 0; k < 6; k++) out[2 + k] = (unsigned char) (bits >> (8 * k));
+}
+
+static void encodeBlock(BlockFormat format, const unsigned char pixels[16][4], unsigned char* out)
+{
+    switch (format) {
+    case BLOCK_BC1:
+        encodeColorBlock(pixels, out);
+        break;
+    case BLOCK_BC3:
+        encodeChannelBlock(pixels, 3, out);
+        encodeColorBlock(pixels, out + 8);
+        break;
+    case BLOCK_BC5:
+        encodeChannelBlock(pixels, 0, out);
+        encodeChannelBlock(pixels, 1, out + 8);
+        break;
+    }
+}
+
+static void decodeColorBlock(const unsigned char* in, bool fourColorsOnly, unsigned char pixels[16][4])
+{
+    uint16_t c0 = (uint16_t) (in[0] | (in[1] << 8)), c1 = (uint16_t) (in[2] | (in[3] << 8));
+    int palette[4][3];
+    colorPalette(c0, c1, palette);
+    if (c0 <= c1 && !fourColorsOnly) {
+        for (int k = 0; k < 3; k++) {
+            palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+            palette[3][k] = 0;
+        }
+    }
+    uint32_t bits = in[4] | (in[5] << 8) | (in[6] << 16) | ((uint32_t) in[7] << 24);
+    for (int p = 0; p < 16; p++) {
+        int index = (bits >> (2 * p)) & 3;
+        for (int k = 0; k < 3; k++) pixels[p][k] = (unsigned char) palette[index][k];
+    }
+}
+
+static void decodeChannelBlock(const unsigned char* in, int channel, unsigned char pixels[16][4])
+{
+    int palette[8];
+    channelPalette(in[0], in[1], palette);
+    uint64_t bits = 0;
+    for (int k = 0; k < 6; k++) bits |= (uint64_t) in[2 + k] << (8 * k);
+    for (int p = 0; p < 16; p++) pixels[p][channel] = (unsigned char) palette[(bits >> (3 * p)) & 7];
+}
+
+static void decodeBlock(BlockFormat format, const unsigned char* in, unsigned char pixels[16][4])
+{
+    for (int p = 0; p < 16; p++) {
+        pixels[p][0] = pixels[p][1] = pixels[p][2] = 0;
+        pixels[p][3] = 255;
+    }
+    switch (format) {
+    case BLOCK_BC1:
+        decodeColorBlock(in, false, pixels);
+        break;
+    case BLOCK_BC3:
+        decodeChannelBlock(in, 3, pixels);
+        decodeColorBlock(in + 8, true, pixels);
+        break;
+    case BLOCK_BC5:
+        decodeChannelBlock(in, 0, pixels);
+        decodeChannelBlock(in + 8, 1, pixels);
+        break;
+    }
+}
+
+// Half the size, every pixel the average of the 2x2 below it (of the edge
+// pixels for odd sizes)
+static void downsample(const std::vector<unsigned char>& source, int width, int height, std::vector<unsigned char>& level)
+{
+    int levelWidth = std::max(1, width / 2), levelHeight = std::max(1, height / 2);
+    level.resize((size_t) levelWidth * levelHeight * 4);
+    for (int y = 0; y < levelHeight; y++) {
+        int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+        for (int x = 0; x < levelWidth; x++) {
+            int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+            for (int k = 0; k < 4; k++) {
+                int sum = source[((size_t) y0 * width + x0) * 4 + k] + source[((size_t) y0 * width + x1) * 4 + k]
+                        + source[((size_t) y1 * width + x0) * 4 + k] + source[((size_t) y1 * width + x1) * 4 + k];
+                level[((size_t) y * levelWidth + x) * 4 + k] = (unsigned char) ((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+// Blocks over the edge repeat the last row and column
+static void encodeLevel(BlockFormat format, const unsigned char* rgba, int width, int height, unsigned char* out)
+{
+    int blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+    size_t bytes = blockBytes(format);
+    ThreadPool::shared().parallelFor(blocksHigh, [&](int by) {
+        unsigned char pixels[16][4];
+        for (int bx = 0; bx < blocksWide; bx++) {
+            for (int p = 0; p < 16; p++) {
+                int x = std::min(bx * 4 + p % 4, width - 1), y = std::min(by * 4 + p / 4, height - 1);
+                std::memcpy(pixels[p], rgba + ((size_t) y * width + x) * 4, 4);
+            }
+            encodeBlock(format, pixels, out + ((size_t) by * blocksWide + bx) * bytes);
+        }
+    });
+}
+
+void compressTexture(const unsigned char* rgba, int width, int height, BlockFormat format, CompressedTexture& texture)
+{
+    texture.format = format;
+    texture.width = width;
+    texture.height = height;
+    texture.levelCount = 1;
+    while (levelSize(width, texture.levelCount - 1) > 1 || levelSize(height, texture.levelCount - 1) > 1) texture.levelCount++;
+    texture.blocks.resize(compressedTextureBytes(format, width, height, texture.levelCount));
+
+    std::vector<unsigned char> level(rgba, rgba + (size_t) width * height * 4), next;
+    unsigned char* out = texture.blocks.data();
+    for (int l = 0; l < texture.levelCount; l++) {
+        int levelWidth = levelSize(width, l), levelHeight = levelSize(height, l);
+        encodeLevel(format, level.data(), levelWidth, levelHeight, out);
+        out += compressedLevelBytes(format, levelWidth, levelHeight);
+        if (l + 1 < texture.levelCount) {
+            downsample(level, levelWidth, levelHeight, next);
+            level.swap(next);
+        }
+    }
+}
+
+void decompressLevel(const CompressedTextureView& texture, std::vector<unsigned char>& rgba)
+{
+    int blocksWide = (texture.width + 3) / 4, blocksHigh = (texture.height + 3) / 4;
+    size_t bytes = blockBytes(texture.format);
+    rgba.resize((size_t) texture.width * texture.height * 4);
+    for (int by = 0; by < blocksHigh; by++) {
+        for (int bx = 0; bx < blocksWide; bx++) {
+            unsigned char pixels[16][4];
+            decodeBlock(texture.format, texture.blocks + ((size_t) by * blocksWide + bx) * bytes, pixels);
+            for (int p = 0; p < 16; p++) {
+                int x = bx * 4 + p % 4, y = by * 4 + p / 4;
+                if (x < texture.width && y < texture.height) std::memcpy(&rgba[((size_t) y * texture.width + x) * 4], pixels[p], 4);
+            }
+        }
+    }
+}
+
+double compressionPsnr(BlockFormat format, const unsigned char* rgba, const unsigned char* decoded, int width, int height)
+{
+    int channelCount = 3;
+    if (format == BLOCK_BC3) channelCount = 4;
+    if (format == BLOCK_BC5) channelCount = 2;
+
+    double squaredError = 0;
+    size_t pixelCount = (size_t) width * height;
+    for (size_t p = 0; p < pixelCount; p++) {
+        for (int k = 0; k < channelCount; k++) {
+            double d = (double) rgba[p * 4 + k] - decoded[p * 4 + k];
+            squaredError += d * d;
+        }
+    }
+    double mse = squaredError / ((double) pixelCount * channelCount);
+    if (mse == 0) return std::numeric_limits<double>::infinity();
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+static const char DDS_MAGIC[4] = { 'D', 'D', 'S', ' ' };
+
+static uint32_t fourCC(char a, char b, char c, char d)
+{
+    return (uint32_t) (unsigned char) a | ((uint32_t) (unsigned char) b << 8) | ((uint32_t) (unsigned char) c << 16)
+         | ((uint32_t) (unsigned char) d << 24);
+}
+
+const uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000;
+const uint32_t DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+const uint32_t DDPF_FOURCC = 0x4;
+const uint32_t DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+
+struct DdsPixelFormat
+{
+    uint32_t size;
+    uint32_t flags;
+    uint32_t fourCC;
+    uint32_t rgbBitCount;
+    uint32_t bitMasks[4];
+};
+
+// The magic and the DDS_HEADER, our stamp in the reserved words
+struct DdsHeader
+{
+    char magic[4];
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t linearSize;
+    uint32_t depth;
+    uint32_t mipMapCount;
+    uint32_t tag;            // of the reserved words
+    uint32_t version;
+    uint32_t sourceSize[2];
+    uint32_t sourceTime[2];
+    uint32_t checksum[2];
+    uint32_t reserved[3];
+    DdsPixelFormat pixelFormat;
+    uint32_t caps[4];
+    uint32_t reserved2;
+};
+
+static uint32_t formatFourCC(BlockFormat format)
+{
+    switch (format) {
+    case BLOCK_BC1: return fourCC('D', 'X', 'T', '1');
+    case BLOCK_BC3: return fourCC('D', 'X', 'T', '5');
+    case BLOCK_BC5: return fourCC('A', 'T', 'I', '2');
+    }
+    return 0;
+}
+
+static void splitWords(uint64_t value, uint32_t words[2])
+{
+    words[0] = (uint32_t) value;
+    words[1] = (uint32_t) (value >> 32);
+}
+
+static uint64_t joinWords(const uint32_t words[2])
+{
+    return words[0] | ((uint64_t) words[1] << 32);
+}
+
+std::string compressedTexturePath(const std::string& imagePath)
+{
+    size_t dot = imagePath.find_last_of('.');
+    size_t slash = imagePath.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return imagePath + ".dds";
+    return imagePath.substr(0, dot) + ".dds";
+}
+
+bool writeCompressedTexture(const std::string& path, const std::string& sourcePath, const CompressedTexture& texture)
+{
+    DdsHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, DDS_MAGIC, sizeof(DDS_MAGIC));
+    header.size = sizeof(DdsHeader) - sizeof(header.magic);
+    header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+    header.height = (uint32_t) texture.height;
+    header.width = (uint32_t) texture.width;
+    header.linearSize = (uint32_t) compressedLevelBytes(texture.format, texture.width, texture.height);
+    header.mipMapCount = (uint32_t) texture.levelCount;
+    header.tag = fourCC('G', 'A', 'M', 'E');
+    header.version = COMPRESSED_TEXTURE_VERSION;
+    uint64_t sourceSize = 0;
+    int64_t sourceTime = 0;
+    getSourceStamp(sourcePath, sourceSize, sourceTime);
+    splitWords(sourceSize, header.sourceSize);
+    splitWords((uint64_t) sourceTime, header.sourceTime);
+    splitWords(hashBytes(texture.blocks.data(), texture.blocks.size()), header.checksum);
+    header.pixelFormat.size = sizeof(DdsPixelFormat);
+    header.pixelFormat.flags = DDPF_FOURCC;
+    header.pixelFormat.fourCC = formatFourCC(texture.format);
+    header.caps[0] = DDSCAPS_TEXTURE | DDSCAPS_MIPMAP | DDSCAPS_COMPLEX;
+    return writeAssetFile(path, &header, sizeof(header), texture.blocks);
+}
+
+bool openCompressedTexture(const std::string& path, const std::string& sourcePath, MappedFile& file, CompressedTextureView& view)
+{
+    ArchiveBlob blob;
+    if (!findInArchive(path, blob)) {
+        if (!file.open(path)) return false;
+        blob.data = file.data();
+        blob.size = file.size();
+    }
+
+    DdsHeader header;
+    if (blob.size < sizeof(header)) {
+        std::cerr << path << " is truncated, decoding the image instead" << std::endl;
+        return false;
+    }
+    std::memcpy(&header, blob.data, sizeof(header));
+
+    BlockFormat format = BLOCK_BC1;
+    if (header.pixelFormat.fourCC == formatFourCC(BLOCK_BC3)) format = BLOCK_BC3;
+    if (header.pixelFormat.fourCC == formatFourCC(BLOCK_BC5)) format = BLOCK_BC5;
+    if (std::memcmp(header.magic, DDS_MAGIC, sizeof(DDS_MAGIC)) != 0 || header.tag != fourCC('G', 'A', 'M', 'E')
+        || header.version != COMPRESSED_TEXTURE_VERSION || header.pixelFormat.fourCC != formatFourCC(format)) {
+        std::cerr << path << " is from another version, decoding the image instead" << std::endl;
+        return false;
+    }
+
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if (getSourceStamp(sourcePath, sourceSize, sourceTime)
+        && (sourceSize != joinWords(header.sourceSize) || (uint64_t) sourceTime != joinWords(header.sourceTime))) {
+        std::cerr << path << " is out of date, decoding the image instead" << std::endl;
+        return false;
+    }
+
+    const uint32_t maxSize = 16384;
+    int fullChain = 1;
+    while (levelSize((int) header.width, fullChain - 1) > 1 || levelSize((int) header.height, fullChain - 1) > 1) fullChain++;
+    if (header.width == 0 || header.height == 0 || header.width > maxSize || header.height > maxSize
+        || header.mipMapCount == 0 || header.mipMapCount > (uint32_t) fullChain
+        || blob.size != sizeof(header) + compressedTextureBytes(format, (int) header.width, (int) header.height, (int) header.mipMapCount)) {
+        std::cerr << path << " is corrupt (bad sizes), decoding the image instead" << std::endl;
+        return false;
+    }
+
+    const unsigned char* blocks = blob.data + sizeof(header);
+    if (!blob.verified && hashBytes(blocks, blob.size - sizeof(header)) != joinWords(header.checksum)) {
+        std::cerr << path << " is corrupt (checksum mismatch), decoding the image instead" << std::endl;
+        return false;
+    }
+
+    view.format = format;
+    view.width = (int) header.width;
+    view.height = (int) header.height;
+    view.levelCount = (int) header.mipMapCount;
+    view.blocks = blocks;
+    view.size = blob.size - sizeof(header);
+    return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "MappedFile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Block compressed textures, the formats GPUs sample directly: every 4x4
+// block of pixels is stored in 8 or 16 bytes, 4 to 8 times less than RGBA8.
+// TextureCompressor encodes the images offline into DDS files with their
+// whole mip chain, the game uploads those as they are. No OpenGL, the
+// encoders and decoders run on the CPU.
+enum BlockFormat
+{
+    BLOCK_BC1 = 1,  // RGB, 8 bytes per block (DXT1), for opaque images
+    BLOCK_BC3 = 3,  // RGBA, 16 bytes per block (DXT5), for images with alpha
+    BLOCK_BC5 = 5   // two channels, 16 bytes per block (RGTC2), for normal maps: X and Y, Z is rebuilt from them
+};
+
+size_t blockBytes(BlockFormat format);
+const char* blockFormatName(BlockFormat format);
+
+// Bytes of one mip level, levels smaller than a block still take a whole one
+size_t compressedLevelBytes(BlockFormat format, int width, int height);
+
+struct CompressedTexture
+{
+    BlockFormat format = BLOCK_BC1;
+    int width = 0, height = 0;
+    int levelCount = 0;
+    std::vector<unsigned char> blocks;  // the levels one after the other, largest first
+};
+
+// The blocks wherever they are stored (a CompressedTexture, a mapped DDS file)
+struct CompressedTextureView
+{
+    BlockFormat format = BLOCK_BC1;
+    int width = 0, height = 0;
+    int levelCount = 0;
+    const unsigned char* blocks = nullptr;
+    size_t size = 0;
+};
+
+CompressedTextureView viewTexture(const CompressedTexture& texture);
+
+// Box filtered mip chain of RGBA8 pixels down to 1x1 and every level
+// encoded. The blocks are encoded on the shared thread pool.
+void compressTexture(const unsigned char* rgba, int width, int height, BlockFormat format, CompressedTexture& texture);
+
+// Level 0 decoded back to RGBA8 (missing channels as 0, alpha as 255)
+void decompressLevel(const CompressedTextureView& texture, std::vector<unsigned char>& rgba);
+
+// Peak signal to noise ratio in dB of 'decoded' against 'rgba', over the
+// channels the format stores
+double compressionPsnr(BlockFormat format, const unsigned char* rgba, const unsigned char* decoded, int width, int height);
+
+// Compressed textures are written by TextureCompressor next to the images as
+// standard DDS files, with the size and modification time of the image and a
+// checksum of the blocks in the reserved words of the header
+const uint32_t COMPRESSED_TEXTURE_VERSION = 2;
+
+// "Resources/2k_sun.jpg" -> "Resources/2k_sun.dds"
+std::string compressedTexturePath(const std::string& imagePath);
+
+bool writeCompressedTexture(const std::string& path, const std::string& sourcePath, const CompressedTexture& texture);
+
+// Maps and validates a DDS file, from the mounted archive when it is in there
+// (ResourceArchive.h). The view points into the archive or 'file'. False when
+// the file is missing, older than 'sourcePath' (when that exists), not one of
+// ours or corrupt.
+bool openCompressedTexture(const std::string& path, const std::string& sourcePath, MappedFile& file, CompressedTextureView& view);
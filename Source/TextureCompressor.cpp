@@ -0,0 +1,121 @@
+// Offline compressor from the JPEG and PNG textures to block compressed DDS
+// files with their whole mip chain (TextureCompression.h), written next to the
+// images. Run by the build on the copied Resources folder, before AssetBaker.
+// Every texture is decoded back on the CPU to report its quality.
+//
+//   TextureCompressor <image | directory>...           compresses, directories recursively: BC5 for
+//                                                      normal maps ("normal" in the file name), BC3 for
+//                                                      images with alpha, BC1 for the others. Skips
+//                                                      the images whose DDS file is up to date.
+//   TextureCompressor --force <image | directory>...   compresses all of them
+
+#include "ResourceArchive.h"
+#include "TextureCompression.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static BlockFormat chooseFormat(const std::string& path, const unsigned char* rgba, int width, int height)
+{
+    size_t slash = path.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    if (name.find("normal") != std::string::npos) return BLOCK_BC5;
+
+    for (size_t p = 0; p < (size_t) width * height; p++) {
+        if (rgba[p * 4 + 3] != 255) return BLOCK_BC3;
+    }
+    return BLOCK_BC1;
+}
+
+// What the game uploaded before: RGBA8 and the mipmaps glGenerateMipmap made
+static size_t uncompressedBytes(int width, int height)
+{
+    size_t bytes = 0;
+    for (;;) {
+        bytes += (size_t) width * height * 4;
+        if (width == 1 && height == 1) return bytes;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    bool force = argc > 1 && std::string(argv[1]) == "--force";
+    if (argc < (force ? 3 : 2)) {
+        std::cerr << "Usage: TextureCompressor [--force] <image | directory>..." << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> files;
+    for (int i = force ? 2 : 1; i < argc; i++) findFiles(argv[i], { ".jpg", ".jpeg", ".png" }, files);
+
+    int failures = 0, compressed = 0, upToDate = 0;
+    size_t totalBytes = 0, totalUncompressedBytes = 0;
+    double totalMs = 0, totalPixels = 0;
+    for (const std::string& path : files) {
+        std::string output = compressedTexturePath(path);
+        MappedFile existing;
+        CompressedTextureView view;
+        if (!force && openCompressedTexture(output, path, existing, view)) {
+            upToDate++;
+            continue;
+        }
+
+        int width, height, comp;
+        unsigned char* rgba = stbi_load(path.c_str(), &width, &height, &comp, 4);
+        if (!rgba) {
+            std::cerr << "Could not read " << path << std::endl;
+            failures++;
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        CompressedTexture texture;
+        compressTexture(rgba, width, height, chooseFormat(path, rgba, width, height), texture);
+        double ms = millisecondsSince(start);
+
+        std::vector<unsigned char> decoded;
+        decompressLevel(viewTexture(texture), decoded);
+        double psnr = compressionPsnr(texture.format, rgba, decoded.data(), width, height);
+        stbi_image_free(rgba);
+
+        if (!writeCompressedTexture(output, path, texture)) {
+            std::cerr << "Could not compress " << path << std::endl;
+            failures++;
+            continue;
+        }
+
+        compressed++;
+        size_t before = uncompressedBytes(width, height);
+        double pixels = (double) before / 4;  // of all levels
+        totalBytes += texture.blocks.size();
+        totalUncompressedBytes += before;
+        totalMs += ms;
+        totalPixels += pixels;
+        std::cout << path << " -> " << output << " (" << width << "x" << height << " " << blockFormatName(texture.format) << ", "
+                  << texture.levelCount << " levels)" << std::endl;
+        std::cout << "    " << texture.blocks.size() / 1024 << " KB against " << before / 1024 << " KB of RGBA8 with mipmaps ("
+                  << (double) before / texture.blocks.size() << "x less), PSNR " << psnr << " dB, encoded in " << ms << " ms ("
+                  << pixels / 1000.0 / std::max(ms, 1e-3) << " Mpixels/s)" << std::endl;
+    }
+    if (upToDate > 0) std::cout << upToDate << " textures up to date" << std::endl;
+    if (compressed > 0) {
+        std::cout << "Total: " << compressed << " textures, " << totalBytes / 1024 << " KB against " << totalUncompressedBytes / 1024
+                  << " KB (" << (double) totalUncompressedBytes / std::max(totalBytes, (size_t) 1) << "x less), encoded in "
+                  << totalMs << " ms (" << totalPixels / 1000.0 / std::max(totalMs, 1e-3) << " Mpixels/s)" << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+#include "TextureRegistry.h"
+
+#include <GDT/OpenGL.h>
+
+#include <unordered_map>
+#include <vector>
+
+struct TextureRegistry
+{
+    std::unordered_map<std::string, int> ids;
+    std::vector<std::string> names;
+    std::vector<GLuint> handles;
+
+    GLuint bound = 0;
+    bool boundKnown = false;
+    TextureBindingStats stats;
+};
+
+static TextureRegistry& registry()
+{
+    static TextureRegistry* registry = new TextureRegistry();
+    return *registry;
+}
+
+int registerTexture(const std::string& name)
+{
+    TextureRegistry& textures = registry();
+    auto found = textures.ids.find(name);
+    if (found != textures.ids.end()) return found->second;
+
+    int id = (int) textures.names.size();
+    textures.ids[name] = id;
+    textures.names.push_back(name);
+    textures.handles.push_back(0);
+    return id;
+}
+
+void setTextureHandle(int texture, unsigned int handle)
+{
+    registry().handles[texture] = handle;
+}
+
+unsigned int textureHandle(int texture)
+{
+    return texture >= 0 ? registry().handles[texture] : 0;
+}
+
+const std::string& textureName(int texture)
+{
+    return registry().names[texture];
+}
+
+size_t textureCount()
+{
+    return registry().names.size();
+}
+
+void bindTexture(int texture)
+{
+    TextureRegistry& textures = registry();
+    GLuint handle = textureHandle(texture);
+    glActiveTexture(GL_TEXTURE0);
+    if (textures.boundKnown && textures.bound == handle) {
+        textures.stats.skipped++;
+        return;
+    }
+    glBindTexture(GL_TEXTURE_2D, handle);
+    textures.bound = handle;
+    textures.boundKnown = true;
+    textures.stats.binds++;
+}
+
+void resetTextureBindings()
+{
+    registry().boundKnown = false;
+}
+
+TextureBindingStats getTextureBindingStats()
+{
+    return registry().stats;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Textures by material name, resolved once to a dense id when a model is
+// uploaded (Model::texture), so drawing looks the handle up in an array. The
+// handle of an id changes as the texture loads: 0 until somebody sets one,
+// then e.g. the placeholder of the AssetLoader, then the real texture. Main
+// thread only.
+
+// The id of the texture called 'name', a new one when it is not known yet
+int registerTexture(const std::string& name);
+
+void setTextureHandle(int texture, unsigned int handle);
+unsigned int textureHandle(int texture);
+const std::string& textureName(int texture);
+size_t textureCount();
+
+// Binds the texture to unit 0, the colorMap of the shaders, handle 0 for -1.
+// Skips the bind when that handle is still bound from the draw before.
+void bindTexture(int texture);
+
+// Forgets what bindTexture bound, once per frame before drawing: texture
+// uploads and other code bind textures behind its back
+void resetTextureBindings();
+
+struct TextureBindingStats
+{
+    size_t binds = 0;    // glBindTexture calls made
+    size_t skipped = 0;  // bindTexture calls that found the texture bound
+};
+
+TextureBindingStats getTextureBindingStats();
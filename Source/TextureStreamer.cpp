@@ -0,0 +1,208 @@
+#include "TextureStreamer.h"
+#include "Image.h"
+
+#include <GDT/OpenGL.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+static int levelWidth(const StreamedTexture& texture, int level)
+{
+    return std::max(1, texture.view.width >> level);
+}
+
+static int levelHeight(const StreamedTexture& texture, int level)
+{
+    return std::max(1, texture.view.height >> level);
+}
+
+static size_t levelBytes(const StreamedTexture& texture, int level)
+{
+    return compressedLevelBytes(texture.view.format, levelWidth(texture, level), levelHeight(texture, level));
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    clear();
+}
+
+int TextureStreamer::add(const std::string& path, std::shared_ptr<MappedFile> file, const CompressedTextureView& view)
+{
+    StreamedTexture texture;
+    texture.path = path;
+    texture.file = std::move(file);
+    texture.view = view;
+    size_t offset = 0;
+    for (int level = 0; level < view.levelCount; level++) {
+        texture.levelOffsets.push_back(offset);
+        offset += levelBytes(texture, level);
+    }
+    while (texture.minResidentLevel < view.levelCount - 1
+           && std::max(levelWidth(texture, texture.minResidentLevel), levelHeight(texture, texture.minResidentLevel)) > minResidentSize) {
+        texture.minResidentLevel++;
+    }
+    texture.wantedLevel = texture.minResidentLevel;
+
+    glGenTextures(1, &texture.handle);
+    glBindTexture(GL_TEXTURE_2D, texture.handle);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, view.levelCount - 1);
+    texture.residentLevel = view.levelCount;
+    for (int level = view.levelCount - 1; level >= texture.minResidentLevel; level--) {
+        uploadLevel(texture, level);
+    }
+
+    trackTextureMemory(texture.handle, texture.path, 0, texture.gpuBytes, true);
+    textures.push_back(std::move(texture));
+    return (int) textures.size() - 1;
+}
+
+void TextureStreamer::request(int id, float texels)
+{
+    StreamedTexture& texture = textures[id];
+
+    // The coarsest level that still has that many texels across
+    int level = texture.minResidentLevel;
+    while (level > 0 && levelWidth(texture, level) < texels) level--;
+
+    texture.wantedLevel = texture.lastUsedFrame == frame ? std::min(texture.wantedLevel, level) : level;
+    texture.lastUsedFrame = frame;
+}
+
+void TextureStreamer::update()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // The textures drawn this frame that lack levels, the ones missing the
+    // most first. One level each per frame, so they sharpen from coarse to fine.
+    std::vector<int> missing;
+    for (int id = 0; id < (int) textures.size(); id++) {
+        const StreamedTexture& texture = textures[id];
+        if (texture.lastUsedFrame == frame && texture.wantedLevel < texture.residentLevel) missing.push_back(id);
+    }
+    std::sort(missing.begin(), missing.end(), [this](int a, int b) {
+        return textures[a].residentLevel - textures[a].wantedLevel > textures[b].residentLevel - textures[b].wantedLevel;
+    });
+
+    bool overBudget = false;
+    for (int id : missing) {
+        double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (elapsedMs >= uploadBudgetMs) break;
+
+        StreamedTexture& texture = textures[id];
+        int level = texture.residentLevel - 1;
+        if (!evictFor(levelBytes(texture, level))) {
+            overBudget = true;
+            continue;
+        }
+        uploadLevel(texture, level);
+        trackTextureMemory(texture.handle, texture.path, 0, texture.gpuBytes, true);
+        stats.uploadedLevels++;
+    }
+
+    double frameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (!missing.empty()) {
+        stats.uploadMs += frameMs;
+        stats.maxFrameUploadMs = std::max(stats.maxFrameUploadMs, frameMs);
+    }
+    if (overBudget) stats.budgetViolations++;
+    frame++;
+}
+
+// Frees levels until 'bytes' more fit in the budget: the levels no longer
+// needed by the textures drawn this frame and all but the small levels of the
+// others, least recently used first. False when the levels needed this frame
+// alone take the budget.
+bool TextureStreamer::evictFor(size_t bytes)
+{
+    while (stats.residentBytes + bytes > memoryBudget) {
+        int victim = -1;
+        for (int id = 0; id < (int) textures.size(); id++) {
+            const StreamedTexture& texture = textures[id];
+            int needed = texture.lastUsedFrame == frame ? texture.wantedLevel : texture.minResidentLevel;
+            if (texture.residentLevel >= needed) continue;
+            if (victim < 0 || texture.lastUsedFrame < textures[victim].lastUsedFrame
+                || (texture.lastUsedFrame == textures[victim].lastUsedFrame && texture.gpuBytes > textures[victim].gpuBytes)) {
+                victim = id;
+            }
+        }
+        if (victim < 0) return false;
+        evictLevel(textures[victim]);
+        trackTextureMemory(textures[victim].handle, textures[victim].path, 0, textures[victim].gpuBytes, true);
+        stats.evictedLevels++;
+    }
+    return true;
+}
+
+void TextureStreamer::uploadLevel(StreamedTexture& texture, int level)
+{
+    size_t bytes = levelBytes(texture, level);
+    glBindTexture(GL_TEXTURE_2D, texture.handle);
+    const unsigned char* blocks = stageTextureUpload(texture.view.blocks + texture.levelOffsets[level], bytes);
+    glCompressedTexImage2D(GL_TEXTURE_2D, level, compressedTextureFormat(texture.view.format),
+                           levelWidth(texture, level), levelHeight(texture, level), 0, (GLsizei) bytes, blocks);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+
+    texture.residentLevel = level;
+    texture.gpuBytes += bytes;
+    stats.residentBytes += bytes;
+}
+
+void TextureStreamer::evictLevel(StreamedTexture& texture)
+{
+    int level = texture.residentLevel;
+    size_t bytes = levelBytes(texture, level);
+    glBindTexture(GL_TEXTURE_2D, texture.handle);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+    // An empty image releases the storage of the level
+    glCompressedTexImage2D(GL_TEXTURE_2D, level, compressedTextureFormat(texture.view.format), 0, 0, 0, 0, nullptr);
+
+    texture.residentLevel = level + 1;
+    texture.gpuBytes -= bytes;
+    stats.residentBytes -= bytes;
+}
+
+void TextureStreamer::clear()
+{
+    for (StreamedTexture& texture : textures) {
+        untrackTextureMemory(texture.handle);
+        glDeleteTextures(1, &texture.handle);
+    }
+    textures.clear();
+    stats.residentBytes = 0;
+}
+
+std::vector<TextureResidency> TextureStreamer::getResidency() const
+{
+    std::vector<TextureResidency> residency;
+    for (const StreamedTexture& texture : textures) {
+        TextureResidency entry;
+        entry.path = texture.path;
+        entry.width = texture.view.width;
+        entry.height = texture.view.height;
+        entry.levelCount = texture.view.levelCount;
+        entry.residentLevel = texture.residentLevel;
+        entry.wantedLevel = texture.wantedLevel;
+        entry.gpuBytes = texture.gpuBytes;
+        entry.lastUsedFrame = texture.lastUsedFrame;
+        residency.push_back(entry);
+    }
+    return residency;
+}
+
+void TextureStreamer::printResidency() const
+{
+    std::cout << "Texture streaming at frame " << frame << ": " << textures.size() << " textures, resident "
+              << stats.residentBytes / 1024 << " KB of " << memoryBudget / 1024 << " KB"
+              << ", uploaded " << stats.uploadedLevels << " levels (worst frame " << stats.maxFrameUploadMs << " ms)"
+              << ", evicted " << stats.evictedLevels << " levels, budget violations " << stats.budgetViolations << std::endl;
+    for (const TextureResidency& entry : getResidency()) {
+        std::cout << "    " << entry.path << ": " << entry.width << "x" << entry.height << ", levels " << entry.residentLevel
+                  << "-" << entry.levelCount - 1 << " resident (" << std::max(1, entry.width >> entry.residentLevel) << "x"
+                  << std::max(1, entry.height >> entry.residentLevel) << ", " << entry.gpuBytes / 1024 << " KB), wants level "
+                  << entry.wantedLevel << ", last drawn in frame " << entry.lastUsedFrame << std::endl;
+    }
+}
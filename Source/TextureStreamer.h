@@ -0,0 +1,95 @@
+#pragma once
+#include "MappedFile.h"
+#include "TextureCompression.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct StreamedTexture
+{
+    std::string path;
+    unsigned int handle = 0;
+    std::shared_ptr<MappedFile> file;  // open while the view points into it, unused for the archive
+    CompressedTextureView view;
+    std::vector<size_t> levelOffsets;  // into view.blocks
+
+    int minResidentLevel = 0;          // the levels from here down to 1x1 are always on the GPU
+    int residentLevel = 0;             // finest level on the GPU, the base level of the texture
+    int wantedLevel = 0;               // finest level the last request asked for
+    size_t gpuBytes = 0;
+    unsigned long lastUsedFrame = 0;
+};
+
+// One line of the residency dump
+struct TextureResidency
+{
+    std::string path;
+    int width = 0, height = 0;
+    int levelCount = 0;
+    int residentLevel = 0;
+    int wantedLevel = 0;
+    size_t gpuBytes = 0;
+    unsigned long lastUsedFrame = 0;
+};
+
+struct TextureStreamingStats
+{
+    size_t uploadedLevels = 0;
+    size_t evictedLevels = 0;
+    size_t budgetViolations = 0; // frames where the requested levels alone exceeded the budget
+
+    double uploadMs = 0;         // main thread time spent uploading
+    double maxFrameUploadMs = 0; // worst upload time of a single frame
+
+    size_t residentBytes = 0;
+};
+
+// Mip level streaming of the block compressed textures (TextureCompression.h).
+// A texture starts with its small levels on the GPU only, the finer ones are
+// uploaded when the objects using it are drawn large enough on screen to need
+// them, one level per texture and frame, from the mapped DDS file. When the
+// streamed textures take more than memoryBudget bytes, the finest levels of
+// the least recently used ones are freed again. The GL texture stays the
+// same, only its base level moves.
+class TextureStreamer
+{
+public:
+    int minResidentSize = 64;              // levels up to this size are uploaded at once and never freed
+    size_t memoryBudget = 8 * 1024 * 1024; // GPU bytes of all streamed textures
+    double uploadBudgetMs = 2.0;           // stop uploading once a frame spent this long on it
+
+    ~TextureStreamer();
+
+    // Creates the texture with the small levels of 'view', which points into
+    // 'file' or the mounted archive. Main thread. Returns its id.
+    int add(const std::string& path, std::shared_ptr<MappedFile> file, const CompressedTextureView& view);
+
+    unsigned int handle(int texture) const { return textures[texture].handle; }
+    const StreamedTexture& texture(int texture) const { return textures[texture]; }
+
+    // An object drawn this frame needs 'texels' texels across the width of
+    // the texture, at most one per pixel it covers on screen
+    void request(int texture, float texels);
+
+    // Uploads the requested levels and evicts under the budget, once per
+    // frame after the draws
+    void update();
+
+    // Frees every texture
+    void clear();
+
+    std::vector<TextureResidency> getResidency() const;
+    TextureStreamingStats getStats() const { return stats; }
+    void printResidency() const;
+
+private:
+    bool evictFor(size_t bytes);
+    void uploadLevel(StreamedTexture& texture, int level);
+    void evictLevel(StreamedTexture& texture);
+
+    std::vector<StreamedTexture> textures;
+    unsigned long frame = 1;  // textures never drawn have lastUsedFrame 0
+    TextureStreamingStats stats;
+};
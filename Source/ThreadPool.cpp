@@ -0,0 +1,84 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+
+ThreadPool::ThreadPool(unsigned int numThreads)
+{
+    if (numThreads == 0) {
+        numThreads = std::thread::hardware_concurrency();
+        if (numThreads == 0) numThreads = 1;
+    }
+
+    for (unsigned int i = 0; i < numThreads; i++) {
+        workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> task)
+{
+    std::packaged_task<void()> packaged(task);
+    std::future<void> result = packaged.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push(std::move(packaged));
+    }
+    condition.notify_one();
+    return result;
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)>& body)
+{
+    if (count <= 0) return;
+
+    // One task per worker, each pulling indices until the range is exhausted,
+    // so uneven tiles balance out without queueing count tasks
+    std::atomic<int> next(0);
+    int numTasks = std::min<int>(count, (int) workers.size());
+
+    std::vector<std::future<void>> pending;
+    for (int t = 0; t < numTasks; t++) {
+        pending.push_back(submit([&next, count, &body]() {
+            for (int i = next++; i < count; i = next++) {
+                body(i);
+            }
+        }));
+    }
+
+    // get() rethrows any exception raised inside a task
+    for (auto& f : pending) f.get();
+}
+
+ThreadPool& ThreadPool::shared()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::workerLoop()
+{
+    while (true) {
+        std::packaged_task<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty()) return;
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads used for the CPU-heavy parts of the game
+// (terrain generation, asset decoding). Tasks must not touch OpenGL, only the
+// main thread owns the context.
+class ThreadPool
+{
+public:
+    // numThreads = 0 uses one worker per hardware thread
+    explicit ThreadPool(unsigned int numThreads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    std::future<void> submit(std::function<void()> task);
+
+    // Runs body(0) ... body(count - 1) on the workers and blocks until all of
+    // them are done. Must not be called from inside a task of the same pool.
+    void parallelFor(int count, const std::function<void(int)>& body);
+
+    unsigned int size() const { return (unsigned int) workers.size(); }
+
+    // Pool shared by the whole application
+    static ThreadPool& shared();
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::queue<std::packaged_task<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+};